@@ -0,0 +1,37 @@
+#ifndef AUDIOCODEC_H
+#define AUDIOCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include "AudioFormat.h"
+
+// Low-complexity codecs for the satellite uplink. All functions work on interleaved
+// S16LE samples; encoders are branch-light and process channels in lockstep so they
+// stay cheap on Pi-class clients.
+//
+// MuLaw:    G.711 mu-law, one byte per sample (2x).
+// ImaAdpcm: self-describing blocks of up to kAdpcmBlockFrames frames (~4x). Each block is
+//           a LE16 frame count followed by, per channel, the first sample (LE16) and the
+//           step index (1 byte + 1 reserved), then 4-bit codes for the remaining frames,
+//           channel-interleaved, low nibble first. Blocks can be concatenated freely, so
+//           separately encoded frames of one stream decode as a whole.
+
+constexpr size_t kAdpcmBlockFrames = 1017;
+
+// Upper bound of the encoded size of `frames` sample frames
+size_t maxEncodedAudioSize(CodecType codec, size_t frames, uint8_t channels);
+
+// Encodes interleaved S16LE samples, returns the number of bytes written to out
+size_t encodeAudio(CodecType codec, const uint8_t *pcm, size_t frames, uint8_t channels, uint8_t *out);
+
+// Number of S16LE bytes decodeAudio() would produce, 0 when the data is malformed
+size_t decodedAudioSize(CodecType codec, const uint8_t *data, size_t length, uint8_t channels);
+
+// Decodes to interleaved S16LE samples, returns the number of bytes written to out
+size_t decodeAudio(CodecType codec, const uint8_t *data, size_t length, uint8_t channels, uint8_t *out);
+
+// Integer-factor downsampling by averaging each run of `factor` frames. Trailing frames
+// that do not fill a run are dropped. out may alias pcm. Returns the frames written.
+size_t downsampleAudio(const uint8_t *pcm, size_t frames, uint8_t channels, int factor, uint8_t *out);
+
+#endif // AUDIOCODEC_H
@@ -0,0 +1,45 @@
+#ifndef AUDIOCONVERT_H
+#define AUDIOCONVERT_H
+
+#include <cstddef>
+#include <cstdint>
+#include "AudioFormat.h"
+
+// PCM conversion stage in front of the transcriber: interleaved S16LE/S24LE/S32LE/F32LE
+// samples become normalized mono float32, optionally with the DC offset removed.
+// Every kernel has a scalar reference; the SSE2/NEON variants produce bit-identical output.
+
+enum class ConvertPath
+{
+    Scalar,
+    Simd // Falls back to Scalar when the build has no SSE2 or NEON
+};
+
+// True when ConvertPath::Simd runs vector code in this build
+bool simdConvertAvailable();
+
+// Bytes convertToMonoFloatInPlace() needs for `length` input bytes
+size_t monoFloatBytes(const AudioFormat &format, size_t length);
+
+// Converts and downmixes interleaved frames to mono float. out may alias in as long as
+// the output does not overtake the input, i.e. when each frame is at least 4 bytes.
+// Returns the number of frames written, 0 for unsupported formats.
+size_t convertToMonoFloat(const uint8_t *in, size_t frames, const AudioFormat &format, float *out, ConvertPath path = ConvertPath::Simd);
+
+// Converts `length` bytes at data in place. capacity must be at least monoFloatBytes().
+size_t convertToMonoFloatInPlace(uint8_t *data, size_t length, size_t capacity, const AudioFormat &format, ConvertPath path = ConvertPath::Simd);
+
+// Per-sample conversion without downmixing, for interleaved data that keeps its channels
+void convertSamplesToFloat(const uint8_t *in, size_t samples, SampleFormat format, float *out, ConvertPath path = ConvertPath::Simd);
+
+// Rounds normalized float samples back to S16LE, clipping out-of-range values
+void convertFloatToS16(const float *in, size_t samples, uint8_t *out);
+
+// Subtracts the mean of the signal
+void removeDcOffset(float *samples, size_t count, ConvertPath path = ConvertPath::Simd);
+
+// Times the scalar and SIMD paths for every supported format and checks that they match.
+// Returns false when any SIMD output differs from the scalar reference.
+bool runAudioConvertBenchmark(size_t frames = 1 << 20, int iterations = 20);
+
+#endif // AUDIOCONVERT_H
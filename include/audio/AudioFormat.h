@@ -0,0 +1,34 @@
+#ifndef AUDIOFORMAT_H
+#define AUDIOFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class SampleFormat : uint8_t
+{
+    Unknown = 0,
+    S16LE = 1,
+    S24LE = 2, // Packed, 3 bytes per sample
+    S32LE = 3,
+    F32LE = 4
+};
+
+// Compression applied on the uplink, the sample format then describes the decoded samples
+enum class CodecType : uint8_t
+{
+    PCM = 0,
+    MuLaw = 1,   // G.711 mu-law, 8 bits per sample
+    ImaAdpcm = 2 // Blocked IMA-ADPCM, 4 bits per sample
+};
+
+struct AudioFormat
+{
+    uint32_t sampleRate = 16000;
+    uint8_t channels = 1;
+    SampleFormat sampleFormat = SampleFormat::F32LE;
+    CodecType codec = CodecType::PCM;
+
+    size_t bytesPerSample() const;
+};
+
+#endif // AUDIOFORMAT_H
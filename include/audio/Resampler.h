@@ -0,0 +1,51 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Streaming polyphase resampler for interleaved float audio with arbitrary rational ratios
+// (e.g. 44100 -> 16000 is up 160, down 441). The windowed-sinc filter bank is computed once
+// per ratio and shared between instances. Consecutive process() calls continue the signal
+// seamlessly; the output lags the input by half the filter length.
+class Resampler
+{
+public:
+    // tapsPerPhase is rounded up to a multiple of 4 for the vector dot product.
+    // Throws std::invalid_argument for zero rates or ratios whose bank would be unreasonably large.
+    Resampler(uint32_t inputRate, uint32_t outputRate, uint8_t channels = 1, size_t tapsPerPhase = 32);
+
+    // Resamples `frames` interleaved frames, returns the number of frames written to out.
+    // out must hold maxOutputFrames(frames) frames and must not alias in.
+    size_t process(const float *in, size_t frames, float *out);
+
+    size_t maxOutputFrames(size_t inputFrames) const;
+
+    // Forgets the signal history, for starting a new stream
+    void reset();
+
+    uint32_t inputRate() const { return inputRate_; }
+    uint32_t outputRate() const { return outputRate_; }
+
+private:
+    struct FilterBank
+    {
+        uint32_t up;
+        uint32_t down;
+        size_t taps;
+        std::vector<float> coefficients; // up phases of `taps` coefficients, reversed for the dot product
+    };
+
+    static std::shared_ptr<const FilterBank> filterBank(uint32_t up, uint32_t down, size_t taps);
+
+    uint32_t inputRate_;
+    uint32_t outputRate_;
+    uint8_t channels_;
+    std::shared_ptr<const FilterBank> bank_;
+    std::vector<std::vector<float>> buffers_; // Per channel: taps - 1 frames of history followed by the current input
+    uint64_t time_; // Position of the next output in units of 1/up input frames, relative to the current input
+};
+
+#endif // RESAMPLER_H
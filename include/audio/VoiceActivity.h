@@ -0,0 +1,40 @@
+#ifndef VOICEACTIVITY_H
+#define VOICEACTIVITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Voice activity detection in front of the transcriber. The signal is cut into short frames;
+// a frame counts as speech when its energy clears the noise floor estimated from the same
+// upload by a margin and its zero-crossing rate is not that of broadband noise. Short speech
+// bursts are dropped as clicks, short pauses are bridged, and every segment keeps a little
+// padding so word onsets survive the trim.
+
+struct VadParams
+{
+    int frame_ms = 20;
+    float margin_db = 12.0f;             // Speech must be this far above the noise floor
+    float min_speech_db = -50.0f;        // Frames quieter than this are never speech (dBFS)
+    float max_zero_crossing_rate = 0.4f; // Crossings per sample above which a frame sounds like hiss
+    int min_speech_ms = 120;             // Shorter speech runs are dropped as clicks
+    int max_gap_ms = 500;                // Shorter pauses are kept inside the segment
+    int padding_ms = 150;                // Audio kept before and after every segment
+    int join_gap_ms = 100;               // Silence left between segments by trimToSpeech()
+};
+
+struct SpeechSegment
+{
+    size_t begin; // First sample
+    size_t end;   // One past the last sample
+};
+
+// Finds the speech segments in mono float audio, ordered and non-overlapping. Empty when the
+// upload holds nothing but silence or noise.
+std::vector<SpeechSegment> detectSpeech(const float *samples, size_t count, uint32_t sampleRate, const VadParams &params = VadParams());
+
+// Drops the silence around and between the speech segments in place, joining the segments
+// with join_gap_ms of silence. Returns the remaining sample count, 0 when there is no speech.
+size_t trimToSpeech(float *samples, size_t count, uint32_t sampleRate, const VadParams &params = VadParams());
+
+#endif // VOICEACTIVITY_H
@@ -0,0 +1,74 @@
+#ifndef FAST_TOKENIZER_H
+#define FAST_TOKENIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// An input sentence split into words once. Words are lowercased and cut at the punctuation
+// the Keras tokenizer filtered at training time; each keeps its span in the original text and
+// a hash of its normalized bytes, so any number of vocabularies can look it up without
+// splitting or hashing again. Fixed capacity, filling it never allocates.
+struct TokenizedText
+{
+    static constexpr size_t kMaxWords = 128;
+    static constexpr size_t kMaxChars = 1024;
+
+    struct Word
+    {
+        uint32_t source;        // Offset of the word in the original text
+        uint32_t source_length;
+        uint16_t offset;        // Offset of the normalized word in normalized
+        uint16_t length;
+        uint64_t hash;
+    };
+
+    char normalized[kMaxChars];
+    Word words[kMaxWords];
+    size_t count = 0;
+    bool truncated = false; // Words past the capacity were dropped
+
+    std::string_view Normalized(size_t i) const { return {normalized + words[i].offset, words[i].length}; }
+    std::string_view Source(std::string_view text, size_t i) const { return text.substr(words[i].source, words[i].source_length); }
+};
+
+// Vocabulary lookup for TokenizedText: every word of the vocabulary is stored once in a single
+// character arena and indexed by an open-addressing table sized for a load factor of at most
+// one half, so a lookup is a hash probe or two and one memcmp.
+class FastTokenizer
+{
+public:
+    static void Split(std::string_view text, TokenizedText &out);
+
+    // Builds the table from a word -> index map, words are lowercased like the input
+    void Build(const std::unordered_map<std::string, int> &word_index);
+
+    // Index of a word as written, -1 when it is not in the vocabulary
+    int32_t Find(std::string_view word) const;
+
+    // Writes the indices of the first `length` words to ids, zero padded; missing words become `unknown`
+    void Encode(const TokenizedText &text, int32_t *ids, size_t length, int32_t unknown) const;
+
+    size_t Size() const { return size_; }
+
+private:
+    struct Slot
+    {
+        uint64_t hash;
+        uint32_t offset;
+        uint32_t length; // 0 marks an empty slot
+        int32_t id;
+    };
+
+    int32_t Lookup(std::string_view word, uint64_t hash) const;
+
+    std::vector<Slot> slots_;
+    std::string arena_;
+    size_t mask_ = 0;
+    size_t size_ = 0;
+};
+
+#endif // FAST_TOKENIZER_H
@@ -0,0 +1,108 @@
+#ifndef MICRO_BATCHER_H
+#define MICRO_BATCHER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Groups inputs that arrive within a few milliseconds of each other into one batched call.
+// The first caller of a batch becomes its leader: it waits up to maxDelay for others to join
+// (or until the batch is full), runs the batch function on its own thread and hands every
+// follower its result. No extra thread is involved, and several batches can run at once when
+// the batch function allows it, e.g. on a ModelRunner interpreter pool.
+template <typename Result>
+class MicroBatcher
+{
+public:
+    using BatchFunction = std::function<std::vector<Result>(const std::vector<std::string> &inputs)>;
+
+    MicroBatcher(BatchFunction run, size_t maxBatch, std::chrono::microseconds maxDelay)
+        : run_(std::move(run)), maxBatch_(std::max<size_t>(1, maxBatch)), maxDelay_(maxDelay) {}
+
+    // Blocks until the batch holding input has run; rethrows what the batch function threw
+    Result run(const std::string &input)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        std::shared_ptr<Batch> batch = open_;
+        const bool leader = !batch;
+        if (leader)
+        {
+            batch = std::make_shared<Batch>();
+            open_ = batch;
+        }
+        const size_t index = batch->inputs.size();
+        batch->inputs.push_back(input);
+        if (batch->inputs.size() >= maxBatch_)
+        {
+            open_.reset();
+            changed_.notify_all();
+        }
+
+        if (!leader)
+        {
+            changed_.wait(lock, [&batch]
+                          { return batch->done; });
+            return take(*batch, index);
+        }
+
+        changed_.wait_for(lock, maxDelay_, [this, &batch]
+                          { return open_ != batch; });
+        if (open_ == batch)
+        {
+            open_.reset();
+        }
+        lock.unlock();
+
+        try
+        {
+            batch->results = run_(batch->inputs);
+            if (batch->results.size() != batch->inputs.size())
+            {
+                throw std::runtime_error("Batch function returned " + std::to_string(batch->results.size()) + " results for " + std::to_string(batch->inputs.size()) + " inputs");
+            }
+        }
+        catch (...)
+        {
+            batch->error = std::current_exception();
+        }
+
+        lock.lock();
+        batch->done = true;
+        changed_.notify_all();
+        return take(*batch, index);
+    }
+
+private:
+    struct Batch
+    {
+        std::vector<std::string> inputs; // Only appended to while the batch is open
+        std::vector<Result> results;
+        std::exception_ptr error;
+        bool done = false;
+    };
+
+    static Result take(Batch &batch, size_t index)
+    {
+        if (batch.error)
+        {
+            std::rethrow_exception(batch.error);
+        }
+        return std::move(batch.results[index]);
+    }
+
+    BatchFunction run_;
+    const size_t maxBatch_;
+    const std::chrono::microseconds maxDelay_;
+    std::mutex mutex_;
+    std::condition_variable changed_; // Batch closed or finished
+    std::shared_ptr<Batch> open_;     // Batch new callers join, null when none is collecting
+};
+
+#endif // MICRO_BATCHER_H
@@ -10,26 +10,100 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <functional>
+#include "FastTokenizer.h"
+#include "TensorView.h"
 
+// A run of consecutive words the NER model tagged with the same entity type
+struct EntitySpan
+{
+    std::string type;       // Label without its B-/I- prefix, e.g. "DEV"
+    std::string text;       // The words as written in the input
+    size_t begin = 0;       // Offset of the span in the input
+    size_t length = 0;
+    float confidence = 0.f; // Lowest word probability in the span
+};
+
+struct ModelRunnerParams
+{
+    int interpreters = 2;            // Interpreters built from the shared model, bounds concurrent inferences
+    int threads_per_interpreter = 1; // Threads each Invoke() may use
+    bool xnnpack = false;            // Hand supported ops to the XNNPACK delegate
+    int xnnpack_threads = 0;         // Threads of each interpreter's XNNPACK pool, 0 uses threads_per_interpreter
+};
+
+// Runs a TFLite text model. The flatbuffer is loaded once and shared by a pool of interpreters;
+// every inference leases one for its duration, so all methods are safe to call from any thread
+// once the tokenizer and labels are loaded. Inputs and outputs may be float32, fp16 or int8/uint8
+// quantized; quantized tensors are converted with their own scale and zero point.
 class ModelRunner
 {
 public:
-    ModelRunner(const std::string &model_path);
+    ModelRunner(const std::string &model_path, const ModelRunnerParams &params = ModelRunnerParams());
     bool IsLoaded() const;
     void LoadTokenizer(const std::string &tokenizer_path);
     void LoadLabels(const std::string &labels_path);
     bool RunInference(const std::string &input_text, std::vector<std::vector<float>> &result);
+
+    // Same as above for text already split by FastTokenizer::Split(), which lets several
+    // models share one split of the same input
+    bool RunInference(const TokenizedText &text, std::vector<std::vector<float>> &result);
+
+    // Runs all inputs through one Invoke() on a [N, max_len] input; results[i] holds the rows
+    // RunInference would have returned for inputs[i]
+    bool RunBatchInference(const std::vector<std::string> &inputs, std::vector<std::vector<std::vector<float>>> &results);
+    bool RunBatchInference(const TokenizedText *texts, size_t count, std::vector<std::vector<std::vector<float>>> &results);
+
+    // Zero-copy variant: consume(i, rows) receives the output for texts[i] as a view into the
+    // interpreter's output tensor, [1, classes] for classification and [max_len, entities] for
+    // NER. A view is only valid during that call, the interpreter goes back to the pool after.
+    // Float outputs are not copied, fp16 and quantized ones are dequantized once per Invoke().
+    using OutputConsumer = std::function<void(size_t index, const TensorView &rows)>;
+    void RunBatchInference(const TokenizedText *texts, size_t count, const OutputConsumer &consume);
     std::pair<std::string, std::vector<std::string>> PredictlabelFromInput(const std::string &input);
     std::string ClassifySentence(const std::string &input);
+    std::vector<std::string> ClassifySentences(const std::vector<std::string> &inputs);
+
+    // Post-processing of the rows handed to an OutputConsumer: the intent label (confidence
+    // receives the top probability) for a classification model, typed spans for an NER model
+    std::string LabelClassification(const TensorView &results, float *confidence = nullptr) const;
+    std::vector<EntitySpan> LabelEntities(std::string_view input, const TokenizedText &text, const TensorView &rows) const;
 
 private:
-    std::vector<int> TokenizeInput(const std::string &input_text);
+    // Checks an interpreter out of the pool for the lifetime of the lease
+    class InterpreterLease
+    {
+    public:
+        explicit InterpreterLease(ModelRunner &owner);
+        ~InterpreterLease();
+        InterpreterLease(const InterpreterLease &) = delete;
+        InterpreterLease &operator=(const InterpreterLease &) = delete;
+
+        tflite::Interpreter *operator->() const { return interpreter_; }
+        tflite::Interpreter *get() const { return interpreter_; }
+
+    private:
+        ModelRunner &owner_;
+        tflite::Interpreter *interpreter_;
+    };
+
+    TfLiteTensor *PrepareInput(tflite::Interpreter &interpreter, size_t rows);
 
     std::unique_ptr<tflite::FlatBufferModel> model_;
-    std::unique_ptr<tflite::Interpreter> interpreter_;
+    std::vector<tflite::Interpreter::TfLiteDelegatePtr> delegates_; // Must outlive the interpreters using them
+    std::vector<std::unique_ptr<tflite::Interpreter>> interpreters_;
+    std::vector<tflite::Interpreter *> free_interpreters_;
+    std::mutex pool_mutex_;
+    std::condition_variable interpreter_returned_;
     std::unordered_map<int, std::string> labels_;
     std::unordered_map<int, std::string> tokenizer_index_word_;
-    std::unordered_map<std::string, int> tokenizer_word_index_;
+    FastTokenizer vocabulary_;
+    int unknown_index_ = 0; // Index of "<UNK>", 0 when the vocabulary has none
+    std::atomic<bool> batch_resizable_{true}; // Cleared when the model rejects a batch dimension
     int max_length_;
 };
 
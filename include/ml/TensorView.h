@@ -0,0 +1,43 @@
+#ifndef TENSOR_VIEW_H
+#define TENSOR_VIEW_H
+
+#include <cstddef>
+
+// Non-owning row-major view of a [rows, cols] block of floats, typically a model's output
+// tensor. It does not keep the buffer alive; see ModelRunner::RunBatchInference() for how
+// long the views it hands out stay valid.
+class TensorView
+{
+public:
+    TensorView() = default;
+    TensorView(const float *data, size_t rows, size_t cols) : data_(data), rows_(rows), cols_(cols) {}
+
+    size_t Rows() const { return rows_; }
+    size_t Cols() const { return cols_; }
+    bool Empty() const { return rows_ == 0 || cols_ == 0; }
+
+    const float *Row(size_t row) const { return data_ + row * cols_; }
+    float operator()(size_t row, size_t col) const { return data_[row * cols_ + col]; }
+
+    // Rows [first, first + count) of this view
+    TensorView Slice(size_t first, size_t count) const { return TensorView(Row(first), count, cols_); }
+
+private:
+    const float *data_ = nullptr;
+    size_t rows_ = 0;
+    size_t cols_ = 0;
+};
+
+// Row kernels, SSE2 or NEON where available with a scalar tail
+
+// Index of the largest value, the first one on ties; count must not be 0
+size_t ArgMaxRow(const float *values, size_t count);
+
+// Writes the indices of the k largest values to indices, largest first, and returns how many
+// were written (k or count, whichever is smaller)
+size_t TopKRow(const float *values, size_t count, size_t k, size_t *indices);
+
+// out = softmax(values); out may be values itself
+void SoftmaxRow(const float *values, size_t count, float *out);
+
+#endif // TENSOR_VIEW_H
@@ -0,0 +1,28 @@
+#ifndef UTTERANCE_UNDERSTANDING_H
+#define UTTERANCE_UNDERSTANDING_H
+
+#include "ModelRunner.h"
+#include <string>
+#include <vector>
+
+// Everything the NLU models extract from one command
+struct Utterance
+{
+    std::string intent = "Unknown";
+    float confidence = 0.f; // Probability of the top intent class
+    std::vector<EntitySpan> entities;
+
+    // Entities as {type, text} pairs, the shape Task::entities carries them in
+    std::vector<std::vector<std::string>> EntityList() const;
+};
+
+// Splits the input once and runs the NER and classification models on it concurrently, each on
+// an interpreter leased from its own pool. NER runs on a single NLU thread that lives as long
+// as the process, or on the calling thread when that one is busy. Either model may be null or
+// not loaded, its part of the result is then left empty.
+Utterance UnderstandUtterance(ModelRunner *nerModel, ModelRunner *classificationModel, const std::string &input);
+
+// Same for several inputs, each model runs all of them through one batched Invoke()
+std::vector<Utterance> UnderstandUtterances(ModelRunner *nerModel, ModelRunner *classificationModel, const std::vector<std::string> &inputs);
+
+#endif // UTTERANCE_UNDERSTANDING_H
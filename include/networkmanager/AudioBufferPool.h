@@ -0,0 +1,64 @@
+#ifndef AUDIOBUFFERPOOL_H
+#define AUDIOBUFFERPOOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Pool of reusable audio buffers in power-of-two size classes (4 KiB .. 16 MiB).
+// Released buffers are cached up to a byte budget, larger requests bypass the pool.
+class AudioBufferPool
+{
+public:
+    // Move-only handle, returns its memory to the pool when destroyed
+    class Buffer
+    {
+    public:
+        Buffer();
+        ~Buffer();
+        Buffer(Buffer &&other) noexcept;
+        Buffer &operator=(Buffer &&other) noexcept;
+        Buffer(const Buffer &) = delete;
+        Buffer &operator=(const Buffer &) = delete;
+
+        uint8_t *data() const { return ptr; }
+        size_t capacity() const { return cap; }
+        void reset();
+
+    private:
+        friend class AudioBufferPool;
+        Buffer(AudioBufferPool *pool, uint8_t *ptr, size_t cap, int sizeClass);
+
+        AudioBufferPool *pool;
+        uint8_t *ptr;
+        size_t cap;
+        int sizeClass;
+    };
+
+    explicit AudioBufferPool(size_t maxCachedBytes = 64 * 1024 * 1024);
+    ~AudioBufferPool();
+
+    // Returns a buffer with at least minCapacity bytes, contents are unspecified
+    Buffer acquire(size_t minCapacity);
+
+    size_t cachedBytes() const;
+
+    // Process-wide pool used by SoundData
+    static AudioBufferPool &shared();
+
+private:
+    static constexpr int minClassShift = 12;
+    static constexpr int maxClassShift = 24;
+    static constexpr int classCount = maxClassShift - minClassShift + 1;
+
+    mutable std::mutex poolMutex;
+    std::vector<uint8_t *> freeLists[classCount];
+    size_t cached;
+    size_t maxCached;
+
+    void release(uint8_t *ptr, int sizeClass);
+    static int sizeClassFor(size_t capacity);
+};
+
+#endif // AUDIOBUFFERPOOL_H
@@ -0,0 +1,74 @@
+#ifndef AUDIOFRAME_H
+#define AUDIOFRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include "AudioFormat.h"
+
+// Binary framing used between satellites and the server.
+// Every frame is a fixed 36 byte little-endian header followed by payloadLength bytes:
+//
+//   magic(4) version(1) type(1) flags(2) streamId(4) sequence(4) timestampUs(8)
+//   sampleRate(4) channels(1) sampleFormat(1) codec(1) queueDepth(1) payloadLength(4)
+//
+// queueDepth was reserved and zero in the first release; servers now report their worker
+// queue depth there on Result and Error frames so clients can balance across servers.
+//
+// While an utterance is processed the server may push event frames (Partial, Final, Intent,
+// TaskStatus) for its streamId ahead of the Result frame. Their payload is UTF-8 text. Clients
+// that do not care about them skip them; the Result or Error frame always ends the stream.
+
+enum class FrameType : uint8_t
+{
+    Audio = 1,       // Audio payload belonging to streamId
+    EndOfStream = 2, // Utterance complete, payload may carry the last audio
+    Result = 3,      // Server to client: processing result for streamId
+    Error = 4,       // Error description as text payload
+    Partial = 5,     // Server to client: transcript so far, may still change
+    Final = 6,       // Server to client: complete transcript of the utterance
+    Intent = 7,      // Server to client: intent label detected in the transcript
+    TaskStatus = 8   // Server to client: progress of the utterance ("processing", "done", ...)
+};
+
+struct FrameHeader
+{
+    static constexpr uint32_t kMagic = 0x5356524A; // "JRVS" on the wire
+    static constexpr uint8_t kVersion = 1;
+    static constexpr size_t kSize = 36;
+
+    static constexpr uint16_t kFlagPriorityMask = 0x0003; // Audio frames: 0 normal .. 3 most urgent
+    static constexpr uint16_t kFlagOverloaded = 0x0100;   // Error frames: server shed the stream, retry later
+
+    uint8_t version = kVersion;
+    FrameType type = FrameType::Audio;
+    uint16_t flags = 0;
+    uint32_t streamId = 0;
+    uint32_t sequence = 0;
+    uint64_t timestampUs = 0;
+    AudioFormat format;
+    uint8_t queueDepth = 0; // Server to client: utterances waiting for a worker, saturates at 255
+    uint32_t payloadLength = 0;
+};
+
+enum class FrameStatus
+{
+    Ok,
+    NeedMore,   // Fewer than FrameHeader::kSize bytes available
+    BadMagic,
+    BadVersion,
+    BadType
+};
+
+// Decodes a header from raw bytes without allocating
+FrameStatus decodeFrameHeader(const uint8_t *bytes, size_t length, FrameHeader &header);
+
+// Writes exactly FrameHeader::kSize bytes into out
+void encodeFrameHeader(const FrameHeader &header, uint8_t *out);
+
+// True for the server-pushed frames that precede the Result of a stream
+bool isEventFrame(FrameType type);
+
+// True when bytes start with the frame magic, used to tell framed connections from HTTP
+bool hasFrameMagic(const uint8_t *bytes, size_t length);
+
+#endif // AUDIOFRAME_H
@@ -5,30 +5,62 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <unordered_map>
 #include <unordered_set>
 #include <sstream>
+#include <algorithm>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include "WorkerPool.h"
+#include "AudioBufferPool.h"
+#include "AudioFrame.h"
+#include "AudioCodec.h"
+#include "AudioConvert.h"
+#include "Resampler.h"
+#include "VoiceActivity.h"
+#include "UdpIngest.h"
+
+namespace prometheus
+{
+    class Registry;
+    class Gauge;
+}
+
 #if defined(BUILD_FULL) || defined(BUILD_SERVER)
 #include "ModelRunner.h"
+#include "MicroBatcher.h"
+#include "UtteranceUnderstanding.h"
 #include "WhisperTranscriber.h"
 #endif
 
 struct SoundData
 {
+    AudioBufferPool::Buffer buffer;
     uint8_t *data;
     size_t length;
     int clientSd;
+    AudioFormat format; // Defaults to 16 kHz mono float for plain HTTP uploads
+    uint32_t streamId;
+    int priority;
 
-    SoundData(size_t len, int sd) : length(len), clientSd(sd)
-    {
-        data = new uint8_t[length];
-    }
+    SoundData(size_t len, int sd) : buffer(AudioBufferPool::shared().acquire(len)), data(buffer.data()), length(len), clientSd(sd), streamId(0), priority(0) {}
 
-    ~SoundData()
+    // Grows the backing buffer while keeping the first `length` bytes, used by streamed uploads
+    void reserve(size_t capacity)
     {
-        delete[] data;
+        if (capacity <= buffer.capacity())
+        {
+            return;
+        }
+        AudioBufferPool::Buffer larger = AudioBufferPool::shared().acquire(std::max(capacity, buffer.capacity() * 2));
+        std::copy(data, data + length, larger.data());
+        buffer = std::move(larger);
+        data = buffer.data();
     }
 };
 
@@ -53,6 +85,38 @@ struct soundData
     }
 };
 
+struct ServerParams
+{
+    int io_threads = 1;     // Reactor threads driving the non-blocking sockets
+    int worker_threads = 0; // Sound processing workers, 0 = hardware concurrency
+    int listen_backlog = 1024;        // Pending connections queued per listening socket, capped by net.core.somaxconn
+    bool reuseport_listeners = false; // One SO_REUSEPORT listener per reactor, the kernel spreads incoming connections
+    bool pin_reactors = false;        // Pin reactor i to core i modulo the core count
+    size_t max_header_size = 8192;
+    size_t max_body_size = 64 * 1024 * 1024; // Upper bound for one utterance, fixed-length or streamed
+    UdpIngest::Params udp;                    // Jitter buffer and batching for the UDP ingest path
+    size_t max_queue_depth = 32;              // Utterances waiting for a worker before new ones are shed
+    int max_queue_wait_ms = 3000;             // Utterances older than this are dropped instead of transcribed
+    int reconnect_initial_ms = 250;           // Client reconnect backoff, doubled after every failed attempt
+    int reconnect_max_ms = 30000;
+    int connect_timeout_ms = 3000;            // Upper bound for a single client connect attempt
+    int failover_cooldown_ms = 5000;          // ServerRouter avoids a server this long after it failed a request
+    int transcriber_states = 1;               // Whisper inference states, utterances transcribed in parallel on one copy of the model
+    int transcriber_threads = 4;              // Threads each transcription uses
+    int transcriber_beam_size = 0;            // Beam search width, 0 for greedy decoding
+    std::string transcriber_model = "models/ggml-base.en.bin";
+    std::string transcriber_fast_model;       // Small model tried first on short utterances, e.g. models/ggml-tiny.en.bin
+    int transcriber_fast_max_ms = 4000;       // Utterances longer than this always go to transcriber_model
+    float transcriber_fast_min_confidence = 0.7f; // Fast transcripts below this mean token probability are decoded again
+    bool live_transcription = true;           // Transcribe framed streams while their frames arrive
+    int live_step_ms = 1000;                  // New audio that triggers another decode of a live stream
+    int live_window_ms = 10000;               // Live streams are decoded on a sliding window of this length
+    int intent_batch_size = 8;                // Transcripts classified together in one inference
+    int intent_batch_delay_us = 2000;         // Longest a transcript waits for others to share its batch, 0 disables batching
+    bool trim_silence = true;                 // Cut silence out of complete utterances and skip the ones without speech
+    VadParams vad;
+};
+
 class NetworkManager
 {
 public:
@@ -63,9 +127,9 @@ public:
     };
 
 #if defined(BUILD_FULL) || defined(BUILD_SERVER)
-    NetworkManager(int port, char *serverIp, Protocol protocol, ModelRunner *nerModel, ModelRunner *classificationModel);
+    NetworkManager(int port, char *serverIp, Protocol protocol, ModelRunner *nerModel, ModelRunner *classificationModel, const ServerParams &serverParams = ServerParams());
 #else
-    NetworkManager(int port, char *serverIp, Protocol protocol);
+    NetworkManager(int port, char *serverIp, Protocol protocol, const ServerParams &serverParams = ServerParams());
 #endif
     ~NetworkManager();
 
@@ -73,16 +137,109 @@ public:
     void connectClient();
 
     void sendSoundData(const uint8_t *data, size_t length);
-    void receiveResponse();
+    std::string receiveResponse();
+    // Format of the PCM passed to the send functions. A codec other than PCM (S16LE input only)
+    // compresses the uplink, downsampleFactor > 1 additionally drops the rate by that factor.
+    void setAudioFormat(const AudioFormat &format, int downsampleFactor = 1);
 
-    void send(int sd, const char *data, size_t length, int flags);
-    void send(int sd, const uint8_t *data, size_t length, int flags);
+    // Resamples S16LE uploads to this rate before encoding (e.g. 16000 to match Whisper), 0 disables.
+    // Takes precedence over the integer downsample factor.
+    void setUplinkSampleRate(uint32_t sampleRate);
+
+    // Called on the receive thread with the result payload, or the error message when ok is false
+    using ResponseCallback = std::function<void(bool ok, const std::string &payload)>;
+    // Called on the receive thread for every event frame (Partial, Final, Intent, TaskStatus)
+    // the server pushes while it works on the utterance, always before the response callback
+    using EventCallback = std::function<void(FrameType type, const std::string &payload)>;
+
+    // Pipelined uploads: returns as soon as the utterance is written, the response is matched by
+    // stream id on a background receive thread. Any number of utterances may be in flight on the
+    // connection. Lost connections fail their in-flight requests and are re-established with
+    // jittered exponential backoff. Do not mix with receiveResponse() on the same instance.
+    std::future<std::string> sendSoundDataAsync(const uint8_t *data, size_t length, ResponseCallback onResponse = nullptr, EventCallback onEvent = nullptr);
+    size_t inFlightCount() const;
+
+    // Starts the receive thread, which connects (and keeps reconnecting) without blocking the caller
+    void connectClientInBackground();
+    bool isConnected() const;
+    // Worker queue depth the server reported with its most recent response
+    int serverQueueDepth() const;
+
+    // Streaming session: one framed stream per utterance over the persistent connection
+    bool beginSoundStream();
+    bool sendSoundFrame(const uint8_t *data, size_t length);
+    bool endSoundStream();
+
+    bool send(int sd, const char *data, size_t length, int flags);
+    bool send(int sd, const uint8_t *data, size_t length, int flags);
     void sendToUDP(const uint8_t *data, size_t length);
     int recv(int sd, char *buffer, size_t length, int flags);
     int recvFromUDP(uint8_t *buffer, size_t length);
     int getServerSocket() const;
 
+    // Registry the worker queue metrics are exported to, set before runServer()
+    void setMetricsRegistry(std::shared_ptr<prometheus::Registry> registry);
+
+#if defined(BUILD_FULL) || defined(BUILD_SERVER)
+    // The Whisper models load in the background, connections are accepted before they are ready
+    WhisperTranscriber::State transcriberState() const;
+#endif
+
 private:
+    // Server builds: an utterance transcribed while its frames are still arriving
+    struct LiveTranscription;
+
+    // Per-connection state machine driven by a reactor thread
+    struct Connection
+    {
+        enum State
+        {
+            ReadingHeader,
+            ReadingBody,
+            ReadingChunkSize,
+            ReadingChunkData,
+            ReadingTrailer,
+            ReadingFrameHeader,
+            ReadingFramePayload,
+            Processing,
+            Writing
+        };
+
+        int sd;
+        State state;
+        std::string pending; // Bytes read from the socket but not consumed by the state machine yet
+        std::unique_ptr<SoundData> soundData; // Upload being received, recv writes straight into it
+        size_t bodyOffset;
+        size_t chunkRemaining; // Bytes left in the current chunk or frame payload
+        bool framed;           // Binary AudioFrame protocol instead of HTTP
+        bool frameEndsStream;
+        uint32_t nextSequence;
+        std::string outbox;
+        size_t outboxOffset;
+        std::unique_ptr<SoundData> responseBody; // Processed audio sent after the outbox without copying
+        size_t responseOffset;
+        bool keepAlive;
+        bool closeAfterWrite;
+        bool closed;
+        std::mutex pushMutex;
+        std::string pushed; // Event frames queued by workers, written by the reactor
+        std::shared_ptr<LiveTranscription> live;
+
+        explicit Connection(int sd) : sd(sd), state(ReadingHeader), bodyOffset(0), chunkRemaining(0), framed(false), frameEndsStream(false), nextSequence(0), outboxOffset(0), responseOffset(0), keepAlive(true), closeAfterWrite(false), closed(false) {}
+    };
+
+    struct Reactor
+    {
+        int epollFd = -1;
+        int wakeFd = -1;
+        int listenSd = -1; // Listening socket accepted on by this reactor, -1 when it has none
+        std::thread thread;
+        std::unordered_map<int, std::shared_ptr<Connection>> connections;
+        std::mutex completedMutex;
+        std::vector<std::shared_ptr<Connection>> completed; // Connections with a response ready, filled by workers
+        std::vector<std::shared_ptr<Connection>> pushes;    // Connections with event frames to write, filled by workers
+    };
+
     int port;
     const char *serverIp;
     int serverSd;
@@ -92,28 +249,105 @@ private:
     socklen_t clientAddrUDPSize;
     bool connectedToSpecialServer;
     Protocol protocol;
-    std::vector<std::thread> clientThreads;
+    ServerParams serverParams;
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::unique_ptr<WorkerPool> workerPool;
+    std::unique_ptr<UdpIngest> udpIngest;
+    std::shared_ptr<prometheus::Registry> metricsRegistry;
+    std::atomic<bool> running;
+    std::atomic<size_t> nextReactor;
     std::mutex clientMutex;
     std::unordered_set<int> knownClients;
+    std::string clientPending; // Response bytes read ahead on the client connection
+    std::atomic<bool> clientStopping;
+    std::atomic<bool> clientConnected;
+    std::atomic<int> clientServerQueueDepth;
+    std::mutex clientSendMutex; // Serializes async uploads against socket resets by the receive thread, not held while connecting
+    uint64_t connectionGeneration; // Bumped on every reconnect, guarded by clientSendMutex
+
+    struct InFlight
+    {
+        std::promise<std::string> promise;
+        ResponseCallback callback;
+        EventCallback onEvent;
+        uint64_t generation; // Connection the request was written to
+    };
+    mutable std::mutex inFlightMutex;
+    std::unordered_map<uint32_t, InFlight> inFlight;
+    std::thread clientReceiver;
+    AudioFormat clientFormat;
+    int clientDownsample;
+    std::vector<uint8_t> clientEncoded; // Scratch for the compressed uplink payload
+    uint32_t clientUplinkRate;
+    std::unique_ptr<Resampler> clientResampler;
+    std::vector<float> clientResampleIn;
+    std::vector<float> clientResampleOut;
+    uint32_t clientStreamId;
+    uint32_t clientSequence;
 
     void setupServerSocket();
     void setupUDPSocket();
     void bindSocket();
     void listenForClients();
-    void acceptClient();
+    void acceptClient(Reactor &acceptor);
+    int openReusePortListener(int cpu);
     void setupClientSocket();
     void connectToServer();
-    void session(int clientSd);
-    void sendHttpResponse(int clientSd, const uint8_t *data, size_t length, const std::string &statusCode, const std::string &contentType);
+    bool reconnectToServer();
+    bool resetClientSocket(); // Replaces the client socket with a fresh unconnected one
+    void receiveLoop();
+    void completeInFlight(uint32_t streamId, bool ok, const std::string &payload);
+    void deliverEvent(uint32_t streamId, FrameType type, const std::string &payload);
+    void failInFlight(uint64_t generation, const std::string &reason);
+    bool sendFrame(FrameType type, const uint8_t *data, size_t length);
+    AudioFormat uplinkFormat() const;
+    const uint8_t *encodeUplink(const uint8_t *data, size_t &length);
+    void startUplinkStream();
+    bool sendFramesUDP(const uint8_t *data, size_t length);
+    void sendFrameUDP(FrameType type, uint16_t flags, uint32_t streamId, const uint8_t *data, size_t length, const sockaddr_in &destination);
+    void setupReactors();
+    void setupWorkerPool();
+    void runReactor(Reactor &reactor, int cpu);
+    void registerConnection(Reactor &reactor, int clientSd, bool local);
+    void handleReadable(Reactor &reactor, const std::shared_ptr<Connection> &connection);
+    bool advanceConnection(Reactor &reactor, const std::shared_ptr<Connection> &connection);
+    bool parseHeader(Connection &connection);
+    bool parseChunkLine(Connection &connection);
+    bool parseFrameHeader(Connection &connection);
+    void rejectRequest(Connection &connection, const std::string &statusCode, const std::string &message);
+    void queueOverloaded(Connection &connection, int retryAfterSeconds);
+    void dispatchSoundData(Reactor &reactor, const std::shared_ptr<Connection> &connection);
+    void flushConnection(Reactor &reactor, const std::shared_ptr<Connection> &connection);
+    void drainCompleted(Reactor &reactor);
+    void pushEvent(Reactor &reactor, const std::shared_ptr<Connection> &connection, uint32_t streamId, FrameType type, const std::string &payload);
+    void writePushed(Connection &connection);
+    void wakeReactor(Reactor &reactor);
+    void closeConnection(Reactor &reactor, const std::shared_ptr<Connection> &connection);
+    void queueHttpResponse(Connection &connection, const uint8_t *data, size_t length, const std::string &statusCode, const std::string &contentType, bool keepAlive, const std::string &extraHeaders = "");
+    void queueFrame(Connection &connection, FrameType type, uint32_t streamId, const uint8_t *data, size_t length);
     void closeSocket(int sd);
+    uint8_t reportedQueueDepth() const;
     bool isKnownClient(int clientSd);
     void addKnownClient(int clientSd);
-    void processSoundData(const SoundData *inputData, uint8_t *outputData);
+    void processSoundData(SoundData *soundData, const EventCallback &emit = nullptr);
+    void feedLiveTranscription(Reactor &reactor, const std::shared_ptr<Connection> &connection);
+    void finishLiveTranscription(Connection &connection, const EventCallback &emit);
+    static bool decodeSoundData(SoundData &soundData);
 
 #if defined(BUILD_FULL) || defined(BUILD_SERVER)
     ModelRunner *nerModel;            // Model for NER
     ModelRunner *classificationModel; // Model for Classification
+    std::unique_ptr<MicroBatcher<Utterance>> utteranceBatcher; // Batches NER and classification across workers
     WhisperTranscriber transcriber;   // Whisper transcriber for live audio transcription
+    std::thread modelLoader;          // Loads the Whisper models after the sockets are up
+    std::mutex modelMetricsMutex;
+    prometheus::Gauge *modelReadyGauge = nullptr;
+    prometheus::Gauge *modelLoadGauge = nullptr;
+
+    void publishModelMetrics();
+
+    void reportTranscript(SoundData *soundData, const std::string &transcription, const EventCallback &emit);
+    void drainLiveTranscription(LiveTranscription &live, const EventCallback &emit);
 #endif
 };
 
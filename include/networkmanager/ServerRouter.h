@@ -0,0 +1,75 @@
+#ifndef SERVERROUTER_H
+#define SERVERROUTER_H
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "NetworkManager.h"
+
+#if !defined(BUILD_FULL) && !defined(BUILD_SERVER)
+
+// Spreads a satellite's utterances over several transcription servers. Every server gets its
+// own pipelined client connection; each utterance goes to the healthy server with the lowest
+// load (requests in flight plus the queue depth it last reported) and fails over to the next
+// one when the chosen server drops the request or sheds it. Client builds only.
+class ServerRouter
+{
+public:
+    struct Endpoint
+    {
+        std::string ip;
+        int port;
+    };
+
+    explicit ServerRouter(const std::vector<Endpoint> &endpoints, const ServerParams &params = ServerParams());
+
+    // Applied to every server connection, see NetworkManager
+    void setAudioFormat(const AudioFormat &format, int downsampleFactor = 1);
+    void setUplinkSampleRate(uint32_t sampleRate);
+
+    // Waits until at least one server is connected, returns false on timeout
+    bool waitForServer(int timeoutMs);
+
+    // Routes one utterance. The future fails only after every reachable server was tried.
+    // Events come from whichever server is working on it, after a failover they start over.
+    std::future<std::string> sendSoundData(const uint8_t *data, size_t length, NetworkManager::ResponseCallback onResponse = nullptr,
+                                           NetworkManager::EventCallback onEvent = nullptr);
+
+    size_t healthyServers() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Server
+    {
+        std::string ip; // Owned here, NetworkManager keeps the pointer
+        int port;
+        std::unique_ptr<NetworkManager> client;
+        std::atomic<int64_t> avoidUntilMs{0}; // Clock time in ms until which the server counts as unhealthy
+    };
+
+    struct Request
+    {
+        std::vector<uint8_t> audio; // Kept for failover until a server answers
+        std::promise<std::string> promise;
+        NetworkManager::ResponseCallback callback;
+        NetworkManager::EventCallback onEvent;
+        std::vector<bool> tried;
+        std::string lastError;
+    };
+
+    std::vector<std::unique_ptr<Server>> servers;
+    std::atomic<size_t> nextServer; // Round-robin among equally loaded servers
+    int failoverCooldownMs;
+
+    int pickServer(const std::vector<bool> &tried);
+    void dispatch(const std::shared_ptr<Request> &request);
+    static int64_t nowMs();
+};
+
+#endif
+
+#endif // SERVERROUTER_H
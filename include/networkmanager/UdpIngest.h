@@ -0,0 +1,92 @@
+#ifndef UDPINGEST_H
+#define UDPINGEST_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include <netinet/in.h>
+#include "AudioFrame.h"
+
+struct SoundData;
+
+// Low-latency UDP audio ingest. Satellites send one AudioFrame per datagram; frames are
+// received in batches with recvmmsg, reordered per stream in a small jitter buffer, gaps
+// are concealed and completed utterances are handed to the completion callback.
+class UdpIngest
+{
+public:
+    struct Params
+    {
+        int batch_size = 32;           // Datagrams per recvmmsg call
+        size_t max_datagram = 2048;    // Receive slot size, larger datagrams are truncated and dropped
+        int reorder_packets = 8;       // Packets held back waiting for a missing sequence number, also the longest gap concealed
+        int max_delay_ms = 60;         // Longest a gap is waited for before it is concealed
+        int stream_timeout_ms = 2000;  // Idle streams without EndOfStream are flushed after this
+        size_t max_stream_bytes = 64 * 1024 * 1024;
+    };
+
+    struct Stats
+    {
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> late{0};      // Arrived after their slot was played out or concealed
+        std::atomic<uint64_t> duplicates{0};
+        std::atomic<uint64_t> concealed{0}; // Packets replaced by loss concealment
+        std::atomic<uint64_t> resets{0};    // Gaps too long to conceal, skipped without filling
+        std::atomic<uint64_t> malformed{0};
+    };
+
+    using CompletionHandler = std::function<void(std::unique_ptr<SoundData> soundData, const sockaddr_in &source)>;
+
+    UdpIngest(int sd, const Params &params, CompletionHandler onComplete);
+
+    // Receives and processes datagrams until stop() is called
+    void run();
+    void stop();
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using StreamKey = std::tuple<uint32_t, uint16_t, uint32_t>; // address, port, stream id
+
+    struct Packet
+    {
+        std::vector<uint8_t> payload;
+        bool endOfStream;
+    };
+
+    struct StreamState
+    {
+        sockaddr_in source;
+        AudioFormat format; // Decoded PCM format of audio
+        CodecType codec = CodecType::PCM; // Codec of the packet payloads
+        uint32_t nextSequence = 0;
+        std::map<uint32_t, Packet> pending; // Out-of-order packets keyed by sequence
+        std::unique_ptr<SoundData> audio;
+        size_t lastPacketOffset = 0; // Start of the most recent packet inside audio, used for concealment
+        size_t lastPacketLength = 0;
+        bool complete = false;
+        Clock::time_point lastArrival;
+        Clock::time_point gapSince;
+    };
+
+    int sd_;
+    Params params_;
+    CompletionHandler onComplete_;
+    std::atomic<bool> running_;
+    std::map<StreamKey, StreamState> streams_;
+    Stats stats_;
+    std::vector<uint8_t> decoded_; // Scratch for decoding compressed packets
+
+    void handleDatagram(const uint8_t *data, size_t length, const sockaddr_in &source, Clock::time_point now);
+    void playout(StreamState &stream, Clock::time_point now);
+    void append(StreamState &stream, const uint8_t *data, size_t length);
+    void conceal(StreamState &stream, size_t length);
+    void expireStreams(Clock::time_point now);
+};
+
+#endif // UDPINGEST_H
@@ -0,0 +1,100 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace prometheus
+{
+    class Registry;
+    class Gauge;
+    class Histogram;
+    class Counter;
+}
+
+// Fixed-size pool of worker threads fed from a bounded priority queue.
+// Used by the NetworkManager to run sound processing off the I/O threads. Jobs are admitted
+// only while the queue has room and are dropped instead of run once their deadline passed.
+class WorkerPool
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Admission
+    {
+        Accepted,
+        Rejected // Queue full or pool stopping, the caller should shed the work
+    };
+
+    // maxQueueDepth of 0 means unbounded
+    explicit WorkerPool(size_t threadCount, size_t maxQueueDepth = 0);
+    ~WorkerPool();
+
+    // Queues a job with normal priority and no deadline, returns false when it was not admitted
+    bool submit(std::function<void()> job);
+
+    // Queues a job, higher priorities run first. onDropped runs on a worker instead of job
+    // when the deadline has passed by the time the job reaches the front of the queue.
+    // onFailed runs with the error message when job throws, so its owner can still answer.
+    Admission submit(std::function<void()> job, std::function<void()> onDropped, int priority, Clock::time_point deadline,
+                     std::function<void(const std::string &error)> onFailed = nullptr);
+
+    // Stops accepting jobs, drains the queue and joins all workers
+    void stop();
+
+    size_t size() const;
+    size_t depth() const;
+
+    // Rough time until a newly queued job would start, for Retry-After style hints
+    int retryAfterSeconds() const;
+
+    // Exports queue depth, wait time and drop counts, labelled with the given pool name
+    void attachMetrics(prometheus::Registry &registry, const std::string &poolName);
+
+private:
+    struct Job
+    {
+        std::function<void()> run;
+        std::function<void()> onDropped;
+        std::function<void(const std::string &error)> onFailed;
+        int priority;
+        uint64_t order; // FIFO among equal priorities
+        Clock::time_point enqueued;
+        Clock::time_point deadline;
+    };
+
+    struct JobOrder
+    {
+        bool operator()(const Job &a, const Job &b) const
+        {
+            return a.priority != b.priority ? a.priority < b.priority : a.order > b.order;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::priority_queue<Job, std::vector<Job>, JobOrder> jobs;
+    mutable std::mutex jobsMutex;
+    std::condition_variable jobsCondition;
+    size_t maxQueueDepth;
+    uint64_t nextOrder;
+    bool stopping;
+    std::atomic<double> averageServiceMs;
+
+    prometheus::Gauge *depthGauge;
+    prometheus::Histogram *waitHistogram;
+    prometheus::Counter *overloadDrops;
+    prometheus::Counter *deadlineDrops;
+
+    void workerLoop();
+    void fail(Job &job, const std::string &error);
+};
+
+#endif // WORKERPOOL_H
@@ -0,0 +1,37 @@
+#ifndef WHISPERCALIBRATION_H
+#define WHISPERCALIBRATION_H
+
+#include "WhisperTranscriber.h"
+#include <string>
+
+// Finds the transcriber settings that suit the machine the server runs on. A directory of
+// reference clips (WAV, any rate and channel count, optionally with a .txt transcript of the
+// same name) is transcribed for every combination of threads per decode, inference states and
+// sampling strategy. Each combination is scored on latency, throughput and, when transcripts
+// are available, word error rate; the result is written as a small JSON tuning file.
+
+struct WhisperTuning
+{
+    int n_threads = 4;
+    int n_states = 1;
+    int beam_size = 0; // 0 for greedy decoding
+};
+
+struct WhisperCalibrationParams
+{
+    std::string clip_dir = "models/calibration";
+    std::string output_path = "models/whisper_tuning.json";
+    int repeats = 2;               // Times every clip is transcribed per combination
+    int beam_size = 5;             // Beam width tried next to greedy decoding, 0 to try greedy only
+    float latency_budget = 1.5f;   // Allowed p95 latency relative to the fastest combination
+    float wer_tolerance = 0.01f;   // Allowed word error rate above the most accurate combination
+};
+
+// Runs the grid search with base as the starting point and writes the best combination to
+// params.output_path. Returns false when no clip could be read or no combination could run.
+bool runWhisperCalibration(const WhisperTranscriber::Params &base, const WhisperCalibrationParams &params);
+
+// Reads a tuning file written by runWhisperCalibration(), false when it is missing or invalid
+bool loadWhisperTuning(const std::string &path, WhisperTuning &tuning);
+
+#endif // WHISPERCALIBRATION_H
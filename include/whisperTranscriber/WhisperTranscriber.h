@@ -9,17 +9,22 @@ Description: This class is used to convert speech to text. It uses kaldi to do t
 #define WHISPERTRANSCRIBER_H
 
 #include "whisper.h"
+#include <atomic>
 #include <string>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 
 class WhisperTranscriber
 {
 public:
     struct Params
     {
-        int n_threads = 4;
-        int n_processors = 1;
+        int n_threads = 4; // Threads per transcription
+        int n_states = 1;  // Inference states sharing the loaded weights, bounds concurrent transcriptions
+        int beam_size = 0; // Beam search width, 0 for greedy decoding
         int offset_t_ms = 0;
         int duration_ms = 0;
         int max_context = -1;
@@ -28,26 +33,147 @@ public:
         bool translate = false;
         bool diarize = false;
         bool use_gpu = true;
+        bool mmap_model = true; // Read model files through a read-ahead mapping instead of buffered reads
         std::string language = "en";
         std::string model_path = "models/ggml-base.en.bin";
+        std::string fast_model_path;      // Smaller model tried first on short utterances, empty to always use model_path
+        int fast_max_ms = 4000;           // Longer utterances go straight to model_path
+        float fast_min_confidence = 0.7f; // Mean token probability below which model_path decodes the utterance again
+    };
+
+    enum class State
+    {
+        Unloaded,
+        Loading,
+        Ready,
+        Failed
+    };
+
+    struct StreamParams
+    {
+        int step_ms = 1000;          // New audio that triggers another decode of the window
+        int window_ms = 10000;       // Longest audio decoded at once, the hypothesis is committed when it is full
+        int keep_ms = 200;           // Audio carried over into the next window so boundary words are not cut
+        int max_prompt_tokens = 128; // Committed text fed back to the decoder as prompt
+    };
+
+    // Called from inside the decode with the transcript so far each time a segment is finished
+    using SegmentCallback = std::function<void(const std::string &textSoFar)>;
+
+    // Incremental transcription of one utterance. Audio is decoded on a sliding window as it
+    // arrives; every decode yields a hypothesis for the current window, text that two
+    // consecutive decodes agree on becomes stable, and a full window is committed and carried
+    // into the next one as prompt. Not thread-safe, feed a stream from one thread at a time.
+    class Stream
+    {
+    public:
+        // Appends 16 kHz mono samples, returns true when a decode changed the hypothesis
+        bool push(const float *samples, size_t count);
+
+        // Decodes the audio not covered yet and returns the complete transcript
+        std::string finish();
+
+        // Committed text followed by the hypothesis for the current window
+        std::string partial() const;
+
+        // Prefix of partial() later decodes are not expected to change
+        const std::string &stable() const { return stable_; }
+
+    private:
+        friend class WhisperTranscriber;
+        Stream(WhisperTranscriber &owner, const StreamParams &params);
+
+        bool decode();
+        void commit(size_t keepSamples);
+        void escalate();
+
+        WhisperTranscriber &owner_;
+        StreamParams params_;
+        bool fast_;        // Still decoding on the fast model, cleared for good once the utterance outgrows it
+        float confidence_; // Mean token probability of the last decode
+        std::vector<float> window_;
+        size_t pending_;   // Samples in window_ not decoded yet
+        size_t received_;  // Samples pushed over the lifetime of the stream
+        std::string committed_;
+        std::string hypothesis_;
+        std::string previous_hypothesis_;
+        std::string stable_;
+        std::vector<whisper_token> prompt_;
+        std::vector<whisper_token> hypothesis_tokens_;
     };
 
     WhisperTranscriber();
     ~WhisperTranscriber();
 
-    // Sets up the Whisper transcriber with the given parameters
+    // Loads the models with the given parameters. May run on a background thread: transcriptions
+    // started while it loads wait for it instead of failing.
     bool setup(const Params &params);
 
-    // Transcribes live audio data (PCM) to text
+    // Switches to Loading ahead of a setup() that is about to start on another thread, so
+    // requests arriving before that thread runs wait for it instead of seeing Unloaded
+    void beginLoading();
+
+    // Load state, safe to poll from any thread
+    State state() const { return state_; }
+
+    // Wall time the last setup() spent loading, in seconds
+    double loadSeconds() const { return load_seconds_; }
+
+    // Blocks while setup() is loading, true when the models are ready
+    bool waitUntilReady();
+
+    // Transcribes live audio data (PCM) to text. Short utterances are decoded by the fast model
+    // when one is loaded and only decoded again by the main model when the fast one is unsure.
+    // Thread-safe: up to n_states calls run in parallel per model, further callers wait for a
+    // state to be returned.
     std::string transcribeLiveData(const std::vector<float> &pcmf32);
+    std::string transcribeLiveData(const float *samples, size_t count, const SegmentCallback &onSegment = nullptr);
+
+    // Starts an incremental transcription, streams check out an inference state per decode
+    std::unique_ptr<Stream> openStream(const StreamParams &params);
 
 private:
+    struct Model
+    {
+        struct whisper_context *ctx = nullptr; // Weights only, decoding happens on the pooled states
+        std::vector<struct whisper_state *> states;
+        std::vector<struct whisper_state *> free_states;
+        std::condition_variable state_returned;
+    };
+
+    // Checks a state of one model out of its pool for the lifetime of the lease
+    class StateLease
+    {
+    public:
+        StateLease(WhisperTranscriber &owner, Model &model);
+        ~StateLease();
+        StateLease(const StateLease &) = delete;
+        StateLease &operator=(const StateLease &) = delete;
+
+        struct whisper_state *get() const { return state_; }
+
+    private:
+        WhisperTranscriber &owner_;
+        Model &model_;
+        struct whisper_state *state_;
+    };
+
     Params params_;
-    struct whisper_context *ctx_;
+    Model model_;      // Main model, every utterance can fall back to it
+    Model fast_model_; // Optional small model for short utterances
     std::mutex whisper_mutex_;
+    std::atomic<State> state_;
+    std::atomic<double> load_seconds_;
+    std::condition_variable ready_;
+
+    struct whisper_context *initContext(const std::string &path) const;
+    bool loadModel(Model &model, const std::string &path);
+    whisper_full_params decodeParams() const;
+    void release(Model &model);
+    void release();
 
-    // Internal function for processing transcription
-    std::string processTranscription(const std::vector<float> &pcmf32);
+    // Internal function for processing transcription, confidence receives the mean token probability
+    std::string processTranscription(Model &model, struct whisper_state *state, const float *samples, size_t count, const SegmentCallback &onSegment, float *confidence);
 };
 
 #endif // WHISPERTRANSCRIBER_H
@@ -0,0 +1,312 @@
+#include "AudioCodec.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    constexpr int kMuLawBias = 0x84;
+    constexpr int kMuLawClip = 32635;
+
+    const int8_t kAdpcmIndexTable[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+    const int16_t kAdpcmStepTable[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+        50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+        253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+        1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+        3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+        12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+    inline int16_t loadSample(const uint8_t *p)
+    {
+        int16_t sample;
+        std::memcpy(&sample, p, sizeof(sample));
+        return sample;
+    }
+
+    inline void storeSample(uint8_t *p, int16_t sample)
+    {
+        std::memcpy(p, &sample, sizeof(sample));
+    }
+
+    inline size_t adpcmBlockSize(size_t frames, uint8_t channels)
+    {
+        return 2 + 4 * size_t(channels) + ((frames - 1) * channels + 1) / 2;
+    }
+
+    struct MuLawTable
+    {
+        int16_t decode[256];
+
+        MuLawTable()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                int bits = ~i & 0xFF;
+                int exponent = (bits >> 4) & 0x07;
+                int magnitude = ((((bits & 0x0F) << 3) + kMuLawBias) << exponent) - kMuLawBias;
+                decode[i] = int16_t((bits & 0x80) ? -magnitude : magnitude);
+            }
+        }
+    };
+
+    const MuLawTable &muLawTable()
+    {
+        static const MuLawTable table;
+        return table;
+    }
+
+    inline uint8_t muLawEncode(int sample)
+    {
+        int sign = (sample >> 8) & 0x80;
+        int magnitude = std::min(sign ? -sample : sample, kMuLawClip) + kMuLawBias;
+        int exponent = 31 - __builtin_clz(unsigned(magnitude >> 7)); // magnitude >= 0x84, so the operand is never 0
+        int mantissa = (magnitude >> (exponent + 3)) & 0x0F;
+        return uint8_t(~(sign | exponent << 4 | mantissa));
+    }
+
+    // One IMA-ADPCM step, shared by encoder and decoder so both track the same predictor
+    inline void adpcmUpdate(int code, int &predictor, int &index)
+    {
+        int step = kAdpcmStepTable[index];
+        int delta = step >> 3;
+        delta += (code & 4) ? step : 0;
+        delta += (code & 2) ? step >> 1 : 0;
+        delta += (code & 1) ? step >> 2 : 0;
+        predictor += (code & 8) ? -delta : delta;
+        predictor = std::max(-32768, std::min(32767, predictor));
+        index = std::max(0, std::min(88, index + kAdpcmIndexTable[code & 7]));
+    }
+
+    inline int adpcmEncodeSample(int sample, int &predictor, int &index)
+    {
+        int step = kAdpcmStepTable[index];
+        int diff = sample - predictor;
+        int code = diff < 0 ? 8 : 0;
+        diff = diff < 0 ? -diff : diff;
+
+        int bit = diff >= step;
+        code |= bit << 2;
+        diff -= bit ? step : 0;
+        step >>= 1;
+        bit = diff >= step;
+        code |= bit << 1;
+        diff -= bit ? step : 0;
+        step >>= 1;
+        code |= diff >= step;
+
+        adpcmUpdate(code, predictor, index);
+        return code;
+    }
+
+    size_t adpcmEncode(const uint8_t *pcm, size_t frames, uint8_t channels, uint8_t *out)
+    {
+        int predictor[256];
+        int index[256] = {};
+        uint8_t *start = out;
+        const size_t frameBytes = 2 * size_t(channels);
+
+        for (size_t offset = 0; offset < frames; offset += kAdpcmBlockFrames)
+        {
+            size_t blockFrames = std::min(kAdpcmBlockFrames, frames - offset);
+            const uint8_t *block = pcm + offset * frameBytes;
+
+            out[0] = uint8_t(blockFrames);
+            out[1] = uint8_t(blockFrames >> 8);
+            out += 2;
+            for (uint8_t c = 0; c < channels; ++c)
+            {
+                // The step index carries over between blocks so adaptation is not restarted
+                predictor[c] = loadSample(block + 2 * c);
+                out[0] = uint8_t(predictor[c]);
+                out[1] = uint8_t(predictor[c] >> 8);
+                out[2] = uint8_t(index[c]);
+                out[3] = 0;
+                out += 4;
+            }
+
+            size_t nibble = 0;
+            for (size_t f = 1; f < blockFrames; ++f)
+            {
+                const uint8_t *frame = block + f * frameBytes;
+                for (uint8_t c = 0; c < channels; ++c, ++nibble)
+                {
+                    int code = adpcmEncodeSample(loadSample(frame + 2 * c), predictor[c], index[c]);
+                    if (nibble & 1)
+                    {
+                        out[nibble >> 1] |= uint8_t(code << 4);
+                    }
+                    else
+                    {
+                        out[nibble >> 1] = uint8_t(code);
+                    }
+                }
+            }
+            out += (nibble + 1) / 2;
+        }
+        return out - start;
+    }
+
+    size_t adpcmDecode(const uint8_t *data, size_t length, uint8_t channels, uint8_t *out)
+    {
+        int predictor[256];
+        int index[256];
+        uint8_t *start = out;
+        const uint8_t *end = data + length;
+
+        while (data < end)
+        {
+            size_t blockFrames = size_t(data[0]) | size_t(data[1]) << 8;
+            data += 2;
+            for (uint8_t c = 0; c < channels; ++c)
+            {
+                predictor[c] = int16_t(uint16_t(data[0]) | uint16_t(data[1]) << 8);
+                index[c] = std::min<int>(data[2], 88);
+                storeSample(out + 2 * c, int16_t(predictor[c]));
+                data += 4;
+            }
+            out += 2 * size_t(channels);
+
+            size_t nibble = 0;
+            for (size_t f = 1; f < blockFrames; ++f)
+            {
+                for (uint8_t c = 0; c < channels; ++c, ++nibble)
+                {
+                    int code = (data[nibble >> 1] >> ((nibble & 1) * 4)) & 0x0F;
+                    adpcmUpdate(code, predictor[c], index[c]);
+                    storeSample(out, int16_t(predictor[c]));
+                    out += 2;
+                }
+            }
+            data += (nibble + 1) / 2;
+        }
+        return out - start;
+    }
+}
+
+size_t maxEncodedAudioSize(CodecType codec, size_t frames, uint8_t channels)
+{
+    switch (codec)
+    {
+    case CodecType::PCM:
+        return frames * channels * 2;
+    case CodecType::MuLaw:
+        return frames * channels;
+    case CodecType::ImaAdpcm:
+    {
+        size_t fullBlocks = frames / kAdpcmBlockFrames;
+        size_t rest = frames % kAdpcmBlockFrames;
+        return fullBlocks * adpcmBlockSize(kAdpcmBlockFrames, channels) + (rest ? adpcmBlockSize(rest, channels) : 0);
+    }
+    default:
+        return 0;
+    }
+}
+
+size_t encodeAudio(CodecType codec, const uint8_t *pcm, size_t frames, uint8_t channels, uint8_t *out)
+{
+    size_t samples = frames * channels;
+    switch (codec)
+    {
+    case CodecType::PCM:
+        std::memmove(out, pcm, samples * 2);
+        return samples * 2;
+    case CodecType::MuLaw:
+        for (size_t i = 0; i < samples; ++i)
+        {
+            out[i] = muLawEncode(loadSample(pcm + 2 * i));
+        }
+        return samples;
+    case CodecType::ImaAdpcm:
+        return channels == 0 ? 0 : adpcmEncode(pcm, frames, channels, out);
+    default:
+        return 0;
+    }
+}
+
+size_t decodedAudioSize(CodecType codec, const uint8_t *data, size_t length, uint8_t channels)
+{
+    switch (codec)
+    {
+    case CodecType::PCM:
+        return length;
+    case CodecType::MuLaw:
+        return length * 2;
+    case CodecType::ImaAdpcm:
+    {
+        if (channels == 0)
+        {
+            return 0;
+        }
+        size_t total = 0;
+        size_t offset = 0;
+        while (offset < length)
+        {
+            if (length - offset < 2)
+            {
+                return 0;
+            }
+            size_t blockFrames = size_t(data[offset]) | size_t(data[offset + 1]) << 8;
+            if (blockFrames == 0 || adpcmBlockSize(blockFrames, channels) > length - offset)
+            {
+                return 0;
+            }
+            offset += adpcmBlockSize(blockFrames, channels);
+            total += blockFrames * channels * 2;
+        }
+        return total;
+    }
+    default:
+        return 0;
+    }
+}
+
+size_t decodeAudio(CodecType codec, const uint8_t *data, size_t length, uint8_t channels, uint8_t *out)
+{
+    switch (codec)
+    {
+    case CodecType::PCM:
+        std::memmove(out, data, length);
+        return length;
+    case CodecType::MuLaw:
+    {
+        const int16_t *table = muLawTable().decode;
+        for (size_t i = 0; i < length; ++i)
+        {
+            storeSample(out + 2 * i, table[data[i]]);
+        }
+        return length * 2;
+    }
+    case CodecType::ImaAdpcm:
+        // Block headers are trusted here, callers validate with decodedAudioSize() first
+        return adpcmDecode(data, length, channels, out);
+    default:
+        return 0;
+    }
+}
+
+size_t downsampleAudio(const uint8_t *pcm, size_t frames, uint8_t channels, int factor, uint8_t *out)
+{
+    if (factor <= 1)
+    {
+        std::memmove(out, pcm, frames * channels * 2);
+        return frames;
+    }
+
+    size_t outFrames = frames / factor;
+    const size_t frameBytes = 2 * size_t(channels);
+    for (size_t f = 0; f < outFrames; ++f)
+    {
+        const uint8_t *run = pcm + f * factor * frameBytes;
+        for (uint8_t c = 0; c < channels; ++c)
+        {
+            int sum = 0;
+            for (int k = 0; k < factor; ++k)
+            {
+                sum += loadSample(run + k * frameBytes + 2 * c);
+            }
+            storeSample(out + f * frameBytes + 2 * c, int16_t(sum / factor));
+        }
+    }
+    return outFrames;
+}
@@ -0,0 +1,556 @@
+#include "AudioConvert.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#define AUDIOCONVERT_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AUDIOCONVERT_NEON 1
+#endif
+
+namespace
+{
+    constexpr float kScale16 = 1.0f / 32768.0f;
+    constexpr float kScale32 = 1.0f / 2147483648.0f; // S24 is widened to the top of an int32 first
+
+    // Float scratch per block, multichannel input is converted here before the downmix
+    constexpr size_t kScratchSamples = 4096;
+
+    inline int32_t load24(const uint8_t *p)
+    {
+        return int32_t(uint32_t(p[0]) << 8 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 24);
+    }
+
+    // Scalar reference kernels
+
+    void convertScalar(const uint8_t *in, size_t samples, SampleFormat format, float *out)
+    {
+        switch (format)
+        {
+        case SampleFormat::S16LE:
+            for (size_t i = 0; i < samples; ++i)
+            {
+                int16_t sample;
+                std::memcpy(&sample, in + 2 * i, sizeof(sample));
+                out[i] = float(sample) * kScale16;
+            }
+            break;
+        case SampleFormat::S24LE:
+            for (size_t i = 0; i < samples; ++i)
+            {
+                out[i] = float(load24(in + 3 * i)) * kScale32;
+            }
+            break;
+        case SampleFormat::S32LE:
+            for (size_t i = 0; i < samples; ++i)
+            {
+                int32_t sample;
+                std::memcpy(&sample, in + 4 * i, sizeof(sample));
+                out[i] = float(sample) * kScale32;
+            }
+            break;
+        case SampleFormat::F32LE:
+            std::memmove(out, in, samples * sizeof(float));
+            break;
+        default:
+            break;
+        }
+    }
+
+    void downmixScalar(const float *in, size_t frames, size_t channels, float *out)
+    {
+        const float gain = 1.0f / float(channels);
+        for (size_t f = 0; f < frames; ++f)
+        {
+            const float *frame = in + f * channels;
+            float sum = frame[0];
+            for (size_t c = 1; c < channels; ++c)
+            {
+                sum += frame[c];
+            }
+            out[f] = sum * gain;
+        }
+    }
+
+    // Four double accumulators, lane k takes samples i % 4 == k, so the vector paths can sum identically
+    double sumScalar(const float *samples, size_t count)
+    {
+        double lanes[4] = {0.0, 0.0, 0.0, 0.0};
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            for (size_t k = 0; k < 4; ++k)
+            {
+                lanes[k] += double(samples[i + k]);
+            }
+        }
+        double total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; i < count; ++i)
+        {
+            total += double(samples[i]);
+        }
+        return total;
+    }
+
+    // Vector kernels, each finishes its tail with the scalar reference
+
+#if defined(AUDIOCONVERT_SSE2)
+    void convertSimd(const uint8_t *in, size_t samples, SampleFormat format, float *out)
+    {
+        size_t i = 0;
+        switch (format)
+        {
+        case SampleFormat::S16LE:
+        {
+            const __m128 scale = _mm_set1_ps(kScale16);
+            for (; i + 8 <= samples; i += 8)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 2 * i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+                _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+            }
+            convertScalar(in + 2 * i, samples - i, format, out + i);
+            break;
+        }
+        case SampleFormat::S24LE:
+        {
+            const __m128 scale = _mm_set1_ps(kScale32);
+#if defined(__SSSE3__)
+            // Move each 3-byte sample into the top of a 32-bit lane, the 16-byte load reads 4 bytes ahead
+            const __m128i spread = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+            for (; i + 6 <= samples; i += 4)
+            {
+                __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 3 * i)), spread);
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+            }
+#else
+            for (; i + 4 <= samples; i += 4)
+            {
+                const uint8_t *p = in + 3 * i;
+                __m128i v = _mm_setr_epi32(load24(p), load24(p + 3), load24(p + 6), load24(p + 9));
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+            }
+#endif
+            convertScalar(in + 3 * i, samples - i, format, out + i);
+            break;
+        }
+        case SampleFormat::S32LE:
+        {
+            const __m128 scale = _mm_set1_ps(kScale32);
+            for (; i + 4 <= samples; i += 4)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 4 * i));
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+            }
+            convertScalar(in + 4 * i, samples - i, format, out + i);
+            break;
+        }
+        default:
+            convertScalar(in, samples, format, out);
+            break;
+        }
+    }
+
+    void downmixSimd(const float *in, size_t frames, size_t channels, float *out)
+    {
+        const __m128 gain = _mm_set1_ps(1.0f / float(channels));
+        size_t f = 0;
+        if (channels == 2)
+        {
+            for (; f + 4 <= frames; f += 4)
+            {
+                __m128 a = _mm_loadu_ps(in + 2 * f);
+                __m128 b = _mm_loadu_ps(in + 2 * f + 4);
+                __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+                __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+                _mm_storeu_ps(out + f, _mm_mul_ps(_mm_add_ps(left, right), gain));
+            }
+        }
+        else if (channels == 4)
+        {
+            for (; f + 4 <= frames; f += 4)
+            {
+                __m128 c0 = _mm_loadu_ps(in + 4 * f);
+                __m128 c1 = _mm_loadu_ps(in + 4 * f + 4);
+                __m128 c2 = _mm_loadu_ps(in + 4 * f + 8);
+                __m128 c3 = _mm_loadu_ps(in + 4 * f + 12);
+                _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(c0, c1), c2), c3);
+                _mm_storeu_ps(out + f, _mm_mul_ps(sum, gain));
+            }
+        }
+        downmixScalar(in + f * channels, frames - f, channels, out + f);
+    }
+
+    double sumSimd(const float *samples, size_t count)
+    {
+        __m128d lanes01 = _mm_setzero_pd();
+        __m128d lanes23 = _mm_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 v = _mm_loadu_ps(samples + i);
+            lanes01 = _mm_add_pd(lanes01, _mm_cvtps_pd(v));
+            lanes23 = _mm_add_pd(lanes23, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+        }
+        double lanes[4];
+        _mm_storeu_pd(lanes, lanes01);
+        _mm_storeu_pd(lanes + 2, lanes23);
+        double total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; i < count; ++i)
+        {
+            total += double(samples[i]);
+        }
+        return total;
+    }
+
+    void subtractSimd(float *samples, size_t count, float offset)
+    {
+        const __m128 v = _mm_set1_ps(offset);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_ps(samples + i, _mm_sub_ps(_mm_loadu_ps(samples + i), v));
+        }
+        for (; i < count; ++i)
+        {
+            samples[i] -= offset;
+        }
+    }
+#elif defined(AUDIOCONVERT_NEON)
+    void convertSimd(const uint8_t *in, size_t samples, SampleFormat format, float *out)
+    {
+        size_t i = 0;
+        switch (format)
+        {
+        case SampleFormat::S16LE:
+        {
+            const float32x4_t scale = vdupq_n_f32(kScale16);
+            for (; i + 8 <= samples; i += 8)
+            {
+                int16x8_t v = vreinterpretq_s16_u8(vld1q_u8(in + 2 * i));
+                int32x4_t lo = vmovl_s16(vget_low_s16(v));
+                int32x4_t hi = vmovl_s16(vget_high_s16(v));
+                vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(lo), scale));
+                vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(hi), scale));
+            }
+            convertScalar(in + 2 * i, samples - i, format, out + i);
+            break;
+        }
+        case SampleFormat::S24LE:
+        {
+            const float32x4_t scale = vdupq_n_f32(kScale32);
+            for (; i + 8 <= samples; i += 8)
+            {
+                // De-interleave the three bytes of 8 samples and rebuild them at the top of 32-bit lanes
+                uint8x8x3_t bytes = vld3_u8(in + 3 * i);
+                uint16x8_t low = vshll_n_u8(bytes.val[0], 8);
+                uint16x8_t high = vorrq_u16(vmovl_u8(bytes.val[1]), vshll_n_u8(bytes.val[2], 8));
+                uint32x4_t first = vorrq_u32(vmovl_u16(vget_low_u16(low)), vshlq_n_u32(vmovl_u16(vget_low_u16(high)), 16));
+                uint32x4_t second = vorrq_u32(vmovl_u16(vget_high_u16(low)), vshlq_n_u32(vmovl_u16(vget_high_u16(high)), 16));
+                vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(first)), scale));
+                vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(second)), scale));
+            }
+            convertScalar(in + 3 * i, samples - i, format, out + i);
+            break;
+        }
+        case SampleFormat::S32LE:
+        {
+            const float32x4_t scale = vdupq_n_f32(kScale32);
+            for (; i + 4 <= samples; i += 4)
+            {
+                int32x4_t v = vreinterpretq_s32_u8(vld1q_u8(in + 4 * i));
+                vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(v), scale));
+            }
+            convertScalar(in + 4 * i, samples - i, format, out + i);
+            break;
+        }
+        default:
+            convertScalar(in, samples, format, out);
+            break;
+        }
+    }
+
+    void downmixSimd(const float *in, size_t frames, size_t channels, float *out)
+    {
+        const float32x4_t gain = vdupq_n_f32(1.0f / float(channels));
+        size_t f = 0;
+        if (channels == 2)
+        {
+            for (; f + 4 <= frames; f += 4)
+            {
+                float32x4x2_t v = vld2q_f32(in + 2 * f);
+                vst1q_f32(out + f, vmulq_f32(vaddq_f32(v.val[0], v.val[1]), gain));
+            }
+        }
+        else if (channels == 4)
+        {
+            for (; f + 4 <= frames; f += 4)
+            {
+                float32x4x4_t v = vld4q_f32(in + 4 * f);
+                float32x4_t sum = vaddq_f32(vaddq_f32(vaddq_f32(v.val[0], v.val[1]), v.val[2]), v.val[3]);
+                vst1q_f32(out + f, vmulq_f32(sum, gain));
+            }
+        }
+        downmixScalar(in + f * channels, frames - f, channels, out + f);
+    }
+
+    double sumSimd(const float *samples, size_t count)
+    {
+#if defined(__aarch64__)
+        float64x2_t lanes01 = vdupq_n_f64(0.0);
+        float64x2_t lanes23 = vdupq_n_f64(0.0);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t v = vld1q_f32(samples + i);
+            lanes01 = vaddq_f64(lanes01, vcvt_f64_f32(vget_low_f32(v)));
+            lanes23 = vaddq_f64(lanes23, vcvt_high_f64_f32(v));
+        }
+        double total = (vgetq_lane_f64(lanes01, 0) + vgetq_lane_f64(lanes01, 1)) + (vgetq_lane_f64(lanes23, 0) + vgetq_lane_f64(lanes23, 1));
+        for (; i < count; ++i)
+        {
+            total += double(samples[i]);
+        }
+        return total;
+#else
+        // 32-bit NEON has no double lanes
+        return sumScalar(samples, count);
+#endif
+    }
+
+    void subtractSimd(float *samples, size_t count, float offset)
+    {
+        const float32x4_t v = vdupq_n_f32(offset);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            vst1q_f32(samples + i, vsubq_f32(vld1q_f32(samples + i), v));
+        }
+        for (; i < count; ++i)
+        {
+            samples[i] -= offset;
+        }
+    }
+#else
+    void convertSimd(const uint8_t *in, size_t samples, SampleFormat format, float *out)
+    {
+        convertScalar(in, samples, format, out);
+    }
+
+    void downmixSimd(const float *in, size_t frames, size_t channels, float *out)
+    {
+        downmixScalar(in, frames, channels, out);
+    }
+
+    double sumSimd(const float *samples, size_t count)
+    {
+        return sumScalar(samples, count);
+    }
+
+    void subtractSimd(float *samples, size_t count, float offset)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            samples[i] -= offset;
+        }
+    }
+#endif
+}
+
+bool simdConvertAvailable()
+{
+#if defined(AUDIOCONVERT_SSE2) || defined(AUDIOCONVERT_NEON)
+    return true;
+#else
+    return false;
+#endif
+}
+
+size_t monoFloatBytes(const AudioFormat &format, size_t length)
+{
+    size_t frameBytes = format.bytesPerSample() * std::max<size_t>(1, format.channels);
+    return frameBytes == 0 ? 0 : length / frameBytes * sizeof(float);
+}
+
+size_t convertToMonoFloat(const uint8_t *in, size_t frames, const AudioFormat &format, float *out, ConvertPath path)
+{
+    const size_t channels = std::max<size_t>(1, format.channels);
+    const size_t frameBytes = format.bytesPerSample() * channels;
+    if (frameBytes == 0)
+    {
+        return 0;
+    }
+
+    const bool simd = path == ConvertPath::Simd;
+    if (channels == 1)
+    {
+        (simd ? convertSimd : convertScalar)(in, frames, format.sampleFormat, out);
+        return frames;
+    }
+
+    // Each block is fully read into the scratch before its mono output is written,
+    // which keeps the conversion safe when out aliases in
+    float scratch[kScratchSamples];
+    const size_t blockFrames = std::max<size_t>(1, kScratchSamples / channels);
+    for (size_t f = 0; f < frames; f += blockFrames)
+    {
+        size_t count = std::min(blockFrames, frames - f);
+        if (simd)
+        {
+            convertSimd(in + f * frameBytes, count * channels, format.sampleFormat, scratch);
+            downmixSimd(scratch, count, channels, out + f);
+        }
+        else
+        {
+            convertScalar(in + f * frameBytes, count * channels, format.sampleFormat, scratch);
+            downmixScalar(scratch, count, channels, out + f);
+        }
+    }
+    return frames;
+}
+
+void convertSamplesToFloat(const uint8_t *in, size_t samples, SampleFormat format, float *out, ConvertPath path)
+{
+    (path == ConvertPath::Simd ? convertSimd : convertScalar)(in, samples, format, out);
+}
+
+void convertFloatToS16(const float *in, size_t samples, uint8_t *out)
+{
+    for (size_t i = 0; i < samples; ++i)
+    {
+        float scaled = std::min(32767.0f, std::max(-32768.0f, in[i] * 32768.0f));
+        int16_t sample = int16_t(std::lrintf(scaled));
+        std::memcpy(out + 2 * i, &sample, sizeof(sample));
+    }
+}
+
+size_t convertToMonoFloatInPlace(uint8_t *data, size_t length, size_t capacity, const AudioFormat &format, ConvertPath path)
+{
+    const size_t frameBytes = format.bytesPerSample() * std::max<size_t>(1, format.channels);
+    if (frameBytes == 0 || capacity < monoFloatBytes(format, length))
+    {
+        return 0;
+    }
+
+    // Narrow mono input grows during conversion. Moving it to the end of the buffer lets the
+    // forward pass write behind the read position without overtaking it.
+    size_t frames = length / frameBytes;
+    const uint8_t *in = data;
+    if (frameBytes < sizeof(float))
+    {
+        size_t inputBytes = frames * frameBytes;
+        uint8_t *moved = data + frames * sizeof(float) - inputBytes;
+        std::memmove(moved, data, inputBytes);
+        in = moved;
+    }
+    return convertToMonoFloat(in, frames, format, reinterpret_cast<float *>(data), path);
+}
+
+void removeDcOffset(float *samples, size_t count, ConvertPath path)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (path == ConvertPath::Simd)
+    {
+        subtractSimd(samples, count, float(sumSimd(samples, count) / double(count)));
+        return;
+    }
+
+    float offset = float(sumScalar(samples, count) / double(count));
+    for (size_t i = 0; i < count; ++i)
+    {
+        samples[i] -= offset;
+    }
+}
+
+bool runAudioConvertBenchmark(size_t frames, int iterations)
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<uint8_t> input(frames * 4 * 4);
+    for (auto &value : input)
+    {
+        value = uint8_t(byte(random));
+    }
+    // Keep the float input finite, random bit patterns would produce NaNs
+    std::vector<float> floats(frames * 4);
+    std::uniform_real_distribution<float> sample(-1.0f, 1.0f);
+    for (auto &value : floats)
+    {
+        value = sample(random);
+    }
+
+    std::vector<float> scalarOut(frames);
+    std::vector<float> simdOut(frames);
+    bool allMatch = true;
+
+    auto timeNs = [&](auto &&run)
+    {
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            run();
+        }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double(iterations) * double(frames));
+    };
+
+    auto report = [&](const std::string &name, double scalarNs, double simdNs, bool match)
+    {
+        allMatch = allMatch && match;
+        std::cout << std::left << std::setw(14) << name << std::right << std::fixed << std::setprecision(3)
+                  << " scalar " << scalarNs << " ns/frame, simd " << simdNs << " ns/frame ("
+                  << std::setprecision(2) << scalarNs / simdNs << "x) " << (match ? "match" : "MISMATCH") << std::endl;
+    };
+
+    std::cout << "Audio conversion benchmark, " << frames << " frames x " << iterations << " iterations, SIMD "
+              << (simdConvertAvailable() ? "enabled" : "unavailable") << std::endl;
+
+    const SampleFormat formats[] = {SampleFormat::S16LE, SampleFormat::S24LE, SampleFormat::S32LE, SampleFormat::F32LE};
+    const char *formatNames[] = {"S16LE", "S24LE", "S32LE", "F32LE"};
+    for (size_t i = 0; i < 4; ++i)
+    {
+        for (uint8_t channels : {1, 2, 4})
+        {
+            AudioFormat format;
+            format.sampleFormat = formats[i];
+            format.channels = channels;
+            const uint8_t *source = formats[i] == SampleFormat::F32LE ? reinterpret_cast<const uint8_t *>(floats.data()) : input.data();
+
+            double scalarNs = timeNs([&]
+                                     { convertToMonoFloat(source, frames, format, scalarOut.data(), ConvertPath::Scalar); });
+            double simdNs = timeNs([&]
+                                   { convertToMonoFloat(source, frames, format, simdOut.data(), ConvertPath::Simd); });
+            bool match = std::memcmp(scalarOut.data(), simdOut.data(), frames * sizeof(float)) == 0;
+            report(std::string(formatNames[i]) + " x" + std::to_string(channels), scalarNs, simdNs, match);
+        }
+    }
+
+    // DC removal works on the converted signal, re-run on fresh copies so both paths see the same input
+    std::vector<float> signal(floats.begin(), floats.begin() + frames);
+    double scalarNs = timeNs([&]
+                             { scalarOut = signal; removeDcOffset(scalarOut.data(), frames, ConvertPath::Scalar); });
+    double simdNs = timeNs([&]
+                           { simdOut = signal; removeDcOffset(simdOut.data(), frames, ConvertPath::Simd); });
+    report("DC removal", scalarNs, simdNs, std::memcmp(scalarOut.data(), simdOut.data(), frames * sizeof(float)) == 0);
+
+    return allMatch;
+}
@@ -0,0 +1,17 @@
+#include "AudioFormat.h"
+
+size_t AudioFormat::bytesPerSample() const
+{
+    switch (sampleFormat)
+    {
+    case SampleFormat::S16LE:
+        return 2;
+    case SampleFormat::S24LE:
+        return 3;
+    case SampleFormat::S32LE:
+    case SampleFormat::F32LE:
+        return 4;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,168 @@
+#include "Resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <tuple>
+
+#if defined(__SSE2__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    constexpr size_t kMaxBankCoefficients = 1 << 20;
+    constexpr double kPassband = 0.92; // Fraction of the lower Nyquist frequency that is kept
+
+    // taps is a multiple of 4
+    inline float dot(const float *coefficients, const float *samples, size_t taps)
+    {
+#if defined(__SSE2__)
+        __m128 acc = _mm_setzero_ps();
+        for (size_t i = 0; i < taps; i += 4)
+        {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(coefficients + i), _mm_loadu_ps(samples + i)));
+        }
+        __m128 shuffled = _mm_movehl_ps(acc, acc);
+        acc = _mm_add_ps(acc, shuffled);
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        return _mm_cvtss_f32(acc);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (size_t i = 0; i < taps; i += 4)
+        {
+            acc = vmlaq_f32(acc, vld1q_f32(coefficients + i), vld1q_f32(samples + i));
+        }
+        float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+        return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+        float sum = 0.0f;
+        for (size_t i = 0; i < taps; ++i)
+        {
+            sum += coefficients[i] * samples[i];
+        }
+        return sum;
+#endif
+    }
+}
+
+Resampler::Resampler(uint32_t inputRate, uint32_t outputRate, uint8_t channels, size_t tapsPerPhase)
+    : inputRate_(inputRate), outputRate_(outputRate), channels_(std::max<uint8_t>(1, channels)), time_(0)
+{
+    if (inputRate == 0 || outputRate == 0)
+    {
+        throw std::invalid_argument("Resampler rates must be non-zero");
+    }
+
+    uint32_t divisor = std::gcd(inputRate, outputRate);
+    size_t taps = (std::max<size_t>(4, tapsPerPhase) + 3) & ~size_t(3);
+    bank_ = filterBank(outputRate / divisor, inputRate / divisor, taps);
+    buffers_.resize(channels_);
+    reset();
+}
+
+std::shared_ptr<const Resampler::FilterBank> Resampler::filterBank(uint32_t up, uint32_t down, size_t taps)
+{
+    static std::mutex cacheMutex;
+    static std::map<std::tuple<uint32_t, uint32_t, size_t>, std::shared_ptr<const FilterBank>> cache;
+
+    std::lock_guard<std::mutex> guard(cacheMutex);
+    auto key = std::make_tuple(up, down, taps);
+    auto it = cache.find(key);
+    if (it != cache.end())
+    {
+        return it->second;
+    }
+
+    if (size_t(up) * taps > kMaxBankCoefficients)
+    {
+        throw std::invalid_argument("Resampling ratio " + std::to_string(up) + "/" + std::to_string(down) + " needs too many filter phases");
+    }
+
+    // Windowed-sinc low-pass at the upsampled rate, cut below the lower of both Nyquist frequencies
+    auto bank = std::make_shared<FilterBank>();
+    bank->up = up;
+    bank->down = down;
+    bank->taps = taps;
+    bank->coefficients.resize(size_t(up) * taps);
+
+    const size_t length = size_t(up) * taps;
+    const double center = (double(length) - 1.0) / 2.0;
+    const double cutoff = 0.5 * kPassband / std::max(up, down);
+    std::vector<double> prototype(length);
+    for (size_t i = 0; i < length; ++i)
+    {
+        double x = double(i) - center;
+        double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+        double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * i / (length - 1)) + 0.08 * std::cos(4.0 * M_PI * i / (length - 1));
+        prototype[i] = sinc * window * up;
+    }
+
+    for (uint32_t phase = 0; phase < up; ++phase)
+    {
+        float *row = bank->coefficients.data() + size_t(phase) * taps;
+        for (size_t k = 0; k < taps; ++k)
+        {
+            row[taps - 1 - k] = float(prototype[phase + k * up]);
+        }
+    }
+
+    cache.emplace(key, bank);
+    return bank;
+}
+
+size_t Resampler::process(const float *in, size_t frames, float *out)
+{
+    const size_t taps = bank_->taps;
+    const uint64_t up = bank_->up;
+    const uint64_t down = bank_->down;
+
+    // Append the new input behind the kept history, one contiguous buffer per channel
+    for (uint8_t c = 0; c < channels_; ++c)
+    {
+        std::vector<float> &buffer = buffers_[c];
+        buffer.resize(taps - 1 + frames);
+        float *dst = buffer.data() + taps - 1;
+        for (size_t f = 0; f < frames; ++f)
+        {
+            dst[f] = in[f * channels_ + c];
+        }
+    }
+
+    size_t written = 0;
+    const uint64_t end = uint64_t(frames) * up;
+    for (; time_ < end; time_ += down, ++written)
+    {
+        const float *coefficients = bank_->coefficients.data() + size_t(time_ % up) * taps;
+        size_t base = size_t(time_ / up);
+        for (uint8_t c = 0; c < channels_; ++c)
+        {
+            out[written * channels_ + c] = dot(coefficients, buffers_[c].data() + base, taps);
+        }
+    }
+    time_ -= end;
+
+    for (auto &buffer : buffers_)
+    {
+        buffer.erase(buffer.begin(), buffer.end() - (taps - 1));
+    }
+    return written;
+}
+
+size_t Resampler::maxOutputFrames(size_t inputFrames) const
+{
+    return size_t((uint64_t(inputFrames) * bank_->up + bank_->down - 1) / bank_->down) + 1;
+}
+
+void Resampler::reset()
+{
+    for (auto &buffer : buffers_)
+    {
+        buffer.assign(bank_->taps - 1, 0.0f);
+    }
+    time_ = 0;
+}
@@ -0,0 +1,190 @@
+#include "VoiceActivity.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define VOICEACTIVITY_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VOICEACTIVITY_NEON 1
+#endif
+
+namespace
+{
+    struct FrameFeatures
+    {
+        float energyDb;
+        float zeroCrossingRate;
+    };
+
+    // Sum of squares and sign changes of one frame; previous is the sample before the frame
+    void measureFrame(const float *x, size_t n, float previous, double &energy, size_t &crossings)
+    {
+        size_t i = 0;
+        energy = 0.0;
+        crossings = 0;
+
+#if defined(VOICEACTIVITY_SSE2)
+        __m128 sum = _mm_setzero_ps();
+        for (; i + 4 <= n; i += 4)
+        {
+            // A sign change flips the sign bit of the xor with the sample before
+            __m128 v = _mm_loadu_ps(x + i);
+            __m128 before = i == 0 ? _mm_setr_ps(previous, x[0], x[1], x[2]) : _mm_loadu_ps(x + i - 1);
+            sum = _mm_add_ps(sum, _mm_mul_ps(v, v));
+            crossings += __builtin_popcount(_mm_movemask_ps(_mm_xor_ps(v, before)));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, sum);
+        energy = double(lanes[0]) + double(lanes[1]) + double(lanes[2]) + double(lanes[3]);
+#elif defined(VOICEACTIVITY_NEON)
+        float32x4_t sum = vdupq_n_f32(0.0f);
+        uint32x4_t changes = vdupq_n_u32(0);
+        for (; i + 4 <= n; i += 4)
+        {
+            float32x4_t v = vld1q_f32(x + i);
+            float32x4_t before = i == 0 ? float32x4_t{previous, x[0], x[1], x[2]} : vld1q_f32(x + i - 1);
+            sum = vmlaq_f32(sum, v, v);
+            uint32x4_t flipped = veorq_u32(vreinterpretq_u32_f32(v), vreinterpretq_u32_f32(before));
+            changes = vaddq_u32(changes, vshrq_n_u32(flipped, 31));
+        }
+        energy = double(vgetq_lane_f32(sum, 0)) + double(vgetq_lane_f32(sum, 1)) + double(vgetq_lane_f32(sum, 2)) + double(vgetq_lane_f32(sum, 3));
+        crossings = vgetq_lane_u32(changes, 0) + vgetq_lane_u32(changes, 1) + vgetq_lane_u32(changes, 2) + vgetq_lane_u32(changes, 3);
+#endif
+
+        for (; i < n; ++i)
+        {
+            float before = i == 0 ? previous : x[i - 1];
+            energy += double(x[i]) * double(x[i]);
+            crossings += std::signbit(x[i]) != std::signbit(before);
+        }
+    }
+
+    std::vector<FrameFeatures> measureFrames(const float *samples, size_t count, size_t frameSamples)
+    {
+        std::vector<FrameFeatures> frames;
+        frames.reserve(count / frameSamples + 1);
+        for (size_t begin = 0; begin < count; begin += frameSamples)
+        {
+            size_t n = std::min(frameSamples, count - begin);
+            double energy;
+            size_t crossings;
+            measureFrame(samples + begin, n, begin == 0 ? samples[0] : samples[begin - 1], energy, crossings);
+            frames.push_back(FrameFeatures{float(10.0 * std::log10(energy / double(n) + 1e-10)), float(crossings) / float(n)});
+        }
+        return frames;
+    }
+
+    float percentile(std::vector<float> values, float fraction)
+    {
+        size_t index = std::min(values.size() - 1, size_t(fraction * float(values.size())));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+}
+
+std::vector<SpeechSegment> detectSpeech(const float *samples, size_t count, uint32_t sampleRate, const VadParams &params)
+{
+    std::vector<SpeechSegment> segments;
+    size_t frameSamples = std::max<size_t>(1, size_t(sampleRate) * size_t(std::max(1, params.frame_ms)) / 1000);
+    if (count == 0 || sampleRate == 0)
+    {
+        return segments;
+    }
+
+    std::vector<FrameFeatures> frames = measureFrames(samples, count, frameSamples);
+    std::vector<float> energies(frames.size());
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        energies[i] = frames[i].energyDb;
+    }
+
+    // The quietest tenth of the upload stands in for the noise floor. When the loud part is not
+    // clearly above it the upload is either all noise or all speech, only the level can tell.
+    float noiseFloor = percentile(energies, 0.1f);
+    float loud = percentile(energies, 0.9f);
+    float threshold = std::max(params.min_speech_db, noiseFloor + params.margin_db);
+    if (loud < threshold)
+    {
+        threshold = params.min_speech_db + params.margin_db;
+    }
+
+    std::vector<bool> speech(frames.size());
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        speech[i] = frames[i].energyDb >= threshold && frames[i].zeroCrossingRate <= params.max_zero_crossing_rate;
+    }
+
+    // Runs of speech frames, with short pauses bridged and short bursts dropped
+    size_t maxGapFrames = size_t(std::max(0, params.max_gap_ms / std::max(1, params.frame_ms)));
+    size_t minSpeechFrames = size_t(std::max(1, params.min_speech_ms / std::max(1, params.frame_ms)));
+    std::vector<std::pair<size_t, size_t>> runs;
+    for (size_t i = 0; i < speech.size();)
+    {
+        if (!speech[i])
+        {
+            ++i;
+            continue;
+        }
+        size_t begin = i;
+        while (i < speech.size() && speech[i])
+        {
+            ++i;
+        }
+        if (!runs.empty() && begin - runs.back().second <= maxGapFrames)
+        {
+            runs.back().second = i;
+        }
+        else
+        {
+            runs.emplace_back(begin, i);
+        }
+    }
+
+    size_t padding = size_t(sampleRate) * size_t(std::max(0, params.padding_ms)) / 1000;
+    for (const auto &run : runs)
+    {
+        if (run.second - run.first < minSpeechFrames)
+        {
+            continue;
+        }
+        size_t begin = run.first * frameSamples;
+        size_t end = std::min(count, run.second * frameSamples);
+        begin = begin > padding ? begin - padding : 0;
+        end = std::min(count, end + padding);
+        if (!segments.empty() && begin <= segments.back().end)
+        {
+            segments.back().end = end;
+        }
+        else
+        {
+            segments.push_back(SpeechSegment{begin, end});
+        }
+    }
+    return segments;
+}
+
+size_t trimToSpeech(float *samples, size_t count, uint32_t sampleRate, const VadParams &params)
+{
+    std::vector<SpeechSegment> segments = detectSpeech(samples, count, sampleRate, params);
+    size_t joinGap = size_t(sampleRate) * size_t(std::max(0, params.join_gap_ms)) / 1000;
+
+    // Segments only ever move towards the front, the silence written between them never
+    // reaches audio that has not been moved yet
+    size_t written = 0;
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        const SpeechSegment &segment = segments[i];
+        if (i > 0)
+        {
+            size_t gap = std::min(joinGap, segment.begin - written);
+            std::fill(samples + written, samples + written + gap, 0.0f);
+            written += gap;
+        }
+        std::memmove(samples + written, samples + segment.begin, (segment.end - segment.begin) * sizeof(float));
+        written += segment.end - segment.begin;
+    }
+    return written;
+}
@@ -0,0 +1,132 @@
+#include "AudioBufferPool.h"
+#include <utility>
+
+AudioBufferPool::Buffer::Buffer() : pool(nullptr), ptr(nullptr), cap(0), sizeClass(-1) {}
+
+AudioBufferPool::Buffer::Buffer(AudioBufferPool *pool, uint8_t *ptr, size_t cap, int sizeClass)
+    : pool(pool), ptr(ptr), cap(cap), sizeClass(sizeClass) {}
+
+AudioBufferPool::Buffer::~Buffer()
+{
+    reset();
+}
+
+AudioBufferPool::Buffer::Buffer(Buffer &&other) noexcept
+    : pool(other.pool), ptr(other.ptr), cap(other.cap), sizeClass(other.sizeClass)
+{
+    other.pool = nullptr;
+    other.ptr = nullptr;
+    other.cap = 0;
+    other.sizeClass = -1;
+}
+
+AudioBufferPool::Buffer &AudioBufferPool::Buffer::operator=(Buffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        reset();
+        std::swap(pool, other.pool);
+        std::swap(ptr, other.ptr);
+        std::swap(cap, other.cap);
+        std::swap(sizeClass, other.sizeClass);
+    }
+    return *this;
+}
+
+void AudioBufferPool::Buffer::reset()
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    if (pool != nullptr && sizeClass >= 0)
+    {
+        pool->release(ptr, sizeClass);
+    }
+    else
+    {
+        delete[] ptr;
+    }
+    pool = nullptr;
+    ptr = nullptr;
+    cap = 0;
+    sizeClass = -1;
+}
+
+AudioBufferPool::AudioBufferPool(size_t maxCachedBytes) : cached(0), maxCached(maxCachedBytes) {}
+
+AudioBufferPool::~AudioBufferPool()
+{
+    for (auto &freeList : freeLists)
+    {
+        for (uint8_t *ptr : freeList)
+        {
+            delete[] ptr;
+        }
+    }
+}
+
+AudioBufferPool::Buffer AudioBufferPool::acquire(size_t minCapacity)
+{
+    int sizeClass = sizeClassFor(minCapacity);
+    if (sizeClass < 0)
+    {
+        // Too large to be worth caching
+        return Buffer(nullptr, new uint8_t[minCapacity], minCapacity, -1);
+    }
+
+    size_t capacity = size_t(1) << (sizeClass + minClassShift);
+    {
+        std::lock_guard<std::mutex> guard(poolMutex);
+        auto &freeList = freeLists[sizeClass];
+        if (!freeList.empty())
+        {
+            uint8_t *ptr = freeList.back();
+            freeList.pop_back();
+            cached -= capacity;
+            return Buffer(this, ptr, capacity, sizeClass);
+        }
+    }
+
+    return Buffer(this, new uint8_t[capacity], capacity, sizeClass);
+}
+
+size_t AudioBufferPool::cachedBytes() const
+{
+    std::lock_guard<std::mutex> guard(poolMutex);
+    return cached;
+}
+
+AudioBufferPool &AudioBufferPool::shared()
+{
+    static AudioBufferPool pool;
+    return pool;
+}
+
+void AudioBufferPool::release(uint8_t *ptr, int sizeClass)
+{
+    size_t capacity = size_t(1) << (sizeClass + minClassShift);
+    {
+        std::lock_guard<std::mutex> guard(poolMutex);
+        if (cached + capacity <= maxCached)
+        {
+            freeLists[sizeClass].push_back(ptr);
+            cached += capacity;
+            return;
+        }
+    }
+    delete[] ptr;
+}
+
+int AudioBufferPool::sizeClassFor(size_t capacity)
+{
+    for (int sizeClass = 0; sizeClass < classCount; ++sizeClass)
+    {
+        if (capacity <= (size_t(1) << (sizeClass + minClassShift)))
+        {
+            return sizeClass;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,102 @@
+#include "AudioFrame.h"
+
+namespace
+{
+    inline uint16_t readLE16(const uint8_t *p)
+    {
+        return uint16_t(p[0]) | uint16_t(p[1]) << 8;
+    }
+
+    inline uint32_t readLE32(const uint8_t *p)
+    {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+
+    inline uint64_t readLE64(const uint8_t *p)
+    {
+        return uint64_t(readLE32(p)) | uint64_t(readLE32(p + 4)) << 32;
+    }
+
+    inline void writeLE16(uint8_t *p, uint16_t v)
+    {
+        p[0] = uint8_t(v);
+        p[1] = uint8_t(v >> 8);
+    }
+
+    inline void writeLE32(uint8_t *p, uint32_t v)
+    {
+        p[0] = uint8_t(v);
+        p[1] = uint8_t(v >> 8);
+        p[2] = uint8_t(v >> 16);
+        p[3] = uint8_t(v >> 24);
+    }
+
+    inline void writeLE64(uint8_t *p, uint64_t v)
+    {
+        writeLE32(p, uint32_t(v));
+        writeLE32(p + 4, uint32_t(v >> 32));
+    }
+}
+
+bool isEventFrame(FrameType type)
+{
+    return type >= FrameType::Partial && type <= FrameType::TaskStatus;
+}
+
+bool hasFrameMagic(const uint8_t *bytes, size_t length)
+{
+    return length >= 4 && readLE32(bytes) == FrameHeader::kMagic;
+}
+
+FrameStatus decodeFrameHeader(const uint8_t *bytes, size_t length, FrameHeader &header)
+{
+    if (length < FrameHeader::kSize)
+    {
+        return FrameStatus::NeedMore;
+    }
+    if (readLE32(bytes) != FrameHeader::kMagic)
+    {
+        return FrameStatus::BadMagic;
+    }
+
+    header.version = bytes[4];
+    if (header.version != FrameHeader::kVersion)
+    {
+        return FrameStatus::BadVersion;
+    }
+
+    uint8_t type = bytes[5];
+    if (type < uint8_t(FrameType::Audio) || type > uint8_t(FrameType::TaskStatus))
+    {
+        return FrameStatus::BadType;
+    }
+    header.type = FrameType(type);
+    header.flags = readLE16(bytes + 6);
+    header.streamId = readLE32(bytes + 8);
+    header.sequence = readLE32(bytes + 12);
+    header.timestampUs = readLE64(bytes + 16);
+    header.format.sampleRate = readLE32(bytes + 24);
+    header.format.channels = bytes[28];
+    header.format.sampleFormat = SampleFormat(bytes[29]);
+    header.format.codec = CodecType(bytes[30]);
+    header.queueDepth = bytes[31];
+    header.payloadLength = readLE32(bytes + 32);
+    return FrameStatus::Ok;
+}
+
+void encodeFrameHeader(const FrameHeader &header, uint8_t *out)
+{
+    writeLE32(out, FrameHeader::kMagic);
+    out[4] = header.version;
+    out[5] = uint8_t(header.type);
+    writeLE16(out + 6, header.flags);
+    writeLE32(out + 8, header.streamId);
+    writeLE32(out + 12, header.sequence);
+    writeLE64(out + 16, header.timestampUs);
+    writeLE32(out + 24, header.format.sampleRate);
+    out[28] = header.format.channels;
+    out[29] = uint8_t(header.format.sampleFormat);
+    out[30] = uint8_t(header.format.codec);
+    out[31] = header.queueDepth;
+    writeLE32(out + 32, header.payloadLength);
+}
@@ -1,12 +1,28 @@
 #include "NetworkManager.h"
+#include "gauge.h"
+#include "registry.h"
 #include <cerrno>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
 #include <iostream>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <chrono>
+#include <random>
+#include <stdexcept>
 
 #if defined(BUILD_FULL) || defined(BUILD_SERVER)
 
-NetworkManager::NetworkManager(int port, char *serverIp, Protocol protocol, ModelRunner *nerModel, ModelRunner *classificationModel)
-    : port(port), serverIp(serverIp), serverSd(-1), udpSd(-1), connectedToSpecialServer(false), protocol(protocol), clientAddrUDPSize(sizeof(clientAddrUDP)), nerModel(nerModel), classificationModel(classificationModel)
+NetworkManager::NetworkManager(int port, char *serverIp, Protocol protocol, ModelRunner *nerModel, ModelRunner *classificationModel, const ServerParams &serverParams)
+    : port(port), serverIp(serverIp), serverSd(-1), udpSd(-1), clientAddrUDPSize(sizeof(clientAddrUDP)), connectedToSpecialServer(false), protocol(protocol), serverParams(serverParams), running(false), nextReactor(0), clientStopping(false), clientConnected(false), clientServerQueueDepth(0), connectionGeneration(0), clientDownsample(1), clientUplinkRate(0), clientStreamId(0), clientSequence(0), nerModel(nerModel), classificationModel(classificationModel)
 {
     std::cout << "Server IP: " << (serverIp ? serverIp : "None") << std::endl;
     std::cout << "Server Port: " << port << std::endl;
@@ -14,9 +30,21 @@ NetworkManager::NetworkManager(int port, char *serverIp, Protocol protocol, Mode
     // WhisperTranscriber setup
     WhisperTranscriber::Params transcriberParams;
     transcriberParams.language = "en";
-    transcriberParams.n_threads = 4;                          // Adjust the number of threads
-    transcriberParams.model_path = "models/ggml-base.en.bin"; // Provide the correct model path
-    transcriber.setup(transcriberParams);
+    transcriberParams.n_threads = serverParams.transcriber_threads;
+    transcriberParams.n_states = serverParams.transcriber_states;
+    transcriberParams.beam_size = serverParams.transcriber_beam_size;
+    transcriberParams.model_path = serverParams.transcriber_model;
+    transcriberParams.fast_model_path = serverParams.transcriber_fast_model;
+    transcriberParams.fast_max_ms = serverParams.transcriber_fast_max_ms;
+    transcriberParams.fast_min_confidence = serverParams.transcriber_fast_min_confidence;
+
+    // Transcripts finishing within a few milliseconds of each other share one NER and one classification batch
+    if (classificationModel && serverParams.intent_batch_delay_us > 0)
+    {
+        utteranceBatcher = std::make_unique<MicroBatcher<Utterance>>([nerModel, classificationModel](const std::vector<std::string> &transcripts)
+                                                                     { return UnderstandUtterances(nerModel, classificationModel, transcripts); },
+                                                                     size_t(std::max(1, serverParams.intent_batch_size)), std::chrono::microseconds(serverParams.intent_batch_delay_us));
+    }
 
     if (protocol == TCP)
     {
@@ -35,12 +63,42 @@ NetworkManager::NetworkManager(int port, char *serverIp, Protocol protocol, Mode
     {
         setupUDPSocket();
     }
+
+    // Reading the model takes seconds, the sockets are already up by now and utterances that
+    // arrive meanwhile wait in the worker queue until the transcriber is ready
+    transcriber.beginLoading();
+    modelLoader = std::thread([this, transcriberParams]()
+                              {
+        if (transcriber.setup(transcriberParams))
+        {
+            std::cout << "Whisper ready after " << transcriber.loadSeconds() << " s" << std::endl;
+        }
+        else
+        {
+            std::cerr << "Failed to load Whisper model " << transcriberParams.model_path << ", utterances will not be transcribed" << std::endl;
+        }
+        publishModelMetrics(); });
+}
+
+WhisperTranscriber::State NetworkManager::transcriberState() const
+{
+    return transcriber.state();
+}
+
+void NetworkManager::publishModelMetrics()
+{
+    std::lock_guard<std::mutex> lock(modelMetricsMutex);
+    if (modelReadyGauge)
+    {
+        modelReadyGauge->Set(transcriber.state() == WhisperTranscriber::State::Ready ? 1.0 : 0.0);
+        modelLoadGauge->Set(transcriber.loadSeconds());
+    }
 }
 
 #else
 
-NetworkManager::NetworkManager(int port, char *serverIp, Protocol protocol)
-    : port(port), serverIp(serverIp), serverSd(-1), udpSd(-1), connectedToSpecialServer(false), protocol(protocol), clientAddrUDPSize(sizeof(clientAddrUDP))
+NetworkManager::NetworkManager(int port, char *serverIp, Protocol protocol, const ServerParams &serverParams)
+    : port(port), serverIp(serverIp), serverSd(-1), udpSd(-1), clientAddrUDPSize(sizeof(clientAddrUDP)), connectedToSpecialServer(false), protocol(protocol), serverParams(serverParams), running(false), nextReactor(0), clientStopping(false), clientConnected(false), clientServerQueueDepth(0), connectionGeneration(0), clientDownsample(1), clientUplinkRate(0), clientStreamId(0), clientSequence(0)
 {
     std::cout << "Server IP: " << (serverIp ? serverIp : "None") << std::endl;
     std::cout << "Server Port: " << port << std::endl;
@@ -66,39 +124,372 @@ NetworkManager::NetworkManager(int port, char *serverIp, Protocol protocol)
 
 #endif
 
-void NetworkManager::processSoundData(const SoundData *inputData, uint8_t *outputData)
+bool NetworkManager::decodeSoundData(SoundData &soundData)
+{
+    if (soundData.format.codec == CodecType::PCM)
+    {
+        return true;
+    }
+
+    uint8_t channels = std::max<uint8_t>(1, soundData.format.channels);
+    size_t decodedLength = decodedAudioSize(soundData.format.codec, soundData.data, soundData.length, channels);
+    if (decodedLength == 0)
+    {
+        std::cerr << "Malformed or unsupported audio codec payload: " << int(soundData.format.codec) << std::endl;
+        return false;
+    }
+
+    AudioBufferPool::Buffer decoded = AudioBufferPool::shared().acquire(decodedLength);
+    decodeAudio(soundData.format.codec, soundData.data, soundData.length, channels, decoded.data());
+    soundData.buffer = std::move(decoded);
+    soundData.data = soundData.buffer.data();
+    soundData.length = decodedLength;
+    soundData.format.codec = CodecType::PCM;
+    soundData.format.sampleFormat = SampleFormat::S16LE;
+    return true;
+}
+
+void NetworkManager::processSoundData(SoundData *soundData, const EventCallback &emit)
 {
+    // Compressed uplinks are expanded to S16LE before anything looks at the samples
+    if (!decodeSoundData(*soundData))
+    {
+        soundData->length = 0;
+        return;
+    }
+
+#if defined(BUILD_FULL) || defined(BUILD_SERVER)
+    // Convert the sound data to mono PCM float in place, as declared by the upload format
+    const AudioFormat &format = soundData->format;
+    if (format.bytesPerSample() == 0)
+    {
+        // Never echo the upload back, the buffer still holds the client's raw bytes
+        std::cerr << "Unsupported sample format: " << int(format.sampleFormat) << std::endl;
+        if (emit)
+        {
+            emit(FrameType::TaskStatus, "unsupported-format");
+        }
+        reportTranscript(soundData, "", emit);
+        return;
+    }
+
+    soundData->reserve(monoFloatBytes(format, soundData->length));
+    size_t frames = convertToMonoFloatInPlace(soundData->data, soundData->length, soundData->buffer.capacity(), format);
+    float *pcmf32 = reinterpret_cast<float *>(soundData->data);
+    removeDcOffset(pcmf32, frames);
+
+    // Whisper expects 16 kHz, anything else is resampled instead of being transcribed at the wrong speed
+    if (format.sampleRate != 0 && format.sampleRate != WHISPER_SAMPLE_RATE)
+    {
+        try
+        {
+            Resampler resampler(format.sampleRate, WHISPER_SAMPLE_RATE);
+            AudioBufferPool::Buffer resampled = AudioBufferPool::shared().acquire(resampler.maxOutputFrames(frames) * sizeof(float));
+            frames = resampler.process(pcmf32, frames, reinterpret_cast<float *>(resampled.data()));
+            soundData->buffer = std::move(resampled);
+            soundData->data = soundData->buffer.data();
+            pcmf32 = reinterpret_cast<float *>(soundData->data);
+            soundData->format.sampleRate = WHISPER_SAMPLE_RATE;
+        }
+        catch (const std::exception &e)
+        {
+            // The buffer already holds converted samples, answer with an empty transcript instead
+            std::cerr << "Cannot resample " << format.sampleRate << " Hz audio: " << e.what() << std::endl;
+            if (emit)
+            {
+                emit(FrameType::TaskStatus, "unsupported-rate");
+            }
+            reportTranscript(soundData, "", emit);
+            return;
+        }
+    }
+
+    // Whisper cost grows with the audio length, leading and trailing silence and long pauses are dropped
+    if (serverParams.trim_silence)
+    {
+        size_t speechFrames = trimToSpeech(pcmf32, frames, WHISPER_SAMPLE_RATE, serverParams.vad);
+        if (speechFrames == 0)
+        {
+            std::cout << "No speech in stream " << soundData->streamId << ", skipping transcription" << std::endl;
+            if (emit)
+            {
+                emit(FrameType::TaskStatus, "no-speech");
+            }
+            reportTranscript(soundData, "", emit);
+            return;
+        }
+        frames = speechFrames;
+    }
+
+    soundData->length = frames * sizeof(float);
+    soundData->format.channels = 1;
+    soundData->format.sampleFormat = SampleFormat::F32LE;
+
+    // Transcribe the received sound data using WhisperTranscriber, pushing each finished segment
+    WhisperTranscriber::SegmentCallback onSegment;
+    if (emit)
+    {
+        onSegment = [&emit](const std::string &textSoFar)
+        {
+            emit(FrameType::Partial, textSoFar);
+        };
+    }
+    if (emit && transcriber.state() == WhisperTranscriber::State::Loading)
+    {
+        emit(FrameType::TaskStatus, "loading-model");
+    }
+    std::string transcription = transcriber.transcribeLiveData(pcmf32, frames, onSegment);
+    reportTranscript(soundData, transcription, emit);
+
+#else
+    // Default sound processing (e.g., inverting the data), done in place so the response reuses the receive buffer.
+    // There is no transcriber here, so nothing to report besides the result itself.
+    (void)emit;
+    for (size_t i = 0; i < soundData->length; ++i)
+    {
+        soundData->data[i] = ~soundData->data[i]; // Example processing: inverting the data
+    }
+#endif
+}
+
 #if defined(BUILD_FULL) || defined(BUILD_SERVER)
-    // Transcribe the received sound data using WhisperTranscriber
-    std::vector<float> pcmf32(inputData->data, inputData->data + inputData->length / sizeof(float)); // Convert the sound data to PCM float
-    std::string transcription = transcriber.transcribeLiveData(pcmf32);
 
+struct NetworkManager::LiveTranscription
+{
+    uint32_t streamId;
+    AudioFormat format;
+    size_t receivedBytes = 0;
+
+    // Filled by the reactor, frame payloads not fed to the stream yet
+    std::mutex chunksMutex;
+    std::vector<std::vector<uint8_t>> chunks;
+    bool drainScheduled = false;
+
+    // Owned by whichever worker holds streamMutex
+    std::mutex streamMutex;
+    std::unique_ptr<WhisperTranscriber::Stream> stream;
+    std::unique_ptr<Resampler> resampler;
+    std::vector<uint8_t> decoded;
+    std::vector<float> mono;
+    std::vector<float> resampled;
+};
+
+void NetworkManager::reportTranscript(SoundData *soundData, const std::string &transcription, const EventCallback &emit)
+{
     if (!transcription.empty())
     {
         std::cout << "Transcription: " << transcription << std::endl;
-        // Process the transcription result here if needed (e.g., sending it back to the client)
+        if (emit)
+        {
+            emit(FrameType::Final, transcription);
+        }
+
+        if (emit && classificationModel && classificationModel->IsLoaded())
+        {
+            // Each model leases one of its interpreters, NER and classification run side by side
+            Utterance utterance = utteranceBatcher ? utteranceBatcher->run(transcription) : UnderstandUtterance(nerModel, classificationModel, transcription);
+            for (const EntitySpan &entity : utterance.entities)
+            {
+                std::cout << "Entity: " << entity.text << " -> " << entity.type << std::endl;
+            }
+            std::cout << "Intent: " << utterance.intent << std::endl;
+            emit(FrameType::Intent, utterance.intent);
+        }
+    }
+
+    // The response carries the transcript instead of the converted audio
+    soundData->reserve(transcription.size());
+    std::copy(transcription.begin(), transcription.end(), soundData->data);
+    soundData->length = transcription.size();
+    soundData->format = AudioFormat();
+}
+
+void NetworkManager::drainLiveTranscription(LiveTranscription &live, const EventCallback &emit)
+{
+    // Called with streamMutex held
+    while (true)
+    {
+        std::vector<std::vector<uint8_t>> chunks;
+        {
+            std::lock_guard<std::mutex> guard(live.chunksMutex);
+            chunks.swap(live.chunks);
+            if (chunks.empty())
+            {
+                live.drainScheduled = false;
+                return;
+            }
+        }
+
+        for (auto &chunk : chunks)
+        {
+            // Every frame payload is encoded on its own, so it decodes without the previous ones
+            const uint8_t *data = chunk.data();
+            size_t length = chunk.size();
+            AudioFormat format = live.format;
+            if (format.codec != CodecType::PCM)
+            {
+                uint8_t channels = std::max<uint8_t>(1, format.channels);
+                live.decoded.resize(decodedAudioSize(format.codec, data, length, channels));
+                if (live.decoded.empty())
+                {
+                    continue;
+                }
+                decodeAudio(format.codec, data, length, channels, live.decoded.data());
+                data = live.decoded.data();
+                length = live.decoded.size();
+                format.codec = CodecType::PCM;
+                format.sampleFormat = SampleFormat::S16LE;
+            }
+
+            size_t frameBytes = format.bytesPerSample() * std::max<uint8_t>(1, format.channels);
+            size_t frames = length / frameBytes;
+            live.mono.resize(frames);
+            convertToMonoFloat(data, frames, format, live.mono.data());
+
+            const float *samples = live.mono.data();
+            if (live.resampler)
+            {
+                live.resampled.resize(live.resampler->maxOutputFrames(frames));
+                frames = live.resampler->process(live.mono.data(), frames, live.resampled.data());
+                samples = live.resampled.data();
+            }
+
+            std::string stable = live.stream->stable();
+            live.stream->push(samples, frames);
+            if (emit && live.stream->stable() != stable)
+            {
+                emit(FrameType::Partial, live.stream->stable());
+            }
+        }
+    }
+}
+
+#endif
+
+void NetworkManager::feedLiveTranscription(Reactor &reactor, const std::shared_ptr<Connection> &connection)
+{
+#if defined(BUILD_FULL) || defined(BUILD_SERVER)
+    // The frame payload moves to the live stream, soundData only ever holds the frame being received
+    std::shared_ptr<LiveTranscription> live = connection->live;
+    SoundData &soundData = *connection->soundData;
+    bool schedule;
+    {
+        std::lock_guard<std::mutex> guard(live->chunksMutex);
+        live->chunks.emplace_back(soundData.data, soundData.data + soundData.length);
+        live->receivedBytes += soundData.length;
+        schedule = !live->drainScheduled;
+        live->drainScheduled = true;
+    }
+    soundData.length = 0;
+    if (!schedule)
+    {
+        return;
     }
 
+    auto drain = [this, &reactor, connection, live]()
+    {
+        std::lock_guard<std::mutex> guard(live->streamMutex);
+        drainLiveTranscription(*live, [this, &reactor, connection, live](FrameType type, const std::string &payload)
+                               { pushEvent(reactor, connection, live->streamId, type, payload); });
+    };
+    auto skipped = [live]()
+    {
+        // Left for the next frame or the end of the stream
+        std::lock_guard<std::mutex> guard(live->chunksMutex);
+        live->drainScheduled = false;
+    };
+    auto failed = [skipped](const std::string &)
+    {
+        skipped();
+    };
+    if (workerPool->submit(drain, skipped, connection->soundData->priority, WorkerPool::Clock::time_point::max(), failed) == WorkerPool::Admission::Rejected)
+    {
+        skipped();
+    }
 #else
-    // Default sound processing (e.g., inverting the data)
-    for (size_t i = 0; i < inputData->length; ++i)
+    (void)reactor;
+    (void)connection;
+#endif
+}
+
+void NetworkManager::finishLiveTranscription(Connection &connection, const EventCallback &emit)
+{
+#if defined(BUILD_FULL) || defined(BUILD_SERVER)
+    std::shared_ptr<LiveTranscription> live = std::move(connection.live);
+    if (emit && transcriber.state() == WhisperTranscriber::State::Loading)
     {
-        outputData[i] = ~inputData->data[i]; // Example processing: inverting the data
+        emit(FrameType::TaskStatus, "loading-model");
     }
+    std::string transcription;
+    {
+        std::lock_guard<std::mutex> guard(live->streamMutex);
+        drainLiveTranscription(*live, emit);
+        transcription = live->stream->finish();
+    }
+    reportTranscript(connection.soundData.get(), transcription, emit);
+#else
+    (void)connection;
+    (void)emit;
 #endif
 }
 
 NetworkManager::~NetworkManager()
 {
-    closeSocket(serverSd);
-    closeSocket(udpSd);
-    for (auto &th : clientThreads)
+    // Wake the client receive thread, it may be blocked in recv or backing off
+    clientStopping = true;
+    if (clientReceiver.joinable())
+    {
+        if (serverSd >= 0)
+        {
+            shutdown(serverSd, SHUT_RDWR);
+        }
+        clientReceiver.join();
+    }
+
+#if defined(BUILD_FULL) || defined(BUILD_SERVER)
+    // Workers waiting for the model only return once the load has finished
+    if (modelLoader.joinable())
+    {
+        modelLoader.join();
+    }
+#endif
+
+    running = false;
+    if (udpIngest)
+    {
+        udpIngest->stop();
+    }
+    for (auto &reactor : reactors)
+    {
+        wakeReactor(*reactor);
+    }
+    for (auto &reactor : reactors)
+    {
+        if (reactor->thread.joinable())
+        {
+            reactor->thread.join();
+        }
+    }
+    if (workerPool)
+    {
+        workerPool->stop();
+    }
+    for (auto &reactor : reactors)
     {
-        if (th.joinable())
+        for (auto &entry : reactor->connections)
+        {
+            closeSocket(entry.first);
+        }
+        if (reactor->listenSd != serverSd)
         {
-            th.join();
+            closeSocket(reactor->listenSd);
         }
+        closeSocket(reactor->epollFd);
+        closeSocket(reactor->wakeFd);
     }
+
+    closeSocket(serverSd);
+    closeSocket(udpSd);
 }
 
 void NetworkManager::setupServerSocket()
@@ -116,6 +507,12 @@ void NetworkManager::setupServerSocket()
         perror("setsockopt failed");
         exit(1);
     }
+    // Has to be set on every socket of the group before bind, the reactors add theirs later
+    if (serverParams.reuseport_listeners && setsockopt(serverSd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        perror("setsockopt SO_REUSEPORT failed");
+        exit(1);
+    }
 
     servAddr.sin_family = AF_INET;
     servAddr.sin_addr.s_addr = htonl(INADDR_ANY);
@@ -133,6 +530,21 @@ void NetworkManager::setupUDPSocket()
         exit(1);
     }
 
+    if (serverIp != nullptr)
+    {
+        // Client side, datagrams go to the server and replies come back on the ephemeral port
+        clientAddrUDP.sin_family = AF_INET;
+        clientAddrUDP.sin_addr.s_addr = inet_addr(serverIp);
+        clientAddrUDP.sin_port = htons(port);
+        clientAddrUDPSize = sizeof(clientAddrUDP);
+        std::cout << "UDP Socket created" << std::endl;
+        return;
+    }
+
+    // Larger receive buffer so bursts survive while the batch is processed
+    int receiveBuffer = 4 * 1024 * 1024;
+    setsockopt(udpSd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+
     servAddr.sin_family = AF_INET;
     servAddr.sin_addr.s_addr = htonl(INADDR_ANY);
     servAddr.sin_port = htons(port);
@@ -150,23 +562,53 @@ void NetworkManager::runServer()
     if (protocol == TCP)
     {
         std::cout << "TCP connection setup." << std::endl;
-        while (true)
+        setupReactors();
+        for (auto &reactor : reactors)
         {
-            acceptClient();
+            if (reactor->thread.joinable())
+            {
+                reactor->thread.join();
+            }
         }
     }
     else if (protocol == UDP)
     {
         std::cout << "UDP connection setup." << std::endl;
-        while (true)
-        {
-            uint8_t buffer[1024];
-            int bytesReceived = recvFromUDP(buffer, sizeof(buffer));
-            if (bytesReceived > 0)
+        setupWorkerPool();
+
+        // Reassembled utterances go straight to the workers, the result is sent back to the sender
+        udpIngest = std::make_unique<UdpIngest>(udpSd, serverParams.udp, [this](std::unique_ptr<SoundData> soundData, const sockaddr_in &source)
+                                                {
+            std::shared_ptr<SoundData> utterance(std::move(soundData));
+            auto shed = [this, utterance, source]()
             {
-                std::cout << "Received UDP data: " << std::string((char *)buffer, bytesReceived) << std::endl;
-            }
-        }
+                std::string message = "overloaded; retry-after=" + std::to_string(workerPool->retryAfterSeconds());
+                sendFrameUDP(FrameType::Error, FrameHeader::kFlagOverloaded, utterance->streamId, reinterpret_cast<const uint8_t *>(message.data()), message.size(), source);
+            };
+            auto deadline = WorkerPool::Clock::now() + std::chrono::milliseconds(serverParams.max_queue_wait_ms);
+            auto admission = workerPool->submit([this, utterance, source]()
+                                                {
+                processSoundData(utterance.get(), [this, utterance, source](FrameType type, const std::string &payload)
+                                 {
+                    if (payload.size() + FrameHeader::kSize <= serverParams.udp.max_datagram)
+                    {
+                        sendFrameUDP(type, 0, utterance->streamId, reinterpret_cast<const uint8_t *>(payload.data()), payload.size(), source);
+                    } });
+
+                // Results that do not fit one datagram are acknowledged without payload
+                size_t payloadLength = utterance->length + FrameHeader::kSize <= serverParams.udp.max_datagram ? utterance->length : 0;
+                sendFrameUDP(FrameType::Result, 0, utterance->streamId, utterance->data, payloadLength, source); },
+                                                shed, utterance->priority, deadline,
+                                                [this, utterance, source](const std::string &error)
+                                                {
+                std::string message = "Processing failed: " + error;
+                sendFrameUDP(FrameType::Error, 0, utterance->streamId, reinterpret_cast<const uint8_t *>(message.data()), message.size(), source); });
+            if (admission == WorkerPool::Admission::Rejected)
+            {
+                shed();
+            } });
+        running = true;
+        udpIngest->run();
     }
 }
 
@@ -175,6 +617,98 @@ void NetworkManager::sendToUDP(const uint8_t *data, size_t length)
     sendto(udpSd, data, length, 0, (struct sockaddr *)&clientAddrUDP, clientAddrUDPSize);
 }
 
+bool NetworkManager::sendFramesUDP(const uint8_t *data, size_t length)
+{
+    // Keep every datagram below a typical MTU and aligned to whole sample frames. Each datagram
+    // is encoded on its own so the server can decode, reorder and conceal per packet.
+    const size_t maxDatagramPayload = 1200;
+    uint8_t channels = std::max<uint8_t>(1, clientFormat.channels);
+    size_t frameBytes = std::max<size_t>(1, clientFormat.bytesPerSample() * channels);
+    AudioFormat wireFormat = uplinkFormat();
+    size_t packetFrames = 1;
+    size_t upper = maxDatagramPayload * 2;
+    while (packetFrames < upper)
+    {
+        size_t candidate = (packetFrames + upper + 1) / 2;
+        if (maxEncodedAudioSize(wireFormat.codec, candidate, channels) <= maxDatagramPayload)
+        {
+            packetFrames = candidate;
+        }
+        else
+        {
+            upper = candidate - 1;
+        }
+    }
+    size_t inputFrames = packetFrames * clientDownsample;
+    if (clientResampler)
+    {
+        // The resampler may emit one frame more than the ratio suggests
+        inputFrames = std::max<size_t>(1, (packetFrames - 1) * clientResampler->inputRate() / clientResampler->outputRate());
+    }
+    else if (wireFormat.codec == CodecType::PCM && clientDownsample <= 1)
+    {
+        inputFrames = std::max<size_t>(1, maxDatagramPayload / frameBytes);
+    }
+    size_t maxPayload = inputFrames * frameBytes;
+
+    startUplinkStream();
+    size_t offset = 0;
+    do
+    {
+        size_t chunkLength = std::min(maxPayload, length - offset);
+        size_t payloadLength = chunkLength;
+        const uint8_t *payload = encodeUplink(data + offset, payloadLength);
+
+        FrameHeader frame;
+        frame.type = offset + chunkLength >= length ? FrameType::EndOfStream : FrameType::Audio;
+        frame.streamId = clientStreamId;
+        frame.sequence = clientSequence++;
+        frame.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        frame.format = wireFormat;
+        frame.payloadLength = static_cast<uint32_t>(payloadLength);
+
+        uint8_t header[FrameHeader::kSize];
+        encodeFrameHeader(frame, header);
+        iovec parts[2] = {{header, sizeof(header)}, {const_cast<uint8_t *>(payload), payloadLength}};
+        msghdr message{};
+        message.msg_name = &clientAddrUDP;
+        message.msg_namelen = clientAddrUDPSize;
+        message.msg_iov = parts;
+        message.msg_iovlen = 2;
+        if (sendmsg(udpSd, &message, 0) < 0)
+        {
+            perror("Failed to send UDP frame");
+            return false;
+        }
+        offset += chunkLength;
+    } while (offset < length);
+
+    return true;
+}
+
+void NetworkManager::sendFrameUDP(FrameType type, uint16_t flags, uint32_t streamId, const uint8_t *data, size_t length, const sockaddr_in &destination)
+{
+    FrameHeader frame;
+    frame.type = type;
+    frame.flags = flags;
+    frame.streamId = streamId;
+    frame.queueDepth = reportedQueueDepth();
+    frame.payloadLength = static_cast<uint32_t>(length);
+
+    uint8_t header[FrameHeader::kSize];
+    encodeFrameHeader(frame, header);
+    iovec parts[2] = {{header, sizeof(header)}, {const_cast<uint8_t *>(data), length}};
+    msghdr message{};
+    message.msg_name = const_cast<sockaddr_in *>(&destination);
+    message.msg_namelen = sizeof(destination);
+    message.msg_iov = parts;
+    message.msg_iovlen = length > 0 ? 2 : 1;
+    if (sendmsg(udpSd, &message, 0) < 0)
+    {
+        perror("Failed to send UDP frame to client");
+    }
+}
+
 int NetworkManager::recvFromUDP(uint8_t *buffer, size_t length)
 {
     return recvfrom(udpSd, buffer, length, 0, (struct sockaddr *)&clientAddrUDP, &clientAddrUDPSize);
@@ -201,6 +735,15 @@ void NetworkManager::setupClientSocket()
         perror("Error establishing the client socket");
         exit(0);
     }
+
+    // Bounds connect(), an unreachable server would otherwise block for minutes
+    timeval timeout{};
+    timeout.tv_sec = serverParams.connect_timeout_ms / 1000;
+    timeout.tv_usec = (serverParams.connect_timeout_ms % 1000) * 1000;
+    if (setsockopt(serverSd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0)
+    {
+        perror("Failed to set the client connect timeout");
+    }
     servAddr.sin_family = AF_INET;
     servAddr.sin_port = htons(port);
 }
@@ -212,198 +755,1595 @@ void NetworkManager::connectToServer()
     servAddr.sin_port = htons(port);
     std::cout << "Client trying to connect to server at IP: " << serverIp << " on port: " << port << std::endl;
 
-    int connectionStatus = -1;
-    while (connectionStatus < 0)
+    // Exponential backoff with jitter so satellites do not reconnect in lockstep after a server restart
+    std::mt19937 jitter(std::random_device{}());
+    int backoffMs = std::max(1, serverParams.reconnect_initial_ms);
+    while (!clientStopping)
     {
-        connectionStatus = connect(serverSd, (struct sockaddr *)&servAddr, sizeof(servAddr));
-        if (connectionStatus < 0)
+        if (connect(serverSd, (struct sockaddr *)&servAddr, sizeof(servAddr)) == 0)
+        {
+            std::cout << "Successfully connected to the server!" << std::endl;
+
+            // Pipelined uploads may legitimately wait while the server is busy, only connect() is bounded
+            timeval noTimeout{};
+            setsockopt(serverSd, SOL_SOCKET, SO_SNDTIMEO, &noTimeout, sizeof(noTimeout));
+            clientConnected = true;
+            return;
+        }
+
+        int delayMs = std::uniform_int_distribution<int>(backoffMs / 2, backoffMs)(jitter);
+        std::cerr << "Error connecting to server. Error: " << strerror(errno) << std::endl;
+        std::cerr << "Retrying connection in " << delayMs << " ms..." << std::endl;
+        auto wakeAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(delayMs);
+        while (!clientStopping && std::chrono::steady_clock::now() < wakeAt)
         {
-            std::cerr << "Error connecting to server. Error: " << strerror(errno) << std::endl;
-            std::cerr << "Retrying connection in 5 seconds..." << std::endl;
-            sleep(5);
+            std::this_thread::sleep_for(std::chrono::milliseconds(std::min(delayMs, 100)));
         }
+        backoffMs = std::min(backoffMs * 2, std::max(backoffMs, serverParams.reconnect_max_ms));
+
+        // A socket is unusable after a failed connect, start over with a fresh one
+        closeSocket(serverSd);
+        setupClientSocket();
     }
-    std::cout << "Successfully connected to the server!" << std::endl;
 }
 
-void NetworkManager::sendSoundData(const uint8_t *data, size_t length)
+bool NetworkManager::reconnectToServer()
 {
-    if (protocol == TCP)
-    {
-        std::ostringstream request;
-        request << "POST /sound HTTP/1.1\r\n";
-        request << "Content-Length: " << length << "\r\n";
-        request << "Content-Type: application/octet-stream\r\n\r\n";
-
-        send(serverSd, request.str().c_str(), request.str().length(), 0);
-        send(serverSd, data, length, 0);
-    }
-    else if (protocol == UDP)
+    if (!resetClientSocket())
     {
-        sendToUDP(data, length);
+        return false;
     }
+    connectToServer();
+    return serverSd >= 0 && !clientStopping;
 }
 
-void NetworkManager::receiveResponse()
+bool NetworkManager::resetClientSocket()
 {
-    if (protocol == TCP)
-    {
-        char buffer[1024];
-        memset(buffer, 0, 1024);
-        int bytesReceived = recv(serverSd, buffer, 1024, 0);
-        if (bytesReceived < 0)
-        {
-            perror("Failed to read data from server");
-            return;
-        }
-
-        std::cout << "Received response from server: " << std::string(buffer, bytesReceived) << std::endl;
-    }
-    else if (protocol == UDP)
+    if (serverIp == nullptr)
     {
-        uint8_t buffer[1024];
-        int bytesReceived = recvFromUDP(buffer, sizeof(buffer));
-        if (bytesReceived > 0)
-        {
-            std::cout << "Received UDP response: " << std::string((char *)buffer, bytesReceived) << std::endl;
-        }
+        return false;
     }
+
+    // shutdown wakes a receive thread blocked on the old socket before the descriptor is reused
+    clientConnected = false;
+    shutdown(serverSd, SHUT_RDWR);
+    closeSocket(serverSd);
+    clientPending.clear();
+    ++connectionGeneration;
+    setupClientSocket();
+    return true;
 }
 
-void NetworkManager::bindSocket()
+void NetworkManager::connectClientInBackground()
 {
-    if (serverSd < 0)
+    std::lock_guard<std::mutex> sendGuard(clientSendMutex);
+    if (!clientReceiver.joinable())
     {
-        std::cerr << "Invalid server socket descriptor" << std::endl;
-        return;
+        clientReceiver = std::thread(&NetworkManager::receiveLoop, this);
     }
+}
 
-    int bindStatus = bind(serverSd, (struct sockaddr *)&servAddr, sizeof(servAddr));
-    if (bindStatus < 0)
-    {
-        perror("Error binding socket to local address");
-        exit(1);
-    }
-    std::cout << "Server socket bound to address" << std::endl;
+bool NetworkManager::isConnected() const
+{
+    return clientConnected;
 }
 
-void NetworkManager::listenForClients()
+int NetworkManager::serverQueueDepth() const
 {
-    if (serverSd < 0)
+    return clientServerQueueDepth;
+}
+
+std::future<std::string> NetworkManager::sendSoundDataAsync(const uint8_t *data, size_t length, ResponseCallback onResponse, EventCallback onEvent)
+{
+    std::unique_lock<std::mutex> sendLock(clientSendMutex);
+    if (!clientReceiver.joinable())
     {
-        std::cerr << "Invalid server socket descriptor" << std::endl;
-        return;
+        clientReceiver = std::thread(&NetworkManager::receiveLoop, this);
     }
 
-    std::cout << "Server running on port " << port << std::endl;
-    if (listen(serverSd, 5) < 0)
+    // Registered before the upload so a fast response always finds its request
+    startUplinkStream();
+    uint32_t streamId = clientStreamId;
+    std::future<std::string> result;
     {
-        perror("Error listening on socket");
-        exit(1);
+        std::lock_guard<std::mutex> guard(inFlightMutex);
+        InFlight &request = inFlight[streamId];
+        request.callback = std::move(onResponse);
+        request.onEvent = std::move(onEvent);
+        request.generation = connectionGeneration;
+        result = request.promise.get_future();
     }
-    std::cout << "Server is now listening for clients..." << std::endl;
-}
 
-void NetworkManager::acceptClient()
-{
-    if (serverSd < 0)
+    if (!clientConnected || !sendFrame(FrameType::EndOfStream, data, length))
+    {
+        // Fail fast and let the receive thread re-establish the connection in the background
+        if (clientConnected.exchange(false))
+        {
+            shutdown(serverSd, SHUT_RDWR);
+        }
+        sendLock.unlock();
+        completeInFlight(streamId, false, "Not connected to server");
+        return result;
+    }
+
+    // sendFrame may have reconnected, the request belongs to the connection it was written to
+    std::lock_guard<std::mutex> guard(inFlightMutex);
+    auto it = inFlight.find(streamId);
+    if (it != inFlight.end())
+    {
+        it->second.generation = connectionGeneration;
+    }
+    return result;
+}
+
+size_t NetworkManager::inFlightCount() const
+{
+    std::lock_guard<std::mutex> guard(inFlightMutex);
+    return inFlight.size();
+}
+
+void NetworkManager::receiveLoop()
+{
+    std::vector<char> buffer(64 * 1024);
+    std::string pending;
+
+    while (!clientStopping)
+    {
+        int sd = -1;
+        uint64_t generation = 0;
+        bool reconnect = false;
+        {
+            std::lock_guard<std::mutex> guard(clientSendMutex);
+            if (!clientConnected)
+            {
+                // Started before connectClient(), or a previous reconnect was interrupted
+                reconnect = resetClientSocket();
+            }
+            else
+            {
+                sd = serverSd;
+                generation = connectionGeneration;
+            }
+        }
+        if (reconnect || sd < 0)
+        {
+            // The backoff runs without clientSendMutex, uploads see clientConnected false and fail fast.
+            // Only this thread touches serverSd until connectToServer() sets clientConnected again.
+            if (reconnect)
+            {
+                connectToServer();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+
+        int bytesReceived = ::recv(sd, buffer.data(), buffer.size(), 0);
+        if (bytesReceived < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        bool malformed = false;
+        if (bytesReceived > 0)
+        {
+            // Responses of any size are reassembled, every complete frame is handed out
+            pending.append(buffer.data(), bytesReceived);
+            size_t offset = 0;
+            while (true)
+            {
+                FrameHeader frame;
+                FrameStatus status = decodeFrameHeader(reinterpret_cast<const uint8_t *>(pending.data()) + offset, pending.size() - offset, frame);
+                if (status == FrameStatus::NeedMore)
+                {
+                    break;
+                }
+                if (status != FrameStatus::Ok)
+                {
+                    malformed = true;
+                    break;
+                }
+                size_t frameLength = FrameHeader::kSize + frame.payloadLength;
+                if (pending.size() - offset < frameLength)
+                {
+                    break;
+                }
+
+                std::string payload = pending.substr(offset + FrameHeader::kSize, frame.payloadLength);
+                offset += frameLength;
+                clientServerQueueDepth = frame.queueDepth;
+                if (isEventFrame(frame.type))
+                {
+                    deliverEvent(frame.streamId, frame.type, payload);
+                    continue;
+                }
+                if (frame.type == FrameType::Error)
+                {
+                    std::cerr << "Server rejected stream " << frame.streamId << ": " << payload << std::endl;
+                }
+                completeInFlight(frame.streamId, frame.type != FrameType::Error, payload);
+            }
+            pending.erase(0, offset);
+            if (!malformed)
+            {
+                continue;
+            }
+            std::cerr << "Malformed response frame from server" << std::endl;
+        }
+        else if (bytesReceived == 0 && !clientStopping)
+        {
+            std::cerr << "Server closed the connection" << std::endl;
+        }
+        else if (!clientStopping)
+        {
+            perror("Connection to server lost");
+        }
+
+        // The connection is gone or out of sync, nothing sent on it will be answered.
+        // Callbacks run without clientSendMutex held so they may queue the next upload.
+        pending.clear();
+        clientConnected = false;
+        std::string reason = clientStopping ? "Client shutting down" : "Connection to server lost";
+        failInFlight(generation, reason);
+        reconnect = false;
+        {
+            std::lock_guard<std::mutex> guard(clientSendMutex);
+            if (!clientStopping && generation == connectionGeneration)
+            {
+                reconnect = resetClientSocket();
+            }
+        }
+        if (reconnect)
+        {
+            connectToServer();
+        }
+        // Uploads that raced with the failure went out on the dead connection as well
+        failInFlight(generation, reason);
+    }
+
+    failInFlight(UINT64_MAX, "Client shutting down");
+}
+
+void NetworkManager::completeInFlight(uint32_t streamId, bool ok, const std::string &payload)
+{
+    InFlight request;
+    {
+        std::lock_guard<std::mutex> guard(inFlightMutex);
+        auto it = inFlight.find(streamId);
+        if (it == inFlight.end())
+        {
+            return;
+        }
+        request = std::move(it->second);
+        inFlight.erase(it);
+    }
+
+    if (ok)
+    {
+        request.promise.set_value(payload);
+    }
+    else
+    {
+        request.promise.set_exception(std::make_exception_ptr(std::runtime_error(payload)));
+    }
+    if (request.callback)
+    {
+        request.callback(ok, payload);
+    }
+}
+
+void NetworkManager::deliverEvent(uint32_t streamId, FrameType type, const std::string &payload)
+{
+    EventCallback onEvent;
+    {
+        std::lock_guard<std::mutex> guard(inFlightMutex);
+        auto it = inFlight.find(streamId);
+        if (it == inFlight.end() || !it->second.onEvent)
+        {
+            return;
+        }
+        onEvent = it->second.onEvent;
+    }
+    onEvent(type, payload);
+}
+
+void NetworkManager::failInFlight(uint64_t generation, const std::string &reason)
+{
+    // Collected under clientSendMutex so a request still being written is never mistaken for a lost one
+    std::vector<uint32_t> failed;
+    {
+        std::lock_guard<std::mutex> sendGuard(clientSendMutex);
+        std::lock_guard<std::mutex> guard(inFlightMutex);
+        for (const auto &entry : inFlight)
+        {
+            if (entry.second.generation <= generation)
+            {
+                failed.push_back(entry.first);
+            }
+        }
+    }
+    for (uint32_t streamId : failed)
+    {
+        completeInFlight(streamId, false, reason);
+    }
+}
+
+void NetworkManager::sendSoundData(const uint8_t *data, size_t length)
+{
+    if (protocol == TCP)
+    {
+        // The whole capture goes out as a single-frame stream
+        startUplinkStream();
+        if (!sendFrame(FrameType::EndOfStream, data, length))
+        {
+            std::cerr << "Failed to send sound data to server" << std::endl;
+        }
+    }
+    else if (protocol == UDP)
+    {
+        sendFramesUDP(data, length);
+    }
+}
+
+void NetworkManager::setAudioFormat(const AudioFormat &format, int downsampleFactor)
+{
+    clientFormat = format;
+    clientDownsample = std::max(1, downsampleFactor);
+
+    clientResampler.reset();
+
+    // The codecs, the downsampler and the resampler operate on 16-bit samples only
+    bool reshaped = clientFormat.codec != CodecType::PCM || clientDownsample > 1 || clientUplinkRate != 0;
+    if (reshaped && clientFormat.sampleFormat != SampleFormat::S16LE)
+    {
+        std::cerr << "Uplink compression requires S16LE samples, sending uncompressed" << std::endl;
+        clientFormat.codec = CodecType::PCM;
+        clientDownsample = 1;
+        return;
+    }
+
+    if (clientUplinkRate != 0 && clientUplinkRate != clientFormat.sampleRate && clientFormat.sampleRate != 0)
+    {
+        try
+        {
+            clientResampler = std::make_unique<Resampler>(clientFormat.sampleRate, clientUplinkRate, std::max<uint8_t>(1, clientFormat.channels));
+            clientDownsample = 1;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Uplink resampling disabled: " << e.what() << std::endl;
+        }
+    }
+}
+
+void NetworkManager::setUplinkSampleRate(uint32_t sampleRate)
+{
+    clientUplinkRate = sampleRate;
+    setAudioFormat(clientFormat, clientDownsample);
+}
+
+AudioFormat NetworkManager::uplinkFormat() const
+{
+    AudioFormat format = clientFormat;
+    format.sampleRate = clientResampler ? clientResampler->outputRate() : clientFormat.sampleRate / clientDownsample;
+    return format;
+}
+
+void NetworkManager::startUplinkStream()
+{
+    ++clientStreamId;
+    clientSequence = 0;
+    if (clientResampler)
+    {
+        clientResampler->reset();
+    }
+}
+
+const uint8_t *NetworkManager::encodeUplink(const uint8_t *data, size_t &length)
+{
+    if (clientFormat.codec == CodecType::PCM && clientDownsample <= 1 && !clientResampler)
+    {
+        return data;
+    }
+
+    // Scratch holds the rate-converted PCM followed by the encoded payload
+    uint8_t channels = std::max<uint8_t>(1, clientFormat.channels);
+    size_t frames = length / (2 * size_t(channels));
+    size_t outFrames;
+    if (clientResampler)
+    {
+        // Resampling runs in float and continues across the frames of one stream
+        clientResampleIn.resize(frames * channels);
+        clientResampleOut.resize(clientResampler->maxOutputFrames(frames) * channels);
+        convertSamplesToFloat(data, frames * channels, SampleFormat::S16LE, clientResampleIn.data());
+        outFrames = clientResampler->process(clientResampleIn.data(), frames, clientResampleOut.data());
+        clientEncoded.resize(outFrames * channels * 2 + maxEncodedAudioSize(clientFormat.codec, outFrames, channels));
+        convertFloatToS16(clientResampleOut.data(), outFrames * channels, clientEncoded.data());
+    }
+    else
+    {
+        outFrames = frames / clientDownsample;
+        clientEncoded.resize(outFrames * channels * 2 + maxEncodedAudioSize(clientFormat.codec, outFrames, channels));
+        downsampleAudio(data, frames, channels, clientDownsample, clientEncoded.data());
+    }
+    size_t pcmBytes = outFrames * channels * 2;
+
+    uint8_t *encoded = clientEncoded.data() + pcmBytes;
+    length = encodeAudio(clientFormat.codec, clientEncoded.data(), outFrames, channels, encoded);
+    return encoded;
+}
+
+bool NetworkManager::sendFrame(FrameType type, const uint8_t *data, size_t length)
+{
+    if (length > 0)
+    {
+        data = encodeUplink(data, length);
+    }
+
+    FrameHeader frame;
+    frame.type = type;
+    frame.streamId = clientStreamId;
+    frame.sequence = clientSequence;
+    frame.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    frame.format = uplinkFormat();
+    frame.payloadLength = static_cast<uint32_t>(length);
+
+    uint8_t header[FrameHeader::kSize];
+    encodeFrameHeader(frame, header);
+
+    // The server may have closed the idle persistent connection, a stream can only be restarted on its first frame
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        if (send(serverSd, header, sizeof(header), length > 0 ? MSG_MORE : 0) && (length == 0 || send(serverSd, data, length, 0)))
+        {
+            ++clientSequence;
+            return true;
+        }
+        // With a receive thread running, reconnecting is its job
+        if (clientSequence != 0 || clientReceiver.joinable() || !reconnectToServer())
+        {
+            break;
+        }
+    }
+    return false;
+}
+
+bool NetworkManager::beginSoundStream()
+{
+    startUplinkStream();
+    return serverSd >= 0;
+}
+
+bool NetworkManager::sendSoundFrame(const uint8_t *data, size_t length)
+{
+    return sendFrame(FrameType::Audio, data, length);
+}
+
+bool NetworkManager::endSoundStream()
+{
+    return sendFrame(FrameType::EndOfStream, nullptr, 0);
+}
+
+std::string NetworkManager::receiveResponse()
+{
+    if (protocol == TCP)
+    {
+        // Event frames pushed ahead of the response are of no interest to this blocking API
+        while (true)
+        {
+            char buffer[16384];
+            FrameHeader frame;
+            FrameStatus status;
+            while ((status = decodeFrameHeader(reinterpret_cast<const uint8_t *>(clientPending.data()), clientPending.size(), frame)) == FrameStatus::NeedMore)
+            {
+                int bytesReceived = recv(serverSd, buffer, sizeof(buffer), 0);
+                if (bytesReceived <= 0)
+                {
+                    perror("Failed to read data from server");
+                    clientPending.clear();
+                    return "";
+                }
+                clientPending.append(buffer, bytesReceived);
+            }
+
+            if (status != FrameStatus::Ok)
+            {
+                std::cerr << "Malformed response frame from server" << std::endl;
+                reconnectToServer();
+                return "";
+            }
+
+            // Read the complete payload so the next response on this connection starts cleanly
+            size_t frameLength = FrameHeader::kSize + frame.payloadLength;
+            while (clientPending.size() < frameLength)
+            {
+                int bytesReceived = recv(serverSd, buffer, sizeof(buffer), 0);
+                if (bytesReceived <= 0)
+                {
+                    perror("Failed to read response payload from server");
+                    clientPending.clear();
+                    return "";
+                }
+                clientPending.append(buffer, bytesReceived);
+            }
+
+            std::string payload = clientPending.substr(FrameHeader::kSize, frame.payloadLength);
+            clientPending.erase(0, frameLength);
+            clientServerQueueDepth = frame.queueDepth;
+            if (isEventFrame(frame.type))
+            {
+                continue;
+            }
+
+            if (frame.type == FrameType::Error)
+            {
+                std::cerr << "Server rejected stream " << frame.streamId << ": " << payload << std::endl;
+                if (!(frame.flags & FrameHeader::kFlagOverloaded))
+                {
+                    // Protocol errors close the connection on the server side
+                    reconnectToServer();
+                }
+                return "";
+            }
+
+            std::cout << "Received response from server for stream " << frame.streamId << " (" << payload.size() << " bytes)" << std::endl;
+            return payload;
+        }
+    }
+    else if (protocol == UDP)
+    {
+        uint8_t buffer[2048];
+        int bytesReceived = recvFromUDP(buffer, sizeof(buffer));
+        FrameHeader frame;
+        while (bytesReceived > 0 && decodeFrameHeader(buffer, bytesReceived, frame) == FrameStatus::Ok && isEventFrame(frame.type))
+        {
+            bytesReceived = recvFromUDP(buffer, sizeof(buffer));
+        }
+        if (bytesReceived > 0 && decodeFrameHeader(buffer, bytesReceived, frame) == FrameStatus::Ok &&
+            FrameHeader::kSize + frame.payloadLength <= static_cast<size_t>(bytesReceived))
+        {
+            std::cout << "Received UDP response for stream " << frame.streamId << " (" << frame.payloadLength << " bytes)" << std::endl;
+            return std::string(reinterpret_cast<char *>(buffer) + FrameHeader::kSize, frame.payloadLength);
+        }
+    }
+    return "";
+}
+
+void NetworkManager::bindSocket()
+{
+    if (serverSd < 0)
+    {
+        std::cerr << "Invalid server socket descriptor" << std::endl;
+        return;
+    }
+
+    int bindStatus = bind(serverSd, (struct sockaddr *)&servAddr, sizeof(servAddr));
+    if (bindStatus < 0)
+    {
+        perror("Error binding socket to local address");
+        exit(1);
+    }
+    std::cout << "Server socket bound to address" << std::endl;
+}
+
+void NetworkManager::listenForClients()
+{
+    if (serverSd < 0)
+    {
+        std::cerr << "Invalid server socket descriptor" << std::endl;
+        return;
+    }
+
+    std::cout << "Server running on port " << port << std::endl;
+    if (listen(serverSd, serverParams.listen_backlog) < 0)
+    {
+        perror("Error listening on socket");
+        exit(1);
+    }
+    std::cout << "Server is now listening for clients..." << std::endl;
+}
+
+void NetworkManager::setupReactors()
+{
+    if (serverSd < 0)
     {
         std::cerr << "Invalid server socket descriptor" << std::endl;
         return;
     }
 
-    sockaddr_in newSockAddr;
-    socklen_t newSockAddrSize = sizeof(newSockAddr);
-    std::cout << "Waiting for client connection..." << std::endl;
-    int newSd = accept(serverSd, (sockaddr *)&newSockAddr, &newSockAddrSize);
-    if (newSd < 0)
+    if (fcntl(serverSd, F_SETFL, fcntl(serverSd, F_GETFL, 0) | O_NONBLOCK) < 0)
+    {
+        perror("Failed to make server socket non-blocking");
+        exit(1);
+    }
+
+    setupWorkerPool();
+
+    size_t reactorCount = serverParams.io_threads > 0 ? serverParams.io_threads : 1;
+    for (size_t i = 0; i < reactorCount; ++i)
+    {
+        auto reactor = std::make_unique<Reactor>();
+        reactor->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        reactor->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (reactor->epollFd < 0 || reactor->wakeFd < 0)
+        {
+            perror("Failed to create reactor");
+            exit(1);
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = reactor->wakeFd;
+        epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, reactor->wakeFd, &event);
+        reactors.push_back(std::move(reactor));
+    }
+
+    // By default the first reactor owns the listening socket and hands accepted connections out
+    // round-robin. With reuseport listeners every reactor accepts on its own socket of the group
+    // and keeps the connection, so reconnect bursts are spread by the kernel instead of queueing
+    // behind a single accept loop.
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < reactors.size(); ++i)
+    {
+        int cpu = serverParams.pin_reactors ? static_cast<int>(i % cores) : -1;
+        if (i == 0)
+        {
+            reactors[i]->listenSd = serverSd;
+#ifdef SO_INCOMING_CPU
+            // Unset, the kernel would pick this listener for every core the others do not match
+            if (serverParams.reuseport_listeners && cpu >= 0)
+            {
+                setsockopt(serverSd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+            }
+#endif
+        }
+        else if (serverParams.reuseport_listeners)
+        {
+            reactors[i]->listenSd = openReusePortListener(cpu);
+        }
+        else
+        {
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = reactors[i]->listenSd;
+        epoll_ctl(reactors[i]->epollFd, EPOLL_CTL_ADD, reactors[i]->listenSd, &event);
+    }
+
+    running = true;
+    for (size_t i = 0; i < reactors.size(); ++i)
+    {
+        int cpu = serverParams.pin_reactors ? static_cast<int>(i % cores) : -1;
+        reactors[i]->thread = std::thread(&NetworkManager::runReactor, this, std::ref(*reactors[i]), cpu);
+    }
+    std::cout << "Started " << reactors.size() << " reactor thread(s) and " << workerPool->size() << " worker thread(s)"
+              << (serverParams.reuseport_listeners ? " with one listener per reactor" : "") << std::endl;
+}
+
+int NetworkManager::openReusePortListener(int cpu)
+{
+    int sd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sd < 0)
+    {
+        perror("Error establishing reuseport listener");
+        exit(1);
+    }
+
+    int opt = 1;
+    if (setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        perror("setsockopt failed on reuseport listener");
+        exit(1);
+    }
+#ifdef SO_INCOMING_CPU
+    // Prefer this listener for connections whose packets are received on the reactor's core
+    if (cpu >= 0)
+    {
+        setsockopt(sd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+    }
+#endif
+
+    if (bind(sd, (struct sockaddr *)&servAddr, sizeof(servAddr)) < 0)
+    {
+        perror("Error binding reuseport listener");
+        exit(1);
+    }
+    if (listen(sd, serverParams.listen_backlog) < 0)
+    {
+        perror("Error listening on reuseport listener");
+        exit(1);
+    }
+    return sd;
+}
+
+void NetworkManager::setupWorkerPool()
+{
+    size_t workerCount = serverParams.worker_threads > 0 ? serverParams.worker_threads : std::thread::hardware_concurrency();
+    workerPool = std::make_unique<WorkerPool>(workerCount, serverParams.max_queue_depth);
+    if (metricsRegistry)
+    {
+        workerPool->attachMetrics(*metricsRegistry, "transcription");
+    }
+}
+
+void NetworkManager::runReactor(Reactor &reactor, int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (error != 0)
+        {
+            std::cerr << "Failed to pin reactor to core " << cpu << ": " << strerror(error) << std::endl;
+        }
+    }
+
+    const int maxEvents = 64;
+    epoll_event events[maxEvents];
+
+    while (running)
+    {
+        int eventCount = epoll_wait(reactor.epollFd, events, maxEvents, -1);
+        if (eventCount < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+
+        for (int i = 0; i < eventCount; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == reactor.wakeFd)
+            {
+                uint64_t counter;
+                while (read(reactor.wakeFd, &counter, sizeof(counter)) > 0)
+                {
+                }
+                drainCompleted(reactor);
+                continue;
+            }
+
+            if (fd == reactor.listenSd)
+            {
+                acceptClient(reactor);
+                continue;
+            }
+
+            auto it = reactor.connections.find(fd);
+            if (it == reactor.connections.end())
+            {
+                continue;
+            }
+            std::shared_ptr<Connection> connection = it->second;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                closeConnection(reactor, connection);
+                continue;
+            }
+            // EPOLLRDHUP is only asked for while reading, where the recv() it triggers returns 0
+            // and closes the connection once the pending requests are parsed
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP))
+            {
+                handleReadable(reactor, connection);
+            }
+            if (!connection->closed && (events[i].events & EPOLLOUT))
+            {
+                flushConnection(reactor, connection);
+            }
+        }
+    }
+}
+
+void NetworkManager::acceptClient(Reactor &acceptor)
+{
+    while (true)
+    {
+        sockaddr_in newSockAddr;
+        socklen_t newSockAddrSize = sizeof(newSockAddr);
+        int newSd = accept4(acceptor.listenSd, (sockaddr *)&newSockAddr, &newSockAddrSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (newSd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                perror("Error accepting client connection");
+            }
+            return;
+        }
+        std::cout << "Connected with client! New socket descriptor: " << newSd << std::endl;
+
+        Reactor &reactor = serverParams.reuseport_listeners ? acceptor : *reactors[nextReactor++ % reactors.size()];
+        registerConnection(reactor, newSd, &reactor == &acceptor);
+    }
+}
+
+void NetworkManager::registerConnection(Reactor &reactor, int clientSd, bool local)
+{
+    auto connection = std::make_shared<Connection>(clientSd);
+
+    // Connections are only touched by their own reactor thread, hand them over through the completed queue
+    if (!local)
+    {
+        std::lock_guard<std::mutex> guard(reactor.completedMutex);
+        reactor.completed.push_back(connection);
+        wakeReactor(reactor);
+        return;
+    }
+
+    reactor.connections[clientSd] = connection;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = clientSd;
+    if (epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, clientSd, &event) < 0)
+    {
+        perror("Failed to register client socket");
+        reactor.connections.erase(clientSd);
+        closeSocket(clientSd);
+    }
+}
+
+void NetworkManager::handleReadable(Reactor &reactor, const std::shared_ptr<Connection> &connection)
+{
+    char buffer[1024];
+
+    while (!connection->closed && connection->state != Connection::Processing && connection->state != Connection::Writing)
+    {
+        // Body bytes go straight into their final destination, framing bytes into the pending buffer
+        char *destination = buffer;
+        size_t capacity = sizeof(buffer);
+        if (connection->state == Connection::ReadingBody)
+        {
+            destination = reinterpret_cast<char *>(connection->soundData->data) + connection->bodyOffset;
+            capacity = connection->soundData->length - connection->bodyOffset;
+        }
+        else if (connection->state == Connection::ReadingChunkData || connection->state == Connection::ReadingFramePayload)
+        {
+            destination = reinterpret_cast<char *>(connection->soundData->data) + connection->soundData->length;
+            capacity = connection->chunkRemaining;
+        }
+
+        int bytesReceived = recv(connection->sd, destination, capacity, 0);
+        if (bytesReceived == 0)
+        {
+            closeConnection(reactor, connection);
+            return;
+        }
+        if (bytesReceived < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Failed to read data from client");
+            closeConnection(reactor, connection);
+            return;
+        }
+
+        if (connection->state == Connection::ReadingBody)
+        {
+            connection->bodyOffset += bytesReceived;
+        }
+        else if (connection->state == Connection::ReadingChunkData || connection->state == Connection::ReadingFramePayload)
+        {
+            connection->soundData->length += bytesReceived;
+            connection->chunkRemaining -= bytesReceived;
+        }
+        else
+        {
+            connection->pending.append(buffer, bytesReceived);
+        }
+
+        if (advanceConnection(reactor, connection))
+        {
+            return;
+        }
+    }
+}
+
+bool NetworkManager::advanceConnection(Reactor &reactor, const std::shared_ptr<Connection> &connection)
+{
+    Connection &conn = *connection;
+
+    while (true)
+    {
+        switch (conn.state)
+        {
+        case Connection::ReadingHeader:
+            if (!parseHeader(conn))
+            {
+                break;
+            }
+            continue;
+
+        case Connection::ReadingBody:
+        {
+            size_t available = std::min(conn.pending.size(), conn.soundData->length - conn.bodyOffset);
+            if (available > 0)
+            {
+                std::memcpy(conn.soundData->data + conn.bodyOffset, conn.pending.data(), available);
+                conn.pending.erase(0, available);
+                conn.bodyOffset += available;
+            }
+            if (conn.bodyOffset == conn.soundData->length)
+            {
+                dispatchSoundData(reactor, connection);
+                return true;
+            }
+            return false;
+        }
+
+        case Connection::ReadingChunkSize:
+        case Connection::ReadingTrailer:
+            if (!parseChunkLine(conn))
+            {
+                break;
+            }
+            if (conn.state == Connection::Processing)
+            {
+                // Terminating chunk seen, the utterance is complete
+                dispatchSoundData(reactor, connection);
+                return true;
+            }
+            continue;
+
+        case Connection::ReadingFrameHeader:
+            if (!parseFrameHeader(conn))
+            {
+                break;
+            }
+            continue;
+
+        case Connection::ReadingChunkData:
+        case Connection::ReadingFramePayload:
+        {
+            size_t available = std::min(conn.pending.size(), conn.chunkRemaining);
+            if (available > 0)
+            {
+                std::memcpy(conn.soundData->data + conn.soundData->length, conn.pending.data(), available);
+                conn.pending.erase(0, available);
+                conn.soundData->length += available;
+                conn.chunkRemaining -= available;
+            }
+            if (conn.chunkRemaining > 0)
+            {
+                return false;
+            }
+            if (conn.state == Connection::ReadingChunkData)
+            {
+                conn.state = Connection::ReadingChunkSize;
+                continue;
+            }
+            if (conn.live)
+            {
+                feedLiveTranscription(reactor, connection);
+            }
+            if (conn.frameEndsStream)
+            {
+                conn.state = Connection::Processing;
+                dispatchSoundData(reactor, connection);
+                return true;
+            }
+            conn.state = Connection::ReadingFrameHeader;
+            continue;
+        }
+
+        default:
+            return true;
+        }
+
+        // The state machine needs more bytes, or the request was rejected
+        if (conn.closeAfterWrite)
+        {
+            flushConnection(reactor, connection);
+            return true;
+        }
+        return false;
+    }
+}
+
+bool NetworkManager::parseHeader(Connection &connection)
+{
+    if (connection.pending.size() < 4)
+    {
+        return false;
+    }
+    if (hasFrameMagic(reinterpret_cast<const uint8_t *>(connection.pending.data()), connection.pending.size()))
+    {
+        // Binary satellite protocol, the connection stays framed from here on
+        connection.framed = true;
+        connection.state = Connection::ReadingFrameHeader;
+        return true;
+    }
+
+    size_t headerEnd = connection.pending.find("\r\n\r\n");
+    if (headerEnd == std::string::npos)
     {
-        perror("Error accepting client connection");
-        return;
+        if (connection.pending.size() > serverParams.max_header_size)
+        {
+            rejectRequest(connection, "400 Bad Request", "Bad Request");
+        }
+        return false;
     }
-    std::cout << "Connected with client! New socket descriptor: " << newSd << std::endl;
 
-    std::lock_guard<std::mutex> guard(clientMutex);
-    clientThreads.push_back(std::thread(&NetworkManager::session, this, newSd));
+    // Header field names are case-insensitive
+    std::string header = connection.pending.substr(0, headerEnd + 2);
+    std::transform(header.begin(), header.end(), header.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    connection.pending.erase(0, headerEnd + 4);
+
+    bool http10 = header.find(" http/1.0\r\n") != std::string::npos;
+    if (header.find("\r\nconnection: close\r\n") != std::string::npos)
+    {
+        connection.keepAlive = false;
+    }
+    else if (header.find("\r\nconnection: keep-alive\r\n") != std::string::npos)
+    {
+        connection.keepAlive = true;
+    }
+    else
+    {
+        connection.keepAlive = !http10;
+    }
+
+    int priority = 0;
+    static const char priorityName[] = "\r\nx-priority:";
+    size_t priorityPos = header.find(priorityName);
+    if (priorityPos != std::string::npos)
+    {
+        // The value may follow the colon directly or after spaces/tabs
+        priorityPos += strlen(priorityName);
+        while (priorityPos < header.size() && (header[priorityPos] == ' ' || header[priorityPos] == '\t'))
+        {
+            ++priorityPos;
+        }
+        priority = std::atoi(header.c_str() + priorityPos);
+    }
+
+    if (header.find("\r\ntransfer-encoding: chunked\r\n") != std::string::npos)
+    {
+        // Start with one pooled page, the buffer grows as frames arrive
+        connection.soundData = std::make_unique<SoundData>(0, connection.sd);
+        connection.soundData->priority = priority;
+        connection.state = Connection::ReadingChunkSize;
+        return true;
+    }
+
+    size_t contentLengthPos = header.find("\r\ncontent-length:");
+    if (contentLengthPos == std::string::npos)
+    {
+        rejectRequest(connection, "400 Bad Request", "Bad Request");
+        return false;
+    }
+
+    contentLengthPos += 17; // Move past "\r\ncontent-length:"
+    size_t contentLength = std::strtoul(header.c_str() + contentLengthPos, nullptr, 10);
+    if (contentLength > serverParams.max_body_size)
+    {
+        rejectRequest(connection, "413 Payload Too Large", "Payload Too Large");
+        return false;
+    }
+
+    connection.soundData = std::make_unique<SoundData>(contentLength, connection.sd);
+    connection.soundData->priority = priority;
+    connection.bodyOffset = 0;
+    connection.state = Connection::ReadingBody;
+    return true;
 }
 
-void NetworkManager::session(int clientSd)
+bool NetworkManager::parseChunkLine(Connection &connection)
 {
-    char buffer[1024];
-    memset(buffer, 0, sizeof(buffer));
+    size_t lineEnd = connection.pending.find("\r\n");
+    if (lineEnd == std::string::npos)
+    {
+        if (connection.pending.size() > serverParams.max_header_size)
+        {
+            rejectRequest(connection, "400 Bad Request", "Bad Request");
+        }
+        return false;
+    }
 
-    int bytesReceived = recv(clientSd, buffer, sizeof(buffer), 0);
-    if (bytesReceived < 0)
+    std::string line = connection.pending.substr(0, lineEnd);
+    connection.pending.erase(0, lineEnd + 2);
+
+    if (connection.state == Connection::ReadingTrailer)
     {
-        perror("Failed to read data from client");
-        closeSocket(clientSd);
-        return;
+        // Trailer fields are ignored, an empty line ends the upload
+        if (line.empty())
+        {
+            connection.state = Connection::Processing;
+        }
+        return true;
     }
 
-    std::string request(buffer);
-    size_t contentLengthPos = request.find("Content-Length: ");
-    if (contentLengthPos == std::string::npos)
+    if (line.empty())
     {
-        sendHttpResponse(clientSd, reinterpret_cast<const uint8_t *>("Bad Request"), 11, "400 Bad Request", "text/plain");
-        closeSocket(clientSd);
+        // CRLF that terminates the previous chunk's data
+        return true;
+    }
+
+    char *end = nullptr;
+    size_t chunkSize = std::strtoul(line.c_str(), &end, 16);
+    if (end == line.c_str())
+    {
+        rejectRequest(connection, "400 Bad Request", "Bad Request");
+        return false;
+    }
+
+    if (chunkSize == 0)
+    {
+        connection.state = Connection::ReadingTrailer;
+        return true;
+    }
+
+    if (connection.soundData->length + chunkSize > serverParams.max_body_size)
+    {
+        rejectRequest(connection, "413 Payload Too Large", "Payload Too Large");
+        return false;
+    }
+
+    connection.soundData->reserve(connection.soundData->length + chunkSize);
+    connection.chunkRemaining = chunkSize;
+    connection.state = Connection::ReadingChunkData;
+    return true;
+}
+
+bool NetworkManager::parseFrameHeader(Connection &connection)
+{
+    FrameHeader frame;
+    FrameStatus status = decodeFrameHeader(reinterpret_cast<const uint8_t *>(connection.pending.data()), connection.pending.size(), frame);
+    if (status == FrameStatus::NeedMore)
+    {
+        return false;
+    }
+    if (status != FrameStatus::Ok)
+    {
+        rejectRequest(connection, "400 Bad Request", "Malformed frame header");
+        return false;
+    }
+    connection.pending.erase(0, FrameHeader::kSize);
+
+    if (frame.type != FrameType::Audio && frame.type != FrameType::EndOfStream)
+    {
+        rejectRequest(connection, "400 Bad Request", "Unexpected frame type");
+        return false;
+    }
+
+    if (!connection.soundData)
+    {
+        // First frame of a new utterance
+        connection.soundData = std::make_unique<SoundData>(0, connection.sd);
+        connection.soundData->format = frame.format;
+        connection.soundData->streamId = frame.streamId;
+        connection.soundData->priority = frame.flags & FrameHeader::kFlagPriorityMask;
+
+        // Codecs always decode to S16LE, raw PCM must name a sample format the converter knows
+        if (frame.format.codec > CodecType::ImaAdpcm || (frame.format.codec == CodecType::PCM && frame.format.bytesPerSample() == 0))
+        {
+            rejectRequest(connection, "400 Bad Request", "Unsupported audio format");
+            return false;
+        }
+
+#if defined(BUILD_FULL) || defined(BUILD_SERVER)
+        // More frames follow, start transcribing while they arrive instead of after the last one
+        if (serverParams.live_transcription && frame.type == FrameType::Audio && frame.format.bytesPerSample() != 0)
+        {
+            try
+            {
+                auto live = std::make_shared<LiveTranscription>();
+                live->streamId = frame.streamId;
+                live->format = frame.format;
+                if (frame.format.sampleRate != 0 && frame.format.sampleRate != WHISPER_SAMPLE_RATE)
+                {
+                    live->resampler = std::make_unique<Resampler>(frame.format.sampleRate, WHISPER_SAMPLE_RATE);
+                }
+                WhisperTranscriber::StreamParams streamParams;
+                streamParams.step_ms = serverParams.live_step_ms;
+                streamParams.window_ms = serverParams.live_window_ms;
+                live->stream = transcriber.openStream(streamParams);
+                connection.live = std::move(live);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Cannot transcribe stream " << frame.streamId << " live: " << e.what() << std::endl;
+            }
+        }
+#endif
+    }
+    else if (frame.streamId != connection.soundData->streamId || frame.sequence != connection.nextSequence)
+    {
+        rejectRequest(connection, "400 Bad Request", "Out of order frame");
+        return false;
+    }
+    connection.nextSequence = frame.sequence + 1;
+
+    size_t streamed = connection.soundData->length + frame.payloadLength;
+#if defined(BUILD_FULL) || defined(BUILD_SERVER)
+    if (connection.live)
+    {
+        std::lock_guard<std::mutex> guard(connection.live->chunksMutex);
+        streamed += connection.live->receivedBytes;
+    }
+#endif
+    if (streamed > serverParams.max_body_size)
+    {
+        rejectRequest(connection, "413 Payload Too Large", "Payload Too Large");
+        return false;
+    }
+
+    connection.soundData->reserve(connection.soundData->length + frame.payloadLength);
+    connection.chunkRemaining = frame.payloadLength;
+    connection.frameEndsStream = frame.type == FrameType::EndOfStream;
+    connection.state = Connection::ReadingFramePayload;
+    return true;
+}
+
+void NetworkManager::rejectRequest(Connection &connection, const std::string &statusCode, const std::string &message)
+{
+    if (connection.framed)
+    {
+        uint32_t streamId = connection.soundData ? connection.soundData->streamId : 0;
+        queueFrame(connection, FrameType::Error, streamId, reinterpret_cast<const uint8_t *>(message.data()), message.size());
+        connection.closeAfterWrite = true;
         return;
     }
 
-    contentLengthPos += 16; // Move past "Content-Length: "
-    size_t endOfContentLength = request.find("\r\n", contentLengthPos);
-    size_t contentLength = std::stoi(request.substr(contentLengthPos, endOfContentLength - contentLengthPos));
+    queueHttpResponse(connection, reinterpret_cast<const uint8_t *>(message.data()), message.size(), statusCode, "text/plain", false);
+    connection.closeAfterWrite = true;
+}
+
+void NetworkManager::dispatchSoundData(Reactor &reactor, const std::shared_ptr<Connection> &connection)
+{
+    connection->state = Connection::Processing;
+
+    // Stop reading while the worker owns the connection, errors and hangups are still reported
+    epoll_event event{};
+    event.events = 0;
+    event.data.fd = connection->sd;
+    epoll_ctl(reactor.epollFd, EPOLL_CTL_MOD, connection->sd, &event);
+
+    auto process = [this, &reactor, connection]()
+    {
+        // Framed clients get progress and intermediate results pushed ahead of the response
+        EventCallback emit;
+        if (connection->framed)
+        {
+            uint32_t streamId = connection->soundData->streamId;
+            emit = [this, &reactor, connection, streamId](FrameType type, const std::string &payload)
+            {
+                pushEvent(reactor, connection, streamId, type, payload);
+            };
+            emit(FrameType::TaskStatus, "processing");
+        }
+
+        // Forward data to ModelRunner and get the result, processed in place. A live stream
+        // has been decoded while it arrived, only the audio after the last decode is left.
+        if (connection->live)
+        {
+            finishLiveTranscription(*connection, emit);
+        }
+        else
+        {
+            processSoundData(connection->soundData.get(), emit);
+        }
+
+        // Send the processed data back to the client straight from the receive buffer
+        if (connection->framed)
+        {
+            queueFrame(*connection, FrameType::Result, connection->soundData->streamId, nullptr, connection->soundData->length);
+        }
+        else
+        {
+            queueHttpResponse(*connection, nullptr, connection->soundData->length, "200 OK", "application/octet-stream", connection->keepAlive);
+            connection->closeAfterWrite = !connection->keepAlive;
+        }
+        connection->responseBody = std::move(connection->soundData);
+
+        std::lock_guard<std::mutex> guard(reactor.completedMutex);
+        reactor.completed.push_back(connection);
+        wakeReactor(reactor);
+    };
+
+    // The utterance waited past its deadline, answer with an overload hint instead
+    auto expired = [this, &reactor, connection]()
+    {
+        queueOverloaded(*connection, workerPool->retryAfterSeconds());
+
+        std::lock_guard<std::mutex> guard(reactor.completedMutex);
+        reactor.completed.push_back(connection);
+        wakeReactor(reactor);
+    };
+
+    // Processing threw, e.g. an inference error; answer so the client is not left waiting
+    auto failed = [this, &reactor, connection](const std::string &error)
+    {
+        rejectRequest(*connection, "500 Internal Server Error", "Processing failed: " + error);
+
+        std::lock_guard<std::mutex> guard(reactor.completedMutex);
+        reactor.completed.push_back(connection);
+        wakeReactor(reactor);
+    };
+
+    auto deadline = WorkerPool::Clock::now() + std::chrono::milliseconds(serverParams.max_queue_wait_ms);
+    if (workerPool->submit(process, expired, connection->soundData->priority, deadline, failed) == WorkerPool::Admission::Rejected)
+    {
+        queueOverloaded(*connection, workerPool->retryAfterSeconds());
+        flushConnection(reactor, connection);
+    }
+}
+
+void NetworkManager::queueOverloaded(Connection &connection, int retryAfterSeconds)
+{
+    std::string message = "overloaded; retry-after=" + std::to_string(retryAfterSeconds);
+    if (connection.framed)
+    {
+        FrameHeader frame;
+        frame.type = FrameType::Error;
+        frame.flags = FrameHeader::kFlagOverloaded;
+        frame.streamId = connection.soundData ? connection.soundData->streamId : 0;
+        frame.queueDepth = reportedQueueDepth();
+        frame.payloadLength = static_cast<uint32_t>(message.size());
+
+        uint8_t header[FrameHeader::kSize];
+        encodeFrameHeader(frame, header);
+        connection.outbox.append(reinterpret_cast<const char *>(header), sizeof(header));
+        connection.outbox += message;
+    }
+    else
+    {
+        queueHttpResponse(connection, reinterpret_cast<const uint8_t *>(message.data()), message.size(), "503 Service Unavailable", "text/plain",
+                          connection.keepAlive, "Retry-After: " + std::to_string(retryAfterSeconds) + "\r\n");
+        connection.closeAfterWrite = !connection.keepAlive;
+    }
+
+    // The shed utterance is released, the connection stays usable for the next one
+    connection.soundData.reset();
+    connection.live.reset();
+}
+
+void NetworkManager::drainCompleted(Reactor &reactor)
+{
+    std::vector<std::shared_ptr<Connection>> completed;
+    std::vector<std::shared_ptr<Connection>> pushes;
+    {
+        std::lock_guard<std::mutex> guard(reactor.completedMutex);
+        completed.swap(reactor.completed);
+        pushes.swap(reactor.pushes);
+    }
+
+    // Event frames go first, a response completed in the same batch must not overtake them
+    for (auto &connection : pushes)
+    {
+        if (!connection->closed && connection->state != Connection::Writing)
+        {
+            writePushed(*connection);
+        }
+    }
+
+    for (auto &connection : completed)
+    {
+        if (connection->closed)
+        {
+            continue;
+        }
+
+        if (reactor.connections.find(connection->sd) == reactor.connections.end())
+        {
+            // Newly accepted connection handed over by the listening reactor
+            reactor.connections[connection->sd] = connection;
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP;
+            event.data.fd = connection->sd;
+            if (epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, connection->sd, &event) < 0)
+            {
+                perror("Failed to register client socket");
+                closeConnection(reactor, connection);
+            }
+            continue;
+        }
+
+        flushConnection(reactor, connection);
+    }
+}
+
+void NetworkManager::pushEvent(Reactor &reactor, const std::shared_ptr<Connection> &connection, uint32_t streamId, FrameType type, const std::string &payload)
+{
+    FrameHeader frame;
+    frame.type = type;
+    frame.streamId = streamId;
+    frame.queueDepth = reportedQueueDepth();
+    frame.payloadLength = static_cast<uint32_t>(payload.size());
+
+    uint8_t header[FrameHeader::kSize];
+    encodeFrameHeader(frame, header);
+    {
+        std::lock_guard<std::mutex> guard(connection->pushMutex);
+        connection->pushed.append(reinterpret_cast<const char *>(header), sizeof(header));
+        connection->pushed += payload;
+    }
 
-    size_t headerEnd = request.find("\r\n\r\n");
-    size_t dataStart = headerEnd + 4;
+    std::lock_guard<std::mutex> guard(reactor.completedMutex);
+    reactor.pushes.push_back(connection);
+    wakeReactor(reactor);
+}
 
-    SoundData soundData(contentLength, clientSd);
+void NetworkManager::writePushed(Connection &connection)
+{
+    // Best effort while the request is read or processed, nothing else writes to the socket then.
+    // Whatever the socket does not take now is sent ahead of the response by flushConnection.
+    std::lock_guard<std::mutex> guard(connection.pushMutex);
+    while (!connection.pushed.empty())
+    {
+        ssize_t bytesSent = ::send(connection.sd, connection.pushed.data(), connection.pushed.size(), MSG_NOSIGNAL);
+        if (bytesSent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        connection.pushed.erase(0, bytesSent);
+    }
+}
 
-    if (dataStart < request.size())
+void NetworkManager::flushConnection(Reactor &reactor, const std::shared_ptr<Connection> &connection)
+{
+    if (connection->state != Connection::Writing)
     {
-        std::memcpy(soundData.data, buffer + dataStart, request.size() - dataStart);
+        std::lock_guard<std::mutex> guard(connection->pushMutex);
+        connection->outbox.insert(0, connection->pushed);
+        connection->pushed.clear();
     }
+    connection->state = Connection::Writing;
 
-    size_t bytesRemaining = contentLength - (request.size() - dataStart);
-    size_t offset = request.size() - dataStart;
-    while (bytesRemaining > 0)
+    size_t responseLength = connection->responseBody ? connection->responseBody->length : 0;
+    while (connection->outboxOffset < connection->outbox.size() || connection->responseOffset < responseLength)
     {
-        int bytesReceived = recv(clientSd, buffer, sizeof(buffer), 0);
-        if (bytesReceived <= 0)
+        // Header and processed audio go out in one gather write
+        iovec parts[2];
+        int partCount = 0;
+        if (connection->outboxOffset < connection->outbox.size())
+        {
+            parts[partCount].iov_base = connection->outbox.data() + connection->outboxOffset;
+            parts[partCount].iov_len = connection->outbox.size() - connection->outboxOffset;
+            ++partCount;
+        }
+        if (connection->responseOffset < responseLength)
+        {
+            parts[partCount].iov_base = connection->responseBody->data + connection->responseOffset;
+            parts[partCount].iov_len = responseLength - connection->responseOffset;
+            ++partCount;
+        }
+
+        msghdr message{};
+        message.msg_iov = parts;
+        message.msg_iovlen = partCount;
+        ssize_t bytesSent = sendmsg(connection->sd, &message, MSG_NOSIGNAL);
+        if (bytesSent < 0)
         {
-            perror("Failed to read remaining data from client");
-            closeSocket(clientSd);
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // Wait until the socket is writable again. No EPOLLRDHUP here: a peer that shut down
+                // its side keeps it raised, level-triggered, until the socket is read again
+                epoll_event event{};
+                event.events = EPOLLOUT;
+                event.data.fd = connection->sd;
+                epoll_ctl(reactor.epollFd, EPOLL_CTL_MOD, connection->sd, &event);
+                return;
+            }
+            perror("Failed to send data to client");
+            closeConnection(reactor, connection);
             return;
         }
-        std::memcpy(soundData.data + offset, buffer, bytesReceived);
-        offset += bytesReceived;
-        bytesRemaining -= bytesReceived;
+        size_t fromOutbox = std::min<size_t>(bytesSent, connection->outbox.size() - connection->outboxOffset);
+        connection->outboxOffset += fromOutbox;
+        connection->responseOffset += bytesSent - fromOutbox;
+    }
+
+    connection->outbox.clear();
+    connection->outboxOffset = 0;
+    connection->responseBody.reset();
+    connection->responseOffset = 0;
+
+    if (connection->closeAfterWrite)
+    {
+        closeConnection(reactor, connection);
+        return;
     }
 
-    // Forward data to ModelRunner and get the result
-    uint8_t processedData[soundData.length];
-    processSoundData(&soundData, processedData);
+    // Persistent connection, wait for the next utterance
+    connection->state = connection->framed ? Connection::ReadingFrameHeader : Connection::ReadingHeader;
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = connection->sd;
+    epoll_ctl(reactor.epollFd, EPOLL_CTL_MOD, connection->sd, &event);
+
+    // A pipelined request may already be waiting in the pending buffer
+    if (!connection->pending.empty())
+    {
+        advanceConnection(reactor, connection);
+    }
+}
 
-    // Send the processed data back to the client
-    sendHttpResponse(clientSd, processedData, soundData.length, "200 OK", "application/octet-stream");
+void NetworkManager::wakeReactor(Reactor &reactor)
+{
+    uint64_t one = 1;
+    if (reactor.wakeFd >= 0 && write(reactor.wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        perror("Failed to wake reactor");
+    }
+}
 
-    closeSocket(clientSd);
+void NetworkManager::closeConnection(Reactor &reactor, const std::shared_ptr<Connection> &connection)
+{
+    if (connection->closed)
+    {
+        return;
+    }
+    connection->closed = true;
+    epoll_ctl(reactor.epollFd, EPOLL_CTL_DEL, connection->sd, nullptr);
+    reactor.connections.erase(connection->sd);
+    closeSocket(connection->sd);
 }
 
-void NetworkManager::sendHttpResponse(int clientSd, const uint8_t *data, size_t length, const std::string &statusCode, const std::string &contentType)
+void NetworkManager::queueHttpResponse(Connection &connection, const uint8_t *data, size_t length, const std::string &statusCode, const std::string &contentType, bool keepAlive, const std::string &extraHeaders)
 {
     std::ostringstream httpResponse;
     httpResponse << "HTTP/1.1 " << statusCode << "\r\n";
     httpResponse << "Content-Type: " << contentType << "\r\n";
+    httpResponse << extraHeaders;
     httpResponse << "Content-Length: " << length << "\r\n";
-    httpResponse << "Connection: close\r\n\r\n";
-    send(clientSd, httpResponse.str().c_str(), httpResponse.str().length(), 0);
+    httpResponse << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+    connection.outbox += httpResponse.str();
+
+    if (data != nullptr && length > 0)
+    {
+        connection.outbox.append(reinterpret_cast<const char *>(data), length);
+    }
+}
+
+void NetworkManager::queueFrame(Connection &connection, FrameType type, uint32_t streamId, const uint8_t *data, size_t length)
+{
+    FrameHeader frame;
+    frame.type = type;
+    frame.streamId = streamId;
+    frame.queueDepth = reportedQueueDepth();
+    frame.payloadLength = static_cast<uint32_t>(length);
+
+    uint8_t header[FrameHeader::kSize];
+    encodeFrameHeader(frame, header);
+    connection.outbox.append(reinterpret_cast<const char *>(header), sizeof(header));
 
     if (data != nullptr && length > 0)
     {
-        send(clientSd, data, length, 0);
+        connection.outbox.append(reinterpret_cast<const char *>(data), length);
     }
 }
 
+uint8_t NetworkManager::reportedQueueDepth() const
+{
+    return workerPool ? static_cast<uint8_t>(std::min<size_t>(workerPool->depth(), 255)) : 0;
+}
+
 void NetworkManager::closeSocket(int sd)
 {
     if (sd >= 0)
@@ -425,19 +2365,55 @@ void NetworkManager::addKnownClient(int clientSd)
     knownClients.insert(clientSd);
 }
 
+void NetworkManager::setMetricsRegistry(std::shared_ptr<prometheus::Registry> registry)
+{
+    metricsRegistry = std::move(registry);
+
+#if defined(BUILD_FULL) || defined(BUILD_SERVER)
+    auto &readyFamily = prometheus::BuildGauge()
+                            .Name("whisper_model_ready")
+                            .Help("1 once the Whisper models are loaded, 0 while loading or after a failed load")
+                            .Register(*metricsRegistry);
+    auto &loadFamily = prometheus::BuildGauge()
+                           .Name("whisper_model_load_seconds")
+                           .Help("Time the last Whisper model load took")
+                           .Register(*metricsRegistry);
+    {
+        std::lock_guard<std::mutex> lock(modelMetricsMutex);
+        modelReadyGauge = &readyFamily.Add({});
+        modelLoadGauge = &loadFamily.Add({});
+    }
+    publishModelMetrics();
+#endif
+}
+
 int NetworkManager::getServerSocket() const
 {
     return serverSd;
 }
 
-void NetworkManager::send(int sd, const char *data, size_t length, int flags)
+bool NetworkManager::send(int sd, const char *data, size_t length, int flags)
 {
-    ::send(sd, data, length, flags);
+    size_t offset = 0;
+    while (offset < length)
+    {
+        ssize_t bytesSent = ::send(sd, data + offset, length - offset, flags | MSG_NOSIGNAL);
+        if (bytesSent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        offset += bytesSent;
+    }
+    return true;
 }
 
-void NetworkManager::send(int sd, const uint8_t *data, size_t length, int flags)
+bool NetworkManager::send(int sd, const uint8_t *data, size_t length, int flags)
 {
-    ::send(sd, reinterpret_cast<const char *>(data), length, flags);
+    return send(sd, reinterpret_cast<const char *>(data), length, flags);
 }
 
 int NetworkManager::recv(int sd, char *buffer, size_t length, int flags)
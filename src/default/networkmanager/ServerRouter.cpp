@@ -0,0 +1,153 @@
+#include "ServerRouter.h"
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(BUILD_FULL) && !defined(BUILD_SERVER)
+
+ServerRouter::ServerRouter(const std::vector<Endpoint> &endpoints, const ServerParams &params)
+    : nextServer(0), failoverCooldownMs(params.failover_cooldown_ms)
+{
+    for (const auto &endpoint : endpoints)
+    {
+        auto server = std::make_unique<Server>();
+        server->ip = endpoint.ip;
+        server->port = endpoint.port;
+        server->client = std::make_unique<NetworkManager>(endpoint.port, &server->ip[0], NetworkManager::TCP, params);
+
+        // Connections come up in the background, a dead server never blocks the others
+        server->client->connectClientInBackground();
+        servers.push_back(std::move(server));
+    }
+}
+
+void ServerRouter::setAudioFormat(const AudioFormat &format, int downsampleFactor)
+{
+    for (auto &server : servers)
+    {
+        server->client->setAudioFormat(format, downsampleFactor);
+    }
+}
+
+void ServerRouter::setUplinkSampleRate(uint32_t sampleRate)
+{
+    for (auto &server : servers)
+    {
+        server->client->setUplinkSampleRate(sampleRate);
+    }
+}
+
+bool ServerRouter::waitForServer(int timeoutMs)
+{
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (healthyServers() == 0)
+    {
+        if (Clock::now() >= deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return true;
+}
+
+std::future<std::string> ServerRouter::sendSoundData(const uint8_t *data, size_t length, NetworkManager::ResponseCallback onResponse,
+                                                    NetworkManager::EventCallback onEvent)
+{
+    auto request = std::make_shared<Request>();
+    request->audio.assign(data, data + length);
+    request->callback = std::move(onResponse);
+    request->onEvent = std::move(onEvent);
+    request->tried.assign(servers.size(), false);
+    std::future<std::string> result = request->promise.get_future();
+    dispatch(request);
+    return result;
+}
+
+size_t ServerRouter::healthyServers() const
+{
+    int64_t now = nowMs();
+    size_t healthy = 0;
+    for (const auto &server : servers)
+    {
+        if (server->client->isConnected() && server->avoidUntilMs <= now)
+        {
+            ++healthy;
+        }
+    }
+    return healthy;
+}
+
+int ServerRouter::pickServer(const std::vector<bool> &tried)
+{
+    // Healthy servers first, recently failed ones only when nothing else is left
+    int64_t now = nowMs();
+    int best = -1;
+    bool bestHealthy = false;
+    size_t bestLoad = std::numeric_limits<size_t>::max();
+    size_t start = nextServer++;
+
+    for (size_t i = 0; i < servers.size(); ++i)
+    {
+        size_t index = (start + i) % servers.size();
+        const Server &server = *servers[index];
+        if (tried[index] || !server.client->isConnected())
+        {
+            continue;
+        }
+
+        bool healthy = server.avoidUntilMs <= now;
+        size_t load = server.client->inFlightCount() + static_cast<size_t>(server.client->serverQueueDepth());
+        if (best < 0 || (healthy && !bestHealthy) || (healthy == bestHealthy && load < bestLoad))
+        {
+            best = static_cast<int>(index);
+            bestHealthy = healthy;
+            bestLoad = load;
+        }
+    }
+    return best;
+}
+
+void ServerRouter::dispatch(const std::shared_ptr<Request> &request)
+{
+    int index = pickServer(request->tried);
+    if (index < 0)
+    {
+        std::string reason = request->lastError.empty() ? "No transcription server available" : request->lastError;
+        request->promise.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+        if (request->callback)
+        {
+            request->callback(false, reason);
+        }
+        return;
+    }
+
+    request->tried[index] = true;
+    Server *server = servers[index].get();
+    server->client->sendSoundDataAsync(request->audio.data(), request->audio.size(), [this, request, server](bool ok, const std::string &payload)
+                                       {
+        if (ok)
+        {
+            request->promise.set_value(payload);
+            if (request->callback)
+            {
+                request->callback(true, payload);
+            }
+            return;
+        }
+
+        // Dropped, shed or disconnected: steer new work away from this server and fail over
+        std::cerr << "Server " << server->ip << ":" << server->port << " failed a request: " << payload << std::endl;
+        server->avoidUntilMs = nowMs() + failoverCooldownMs;
+        request->lastError = payload;
+        dispatch(request); },
+                                       request->onEvent);
+}
+
+int64_t ServerRouter::nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+}
+
+#endif
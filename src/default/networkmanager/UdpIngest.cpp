@@ -0,0 +1,279 @@
+#include "UdpIngest.h"
+#include "NetworkManager.h"
+#include "AudioCodec.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/socket.h>
+
+UdpIngest::UdpIngest(int sd, const Params &params, CompletionHandler onComplete)
+    : sd_(sd), params_(params), onComplete_(std::move(onComplete)), running_(false)
+{
+    if (params_.batch_size < 1)
+    {
+        params_.batch_size = 1;
+    }
+}
+
+void UdpIngest::run()
+{
+    const size_t batch = params_.batch_size;
+    std::vector<uint8_t> slots(batch * params_.max_datagram);
+    std::vector<mmsghdr> messages(batch);
+    std::vector<iovec> vectors(batch);
+    std::vector<sockaddr_in> sources(batch);
+
+    running_ = true;
+    while (running_)
+    {
+        // Wake up regularly so gaps and idle streams are resolved even without traffic
+        pollfd pfd{sd_, POLLIN, 0};
+        int ready = poll(&pfd, 1, 10);
+        Clock::time_point now = Clock::now();
+
+        if (ready > 0)
+        {
+            for (size_t i = 0; i < batch; ++i)
+            {
+                vectors[i].iov_base = slots.data() + i * params_.max_datagram;
+                vectors[i].iov_len = params_.max_datagram;
+                std::memset(&messages[i], 0, sizeof(mmsghdr));
+                messages[i].msg_hdr.msg_iov = &vectors[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+                messages[i].msg_hdr.msg_name = &sources[i];
+                messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            }
+
+            int received = recvmmsg(sd_, messages.data(), batch, MSG_DONTWAIT, nullptr);
+            if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                perror("recvmmsg failed");
+            }
+
+            for (int i = 0; i < received; ++i)
+            {
+                if (messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+                {
+                    ++stats_.malformed;
+                    continue;
+                }
+                handleDatagram(slots.data() + i * params_.max_datagram, messages[i].msg_len, sources[i], now);
+            }
+        }
+        else if (ready < 0 && errno != EINTR)
+        {
+            perror("poll failed on UDP socket");
+        }
+
+        expireStreams(now);
+    }
+}
+
+void UdpIngest::stop()
+{
+    running_ = false;
+}
+
+void UdpIngest::handleDatagram(const uint8_t *data, size_t length, const sockaddr_in &source, Clock::time_point now)
+{
+    FrameHeader frame;
+    if (decodeFrameHeader(data, length, frame) != FrameStatus::Ok ||
+        (frame.type != FrameType::Audio && frame.type != FrameType::EndOfStream) ||
+        FrameHeader::kSize + frame.payloadLength != length)
+    {
+        ++stats_.malformed;
+        return;
+    }
+    ++stats_.packets;
+
+    StreamKey key{source.sin_addr.s_addr, source.sin_port, frame.streamId};
+    auto it = streams_.find(key);
+    if (it == streams_.end())
+    {
+        StreamState stream;
+        stream.source = source;
+        stream.format = frame.format;
+        stream.codec = frame.format.codec;
+        if (stream.codec != CodecType::PCM)
+        {
+            // Packets are decoded as they are played out, so the stream carries plain PCM
+            stream.format.codec = CodecType::PCM;
+            stream.format.sampleFormat = SampleFormat::S16LE;
+        }
+        stream.audio = std::make_unique<SoundData>(0, -1);
+        stream.audio->format = stream.format;
+        stream.audio->streamId = frame.streamId;
+        stream.gapSince = now;
+        it = streams_.emplace(key, std::move(stream)).first;
+    }
+
+    StreamState &stream = it->second;
+    stream.lastArrival = now;
+    if (stream.complete || frame.sequence < stream.nextSequence)
+    {
+        ++stats_.late;
+        return;
+    }
+    if (stream.pending.count(frame.sequence))
+    {
+        ++stats_.duplicates;
+        return;
+    }
+
+    Packet packet;
+    packet.payload.assign(data + FrameHeader::kSize, data + length);
+    packet.endOfStream = frame.type == FrameType::EndOfStream;
+    stream.pending.emplace(frame.sequence, std::move(packet));
+
+    playout(stream, now);
+}
+
+void UdpIngest::playout(StreamState &stream, Clock::time_point now)
+{
+    while (!stream.complete && !stream.pending.empty())
+    {
+        auto it = stream.pending.begin();
+        if (it->first == stream.nextSequence)
+        {
+            append(stream, it->second.payload.data(), it->second.payload.size());
+            stream.complete = it->second.endOfStream;
+            stream.pending.erase(it);
+            ++stream.nextSequence;
+            stream.gapSince = now;
+            continue;
+        }
+
+        // A sequence number is missing, wait for it unless the jitter budget is exhausted
+        bool bufferFull = stream.pending.size() >= static_cast<size_t>(params_.reorder_packets);
+        bool waitedTooLong = now - stream.gapSince >= std::chrono::milliseconds(params_.max_delay_ms);
+        if (!bufferFull && !waitedTooLong)
+        {
+            break;
+        }
+
+        // A gap longer than the reorder window is not loss worth hiding: a sender restart or a
+        // corrupt or spoofed sequence number. Skip to the packet instead of synthesizing audio for it.
+        const uint32_t gap = it->first - stream.nextSequence;
+        if (gap > static_cast<uint32_t>(std::max(1, params_.reorder_packets)))
+        {
+            ++stats_.resets;
+            stream.nextSequence = it->first;
+            continue;
+        }
+
+        // Compressed payload sizes say little about the decoded duration, reuse the last decoded packet size
+        size_t packetLength = stream.codec == CodecType::PCM ? it->second.payload.size() : stream.lastPacketLength;
+        for (uint32_t missing = 0; missing < gap; ++missing)
+        {
+            conceal(stream, packetLength);
+            ++stats_.concealed;
+        }
+        stream.nextSequence = it->first;
+    }
+
+    if (stream.complete && stream.audio)
+    {
+        onComplete_(std::move(stream.audio), stream.source);
+        stream.pending.clear();
+    }
+}
+
+void UdpIngest::append(StreamState &stream, const uint8_t *data, size_t length)
+{
+    if (stream.codec != CodecType::PCM)
+    {
+        uint8_t channels = std::max<uint8_t>(1, stream.format.channels);
+        size_t decodedLength = decodedAudioSize(stream.codec, data, length, channels);
+        if (decodedLength == 0)
+        {
+            ++stats_.malformed;
+            return;
+        }
+        decoded_.resize(decodedLength);
+        decodeAudio(stream.codec, data, length, channels, decoded_.data());
+        data = decoded_.data();
+        length = decodedLength;
+    }
+
+    SoundData &audio = *stream.audio;
+    if (audio.length + length > params_.max_stream_bytes)
+    {
+        return;
+    }
+    audio.reserve(audio.length + length);
+    std::memcpy(audio.data + audio.length, data, length);
+    stream.lastPacketOffset = audio.length;
+    stream.lastPacketLength = length;
+    audio.length += length;
+}
+
+void UdpIngest::conceal(StreamState &stream, size_t length)
+{
+    SoundData &audio = *stream.audio;
+    if (audio.length + length > params_.max_stream_bytes)
+    {
+        return;
+    }
+
+    audio.reserve(audio.length + length);
+    uint8_t *out = audio.data + audio.length;
+    const uint8_t *previous = audio.data + stream.lastPacketOffset;
+    size_t available = std::min(length, stream.lastPacketLength);
+
+    // Repeat the previous packet at half amplitude, silence where it is too short
+    std::memset(out, 0, length);
+    if (stream.format.sampleFormat == SampleFormat::S16LE)
+    {
+        for (size_t i = 0; i + 2 <= available; i += 2)
+        {
+            int16_t sample;
+            std::memcpy(&sample, previous + i, sizeof(sample));
+            sample = static_cast<int16_t>(sample / 2);
+            std::memcpy(out + i, &sample, sizeof(sample));
+        }
+    }
+    else if (stream.format.sampleFormat == SampleFormat::F32LE)
+    {
+        for (size_t i = 0; i + 4 <= available; i += 4)
+        {
+            float sample;
+            std::memcpy(&sample, previous + i, sizeof(sample));
+            sample *= 0.5f;
+            std::memcpy(out + i, &sample, sizeof(sample));
+        }
+    }
+
+    stream.lastPacketOffset = audio.length;
+    stream.lastPacketLength = length;
+    audio.length += length;
+}
+
+void UdpIngest::expireStreams(Clock::time_point now)
+{
+    const auto timeout = std::chrono::milliseconds(params_.stream_timeout_ms);
+
+    for (auto it = streams_.begin(); it != streams_.end();)
+    {
+        StreamState &stream = it->second;
+        if (!stream.complete)
+        {
+            playout(stream, now);
+        }
+
+        if (now - stream.lastArrival < timeout)
+        {
+            ++it;
+            continue;
+        }
+
+        if (!stream.complete && stream.audio && stream.audio->length > 0)
+        {
+            // The EndOfStream packet never arrived, deliver what was received
+            stream.complete = true;
+            onComplete_(std::move(stream.audio), stream.source);
+        }
+        it = streams_.erase(it);
+    }
+}
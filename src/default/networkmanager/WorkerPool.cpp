@@ -0,0 +1,196 @@
+#include "WorkerPool.h"
+#include "counter.h"
+#include "gauge.h"
+#include "histogram.h"
+#include "registry.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+WorkerPool::WorkerPool(size_t threadCount, size_t maxQueueDepth)
+    : maxQueueDepth(maxQueueDepth), nextOrder(0), stopping(false), averageServiceMs(0.0),
+      depthGauge(nullptr), waitHistogram(nullptr), overloadDrops(nullptr), deadlineDrops(nullptr)
+{
+    if (threadCount == 0)
+    {
+        threadCount = 1;
+    }
+
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+    {
+        workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+bool WorkerPool::submit(std::function<void()> job)
+{
+    return submit(std::move(job), nullptr, 0, Clock::time_point::max()) == Admission::Accepted;
+}
+
+WorkerPool::Admission WorkerPool::submit(std::function<void()> job, std::function<void()> onDropped, int priority, Clock::time_point deadline,
+                                         std::function<void(const std::string &error)> onFailed)
+{
+    {
+        std::lock_guard<std::mutex> guard(jobsMutex);
+        if (stopping)
+        {
+            return Admission::Rejected;
+        }
+        if (maxQueueDepth > 0 && jobs.size() >= maxQueueDepth)
+        {
+            if (overloadDrops)
+            {
+                overloadDrops->Increment();
+            }
+            return Admission::Rejected;
+        }
+        jobs.push(Job{std::move(job), std::move(onDropped), std::move(onFailed), priority, nextOrder++, Clock::now(), deadline});
+        if (depthGauge)
+        {
+            depthGauge->Set(static_cast<double>(jobs.size()));
+        }
+    }
+    jobsCondition.notify_one();
+    return Admission::Accepted;
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(jobsMutex);
+        stopping = true;
+    }
+    jobsCondition.notify_all();
+
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+        {
+            worker.join();
+        }
+    }
+}
+
+size_t WorkerPool::size() const
+{
+    return workers.size();
+}
+
+size_t WorkerPool::depth() const
+{
+    std::lock_guard<std::mutex> guard(jobsMutex);
+    return jobs.size();
+}
+
+int WorkerPool::retryAfterSeconds() const
+{
+    double queuedMs = averageServiceMs.load() * static_cast<double>(depth()) / static_cast<double>(workers.size());
+    return std::max(1, static_cast<int>(std::ceil(queuedMs / 1000.0)));
+}
+
+void WorkerPool::attachMetrics(prometheus::Registry &registry, const std::string &poolName)
+{
+    auto &depthFamily = prometheus::BuildGauge()
+                            .Name("worker_queue_depth")
+                            .Help("Jobs waiting in the worker queue")
+                            .Register(registry);
+    auto &waitFamily = prometheus::BuildHistogram()
+                           .Name("worker_queue_wait_seconds")
+                           .Help("Time jobs spent queued before a worker picked them up")
+                           .Register(registry);
+    auto &dropFamily = prometheus::BuildCounter()
+                           .Name("worker_queue_dropped_total")
+                           .Help("Jobs shed because the queue was full or their deadline passed")
+                           .Register(registry);
+
+    std::lock_guard<std::mutex> guard(jobsMutex);
+    depthGauge = &depthFamily.Add({{"pool", poolName}});
+    waitHistogram = &waitFamily.Add({{"pool", poolName}}, prometheus::Histogram::BucketBoundaries{0.005, 0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10});
+    overloadDrops = &dropFamily.Add({{"pool", poolName}, {"reason", "overload"}});
+    deadlineDrops = &dropFamily.Add({{"pool", poolName}, {"reason", "deadline"}});
+}
+
+void WorkerPool::workerLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobsMutex);
+            jobsCondition.wait(lock, [this]
+                               { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+            {
+                return;
+            }
+            job = std::move(const_cast<Job &>(jobs.top()));
+            jobs.pop();
+            if (depthGauge)
+            {
+                depthGauge->Set(static_cast<double>(jobs.size()));
+            }
+        }
+
+        Clock::time_point started = Clock::now();
+        if (waitHistogram)
+        {
+            waitHistogram->Observe(std::chrono::duration<double>(started - job.enqueued).count());
+        }
+
+        try
+        {
+            if (started > job.deadline)
+            {
+                // Stale work, let the owner answer the client instead of running it
+                if (deadlineDrops)
+                {
+                    deadlineDrops->Increment();
+                }
+                if (job.onDropped)
+                {
+                    job.onDropped();
+                }
+                continue;
+            }
+
+            job.run();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Worker job failed: " << e.what() << std::endl;
+            fail(job, e.what());
+        }
+        catch (...)
+        {
+            std::cerr << "Worker job failed with an unknown exception" << std::endl;
+            fail(job, "unknown error");
+        }
+
+        // Exponential moving average of the service time feeds retryAfterSeconds()
+        double serviceMs = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+        double average = averageServiceMs.load();
+        averageServiceMs.store(average == 0.0 ? serviceMs : average * 0.9 + serviceMs * 0.1);
+    }
+}
+
+void WorkerPool::fail(Job &job, const std::string &error)
+{
+    if (!job.onFailed)
+    {
+        return;
+    }
+    try
+    {
+        job.onFailed(error);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Worker failure handler failed: " << e.what() << std::endl;
+    }
+}
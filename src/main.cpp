@@ -5,6 +5,7 @@
 #include <cstdio>
 #include <sstream>
 #include <algorithm>
+#include <vector>
 
 // Common headers
 #include "BluetoothComm.h"
@@ -89,6 +90,7 @@ bool checkBluetoothAvailability()
 #include "ReSpeaker.h"
 #include "HardwareInterface.h"
 #include "AirPlayServer.h"
+#include "ServerRouter.h"
 
 // Client-specific variables
 const char *spiDevicePath = "/dev/spidev0.0";
@@ -106,15 +108,83 @@ std::thread bluetoothThread;
 spi_config_t spiConfig;
 std::thread AirPlayServerThread;
 std::thread NetworkSpeechThread;
+CodecType uplink_codec = CodecType::PCM;
+int uplink_downsample = 1;
+uint32_t uplink_rate = 0;
+std::vector<ServerRouter::Endpoint> extra_servers;
+ServerParams client_params; // Connect timeout and failover settings of the uplink
+
+// Intermediate results pushed by the server while it works on an utterance (client-specific)
+void on_speech_event(FrameType type, const std::string &payload)
+{
+    switch (type)
+    {
+    case FrameType::Partial:
+        DEBUG_PRINT("Partial transcript: " << payload);
+        break;
+    case FrameType::Final:
+        std::cout << "Transcript: " << payload << std::endl;
+        break;
+    case FrameType::Intent:
+        std::cout << "Intent: " << payload << std::endl;
+        break;
+    case FrameType::TaskStatus:
+        DEBUG_PRINT("Task status: " << payload);
+        break;
+    default:
+        break;
+    }
+}
+
+// Applies the uplink flags to a NetworkManager or ServerRouter (client-specific)
+template <typename Uplink>
+void configure_uplink(Uplink &uplink)
+{
+    if (uplink_codec != CodecType::PCM || uplink_downsample > 1 || uplink_rate != 0)
+    {
+        // ReSpeaker captures 16-bit samples at 44.1 kHz on every microphone
+        AudioFormat uplinkFormat;
+        uplinkFormat.sampleRate = 44100;
+        uplinkFormat.channels = micCount;
+        uplinkFormat.sampleFormat = SampleFormat::S16LE;
+        uplinkFormat.codec = uplink_codec;
+        uplink.setAudioFormat(uplinkFormat, uplink_downsample);
+        uplink.setUplinkSampleRate(uplink_rate);
+    }
+}
 
 // Send speech data (client-specific)
 void send_speech_data(NetworkManager &client)
+{
+    try
+    {
+        // Uploads are pipelined, capturing can continue while the server is still working on this one
+        const char *soundData = "example sound data";
+        client.sendSoundDataAsync(reinterpret_cast<const uint8_t *>(soundData), strlen(soundData), [](bool ok, const std::string &response)
+                                  {
+            if (!ok)
+            {
+                std::cerr << "Speech request failed: " << response << std::endl;
+            } }, on_speech_event);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error sending speech data: " << e.what() << std::endl;
+    }
+}
+
+// Send speech data through the least loaded of several servers (client-specific)
+void send_speech_data_routed(ServerRouter &router)
 {
     try
     {
         const char *soundData = "example sound data";
-        client.sendSoundData(reinterpret_cast<const uint8_t *>(soundData), strlen(soundData));
-        client.receiveResponse();
+        router.sendSoundData(reinterpret_cast<const uint8_t *>(soundData), strlen(soundData), [](bool ok, const std::string &response)
+                             {
+            if (!ok)
+            {
+                std::cerr << "Speech request failed on every server: " << response << std::endl;
+            } }, on_speech_event);
     }
     catch (const std::exception &e)
     {
@@ -168,6 +238,58 @@ int main(int argc, char *argv[])
                 }
             }
 
+            if (std::string(argv[i]) == "-uplink-codec")
+            {
+                if (i + 1 < argc)
+                {
+                    std::string codec = argv[i + 1];
+                    uplink_codec = codec == "adpcm" ? CodecType::ImaAdpcm : codec == "mulaw" ? CodecType::MuLaw : CodecType::PCM;
+                }
+            }
+
+            if (std::string(argv[i]) == "-uplink-downsample")
+            {
+                if (i + 1 < argc)
+                {
+                    uplink_downsample = std::atoi(argv[i + 1]);
+                }
+            }
+
+            if (std::string(argv[i]) == "-uplink-rate")
+            {
+                if (i + 1 < argc)
+                {
+                    uplink_rate = static_cast<uint32_t>(std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-extra-server")
+            {
+                if (i + 1 < argc)
+                {
+                    std::string endpoint = argv[i + 1];
+                    size_t colon = endpoint.find(':');
+                    int port = colon == std::string::npos ? 15880 : std::atoi(endpoint.c_str() + colon + 1);
+                    extra_servers.push_back({endpoint.substr(0, colon), port});
+                }
+            }
+
+            if (std::string(argv[i]) == "-connect-timeout-ms")
+            {
+                if (i + 1 < argc)
+                {
+                    client_params.connect_timeout_ms = std::max(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-failover-cooldown-ms")
+            {
+                if (i + 1 < argc)
+                {
+                    client_params.failover_cooldown_ms = std::max(0, std::atoi(argv[i + 1]));
+                }
+            }
+
             if (std::string(argv[i]) == "-airplay")
             {
                 use_airplay = true;
@@ -184,8 +306,14 @@ int main(int argc, char *argv[])
                           << "Options:\n"
                           << "  -server-port <port>      : Set port to connect to the main server.\n"
                           << "  -server-ip <server-ip>   : Set IP address to connect to the main server.\n"
+                          << "  -extra-server <ip[:port]>: Add a transcription server, utterances go to the least loaded one.\n"
+                          << "  -connect-timeout-ms <ms> : Give up a single connect attempt to a server after this long.\n"
+                          << "  -failover-cooldown-ms <ms>: Avoid a server this long after it failed a request.\n"
                           << "  -airplay                 : Enable AirPlay server functionality.\n"
                           << "  -bluetooth               : Enable Bluetooth communication functionality.\n"
+                          << "  -uplink-codec <codec>    : Compress microphone uploads with pcm, mulaw or adpcm.\n"
+                          << "  -uplink-downsample <n>   : Divide the microphone sample rate by n before upload.\n"
+                          << "  -uplink-rate <hz>        : Resample microphone audio to this rate before upload (16000 for Whisper).\n"
                           << "  -help                    : Display this help message.\n"
                           << "AirPlay Options:\n"
                           << "  -allow <client>          : Allow specified client for AirPlay.\n"
@@ -267,9 +395,24 @@ int main(int argc, char *argv[])
         try
         {
             std::cout << "Client started." << std::endl;
-            NetworkManager client(
-                main_server_port, main_server_ip , NetworkManager::Protocol::TCP);
+            if (!extra_servers.empty())
+            {
+                // Several servers, route every utterance to the least loaded healthy one
+                std::vector<ServerRouter::Endpoint> endpoints{{main_server_ip ? main_server_ip : "127.0.0.1", main_server_port}};
+                endpoints.insert(endpoints.end(), extra_servers.begin(), extra_servers.end());
+                static ServerRouter router(endpoints, client_params);
+                configure_uplink(router);
+                router.waitForServer(client_params.connect_timeout_ms);
+                NetworkSpeechThread = std::thread(send_speech_data_routed, std::ref(router));
+                NetworkSpeechThread.detach();
+                std::cout << "Client finished." << std::endl;
+                return;
+            }
+            // Outlives this thread, the detached speech thread keeps sending through it
+            static NetworkManager client(
+                main_server_port, main_server_ip , NetworkManager::Protocol::TCP, client_params);
             client.connectClient();
+            configure_uplink(client);
             NetworkSpeechThread = std::thread(send_speech_data, std::ref(client));
             NetworkSpeechThread.detach();
             std::cout << "Client finished." << std::endl;
@@ -361,6 +504,7 @@ int main(int argc, char *argv[])
 #include <unordered_set>
 #include <cstdlib>
 #include <algorithm>
+#include <vector>
 #include <chrono>
 #include <boost/make_shared.hpp>
 #include <tensorflow/lite/interpreter.h>
@@ -368,6 +512,8 @@ int main(int argc, char *argv[])
 #include <tensorflow/lite/model.h>
 #include <tensorflow/lite/optional_debug_tools.h>
 #include "ModelRunner.h"
+#include "UtteranceUnderstanding.h"
+#include "WhisperCalibration.h"
 #include "InputHandler.h"
 #include "TaskProcessor.h"
 #include "HomeAssistantAPI.h"
@@ -392,6 +538,13 @@ bool use_homeassistant = false;
 bool use_terminal_input = false;
 
 int main_server_port = 15880;
+ServerParams network_params;
+ModelRunnerParams nlu_params;
+std::string whisper_tuning_path = "models/whisper_tuning.json";
+std::string whisper_calibration_dir;
+bool whisper_threads_set = false; // Explicit flags win over the tuning file
+bool whisper_states_set = false;
+bool whisper_beam_set = false;
 
 std::string homeassistant_ip;
 std::string homeassistant_token;
@@ -457,36 +610,20 @@ void terminalInputFunction(ModelRunner &nerModel, ModelRunner &classificationMod
             break;
         }
 
-        // Get entities from NER model
-        auto [_, predicted_entities] = nerModel.PredictlabelFromInput(user_input); // Ignore the first part
-
-        // Store the sentence and the entities
-        std::vector<std::pair<std::string, std::string>> sentence_entities;
-
-        std::istringstream iss(user_input);
-        std::string word;
-        int entity_index = 0;
-
-        while (iss >> word && entity_index < predicted_entities.size())
-        {
-            sentence_entities.push_back({word, predicted_entities[entity_index]});
-            entity_index++;
-        }
+        // Entities and intent from one split of the input, both models run at the same time
+        Utterance utterance = UnderstandUtterance(&nerModel, &classificationModel, user_input);
 
         // Output the sentence and its entities
         std::cout << "Sentence and Entities: " << std::endl;
-        for (const auto &pair : sentence_entities)
+        for (const EntitySpan &entity : utterance.entities)
         {
-            std::cout << "Word: " << pair.first << " -> Entity: " << pair.second << std::endl;
+            std::cout << "Entity: " << entity.text << " -> " << entity.type << " (" << entity.confidence << ")" << std::endl;
         }
-
-        // Get intent from Classification model
-        std::string sentence_label = classificationModel.ClassifySentence(user_input);
-        std::cout << "Intent: " << sentence_label << std::endl;
+        std::cout << "Intent: " << utterance.intent << " (" << utterance.confidence << ")" << std::endl;
 
         // Convert predicted intent to Task::TaskType
-        Task::TaskType taskType = stringToTaskType(sentence_label);
-        Task task(sentence_label, 1, device, taskType, {predicted_entities});
+        Task::TaskType taskType = stringToTaskType(utterance.intent);
+        Task task(utterance.intent, 1, device, taskType, utterance.EntityList());
 
         inputHandler.addTask(task);
         taskProcessor.processTask(task);
@@ -553,6 +690,192 @@ int main(int argc, char *argv[])
                 }
             }
 
+            if (std::string(argv[i]) == "-network-io-threads")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.io_threads = std::max<int>(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-network-backlog")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.listen_backlog = std::max<int>(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-network-reuseport")
+            {
+                network_params.reuseport_listeners = true;
+            }
+
+            if (std::string(argv[i]) == "-network-pin-threads")
+            {
+                network_params.pin_reactors = true;
+            }
+
+            if (std::string(argv[i]) == "-whisper-states")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.transcriber_states = std::max<int>(1, std::atoi(argv[i + 1]));
+                    whisper_states_set = true;
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-threads")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.transcriber_threads = std::max<int>(1, std::atoi(argv[i + 1]));
+                    whisper_threads_set = true;
+                }
+            }
+
+            if (std::string(argv[i]) == "-nlu-interpreters")
+            {
+                if (i + 1 < argc)
+                {
+                    nlu_params.interpreters = std::max<int>(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-nlu-threads")
+            {
+                if (i + 1 < argc)
+                {
+                    nlu_params.threads_per_interpreter = std::max<int>(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-nlu-xnnpack")
+            {
+                nlu_params.xnnpack = true;
+            }
+
+            if (std::string(argv[i]) == "-nlu-xnnpack-threads")
+            {
+                if (i + 1 < argc)
+                {
+                    nlu_params.xnnpack = true;
+                    nlu_params.xnnpack_threads = std::max<int>(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-nlu-batch-delay-us")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.intent_batch_delay_us = std::max<int>(0, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-beam-size")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.transcriber_beam_size = std::max<int>(0, std::atoi(argv[i + 1]));
+                    whisper_beam_set = true;
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-tuning")
+            {
+                if (i + 1 < argc)
+                {
+                    whisper_tuning_path = argv[i + 1];
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-calibrate")
+            {
+                if (i + 1 < argc)
+                {
+                    whisper_calibration_dir = argv[i + 1];
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-model")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.transcriber_model = argv[i + 1];
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-fast-model")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.transcriber_fast_model = argv[i + 1];
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-fast-max-ms")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.transcriber_fast_max_ms = std::max<int>(0, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-fast-confidence")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.transcriber_fast_min_confidence = std::min(1.0f, std::max(0.0f, static_cast<float>(std::atof(argv[i + 1]))));
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-live-step-ms")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.live_step_ms = std::max<int>(100, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-whisper-no-live")
+            {
+                network_params.live_transcription = false;
+            }
+
+            if (std::string(argv[i]) == "-no-silence-trim")
+            {
+                network_params.trim_silence = false;
+            }
+
+            if (std::string(argv[i]) == "-network-workers")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.worker_threads = std::max<int>(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-network-queue-depth")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.max_queue_depth = std::max<int>(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-network-queue-wait-ms")
+            {
+                if (i + 1 < argc)
+                {
+                    network_params.max_queue_wait_ms = std::max<int>(1, std::atoi(argv[i + 1]));
+                }
+            }
+
+            if (std::string(argv[i]) == "-audio-benchmark")
+            {
+                return runAudioConvertBenchmark() ? 0 : 1;
+            }
+
             if (std::string(argv[i]) == "-homeassistant")
             {
                 use_homeassistant = true;
@@ -582,6 +905,31 @@ int main(int argc, char *argv[])
                           << "  -network-port <port>: Set the network port\n"
                           << "  -web-server-port <port>: Set the web server port\n"
                           << "  -threads <number>: Set the number of threads\n"
+                          << "  -network-io-threads <number>: Set the number of network reactor threads\n"
+                          << "  -network-backlog <number>: Set how many pending connections each listening socket queues\n"
+                          << "  -network-reuseport: Give every reactor thread its own SO_REUSEPORT listening socket\n"
+                          << "  -network-pin-threads: Pin each reactor thread to its own core\n"
+                          << "  -network-workers <number>: Set the number of sound processing workers\n"
+                          << "  -network-queue-depth <number>: Set how many utterances may wait before new ones are rejected\n"
+                          << "  -network-queue-wait-ms <ms>: Drop utterances that waited longer than this\n"
+                          << "  -whisper-states <number>: Set how many utterances are transcribed in parallel on one loaded model\n"
+                          << "  -whisper-threads <number>: Set the number of threads each transcription uses\n"
+                          << "  -nlu-interpreters <number>: Set how many NER and classification inferences run in parallel per model\n"
+                          << "  -nlu-threads <number>: Set the number of threads each NER or classification inference uses\n"
+                          << "  -nlu-xnnpack: Run the NER and classification models through the XNNPACK delegate\n"
+                          << "  -nlu-xnnpack-threads <number>: Enable XNNPACK with this many threads per inference\n"
+                          << "  -nlu-batch-delay-us <us>: Let transcripts wait this long to be classified together, 0 to classify each alone\n"
+                          << "  -whisper-beam-size <number>: Decode with beam search of this width, 0 for greedy\n"
+                          << "  -whisper-tuning <path>: Read the Whisper tuning from this file (default models/whisper_tuning.json)\n"
+                          << "  -whisper-calibrate <clip dir>: Benchmark Whisper settings on the WAV clips in the directory, write the tuning file and exit\n"
+                          << "  -whisper-model <path>: Set the main Whisper model\n"
+                          << "  -whisper-fast-model <path>: Try short utterances on this smaller model first, e.g. a tiny.en model\n"
+                          << "  -whisper-fast-max-ms <ms>: Send utterances longer than this straight to the main model\n"
+                          << "  -whisper-fast-confidence <0-1>: Decode fast transcripts below this mean token probability again on the main model\n"
+                          << "  -whisper-live-step-ms <ms>: Decode streamed utterances again after this much new audio\n"
+                          << "  -whisper-no-live: Transcribe streamed utterances only once they are complete\n"
+                          << "  -no-silence-trim: Transcribe uploads as they are instead of cutting out silence first\n"
+                          << "  -audio-benchmark: Time the scalar and SIMD audio conversion kernels and exit\n"
                           << "  -homeassistant <ip> <port> <token>: Enable Home Assistant integration\n"
                           << "  -start-web-server: Start the web server\n"
                           << "  -web-server-secure <cert> <key>: Start the web server with SSL using the provided certificate and key\n"
@@ -591,6 +939,27 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Calibration runs with the model flags given so far, the remaining server never starts
+    if (!whisper_calibration_dir.empty())
+    {
+        WhisperTranscriber::Params transcriberParams;
+        transcriberParams.model_path = network_params.transcriber_model;
+        WhisperCalibrationParams calibrationParams;
+        calibrationParams.clip_dir = whisper_calibration_dir;
+        calibrationParams.output_path = whisper_tuning_path;
+        return runWhisperCalibration(transcriberParams, calibrationParams) ? 0 : 1;
+    }
+
+    WhisperTuning whisper_tuning;
+    if (loadWhisperTuning(whisper_tuning_path, whisper_tuning))
+    {
+        network_params.transcriber_threads = whisper_threads_set ? network_params.transcriber_threads : whisper_tuning.n_threads;
+        network_params.transcriber_states = whisper_states_set ? network_params.transcriber_states : whisper_tuning.n_states;
+        network_params.transcriber_beam_size = whisper_beam_set ? network_params.transcriber_beam_size : whisper_tuning.beam_size;
+        std::cout << "Whisper tuning loaded from " << whisper_tuning_path << ": " << network_params.transcriber_threads
+                  << " thread(s) x " << network_params.transcriber_states << " state(s)" << std::endl;
+    }
+
     if (use_web_server)
     {
         webServerThread = std::thread(setup_server, web_server_secure, web_server_cert_path, web_server_key_path, web_server_port, threads);
@@ -621,8 +990,8 @@ int main(int argc, char *argv[])
     }
 
     // Initialize the model runners
-    ModelRunner NER_Model("./models/ner_model.tflite");
-    ModelRunner Classification_Model("./models/classification_model.tflite");
+    ModelRunner NER_Model("./models/ner_model.tflite", nlu_params);
+    ModelRunner Classification_Model("./models/classification_model.tflite", nlu_params);
 
     try
     {
@@ -649,7 +1018,8 @@ int main(int argc, char *argv[])
     try
     {
         DEBUG_PRINT("Starting NetworkManager as server.");
-        networkserver = new NetworkManager(main_server_port, nullptr, NetworkManager::Protocol::TCP, &NER_Model, &Classification_Model);
+        networkserver = new NetworkManager(main_server_port, nullptr, NetworkManager::Protocol::TCP, &NER_Model, &Classification_Model, network_params);
+        networkserver->setMetricsRegistry(registry);
         networkThread = std::thread(&NetworkManager::runServer, networkserver);
         DEBUG_PRINT("NetworkManager running.");
     }
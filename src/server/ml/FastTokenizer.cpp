@@ -0,0 +1,175 @@
+#include "FastTokenizer.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace
+{
+    constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+    constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+    // Whitespace plus the default filters of the Keras tokenizer the vocabularies were fit with
+    const std::array<bool, 256> kSeparators = []
+    {
+        std::array<bool, 256> table{};
+        for (unsigned char c : std::string_view(" \t\n\r\v\f!\"#$%&()*+,-./:;<=>?@[\\]^_`{|}~"))
+        {
+            table[c] = true;
+        }
+        return table;
+    }();
+
+    inline bool isSeparator(char c)
+    {
+        return kSeparators[static_cast<unsigned char>(c)];
+    }
+
+    // ASCII only, multi-byte UTF-8 sequences pass through untouched
+    inline char lower(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? char(c + ('a' - 'A')) : c;
+    }
+
+    inline uint64_t hashStep(uint64_t hash, char c)
+    {
+        return (hash ^ static_cast<unsigned char>(c)) * kFnvPrime;
+    }
+
+    std::string lowercase(std::string_view word)
+    {
+        std::string result(word);
+        std::transform(result.begin(), result.end(), result.begin(), lower);
+        return result;
+    }
+
+    uint64_t hashWord(std::string_view word)
+    {
+        uint64_t hash = kFnvOffset;
+        for (char c : word)
+        {
+            hash = hashStep(hash, c);
+        }
+        return hash;
+    }
+}
+
+void FastTokenizer::Split(std::string_view text, TokenizedText &out)
+{
+    out.count = 0;
+    out.truncated = false;
+    size_t written = 0;
+
+    // One pass: skip separators, then lowercase, copy and hash the word in the same loop
+    size_t i = 0;
+    while (true)
+    {
+        while (i < text.size() && isSeparator(text[i]))
+        {
+            ++i;
+        }
+        if (i == text.size())
+        {
+            break;
+        }
+        if (out.count == TokenizedText::kMaxWords)
+        {
+            out.truncated = true;
+            break;
+        }
+
+        const size_t begin = i;
+        const size_t offset = written;
+        uint64_t hash = kFnvOffset;
+        for (; i < text.size() && !isSeparator(text[i]); ++i)
+        {
+            char c = lower(text[i]);
+            hash = hashStep(hash, c);
+            if (written < TokenizedText::kMaxChars)
+            {
+                out.normalized[written++] = c;
+            }
+        }
+        if (written - offset != i - begin)
+        {
+            out.truncated = true; // The word did not fit, a partial word would look up the wrong index
+            break;
+        }
+
+        TokenizedText::Word &word = out.words[out.count++];
+        word.source = uint32_t(begin);
+        word.source_length = uint32_t(i - begin);
+        word.offset = uint16_t(offset);
+        word.length = uint16_t(written - offset);
+        word.hash = hash;
+    }
+}
+
+void FastTokenizer::Build(const std::unordered_map<std::string, int> &word_index)
+{
+    size_t capacity = 16;
+    while (capacity < word_index.size() * 2)
+    {
+        capacity *= 2;
+    }
+    slots_.assign(capacity, Slot{0, 0, 0, -1});
+    mask_ = capacity - 1;
+    arena_.clear();
+    size_ = 0;
+
+    for (const auto &[word, id] : word_index)
+    {
+        if (word.empty())
+        {
+            continue;
+        }
+        std::string normalized = lowercase(word);
+        uint64_t hash = hashWord(normalized);
+        if (Lookup(normalized, hash) >= 0)
+        {
+            continue;
+        }
+
+        size_t slot = hash & mask_;
+        while (slots_[slot].length != 0)
+        {
+            slot = (slot + 1) & mask_;
+        }
+        slots_[slot] = Slot{hash, uint32_t(arena_.size()), uint32_t(normalized.size()), int32_t(id)};
+        arena_ += normalized;
+        ++size_;
+    }
+}
+
+int32_t FastTokenizer::Find(std::string_view word) const
+{
+    std::string normalized = lowercase(word);
+    return Lookup(normalized, hashWord(normalized));
+}
+
+int32_t FastTokenizer::Lookup(std::string_view word, uint64_t hash) const
+{
+    if (slots_.empty())
+    {
+        return -1;
+    }
+    for (size_t slot = hash & mask_; slots_[slot].length != 0; slot = (slot + 1) & mask_)
+    {
+        const Slot &candidate = slots_[slot];
+        if (candidate.hash == hash && candidate.length == word.size() && std::memcmp(arena_.data() + candidate.offset, word.data(), word.size()) == 0)
+        {
+            return candidate.id;
+        }
+    }
+    return -1;
+}
+
+void FastTokenizer::Encode(const TokenizedText &text, int32_t *ids, size_t length, int32_t unknown) const
+{
+    const size_t words = std::min(length, text.count);
+    for (size_t i = 0; i < words; ++i)
+    {
+        int32_t id = Lookup(text.Normalized(i), text.words[i].hash);
+        ids[i] = id >= 0 ? id : unknown;
+    }
+    std::fill(ids + words, ids + length, 0);
+}
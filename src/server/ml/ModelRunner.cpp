@@ -1,30 +1,204 @@
 #include "ModelRunner.h"
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <stdexcept>
 #include <cstring>
+#include <cmath>
+#include <limits>
 #include <algorithm>
 #include <nlohmann/json.hpp>
+#include <tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h>
 
-ModelRunner::ModelRunner(const std::string &model_path)
+namespace
+{
+    // IEEE 754 half precision, for models exported with fp16 inputs or outputs
+    float halfToFloat(uint16_t half)
+    {
+        const uint32_t sign = uint32_t(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1f;
+        uint32_t mantissa = half & 0x3ff;
+        uint32_t bits;
+        if (exponent == 0x1f)
+        {
+            bits = sign | 0x7f800000 | (mantissa << 13); // Infinity or NaN
+        }
+        else if (exponent != 0)
+        {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        else if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Subnormal half, normal as a float
+            exponent = 113;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint16_t sign = (bits >> 16) & 0x8000;
+        const int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+        const uint32_t mantissa = bits & 0x7fffff;
+        if (exponent >= 0x1f)
+        {
+            return sign | 0x7c00;
+        }
+        if (exponent <= 0)
+        {
+            return sign; // Too small for a normal half, token indices never get here
+        }
+        uint16_t half = uint16_t(sign | (exponent << 10) | (mantissa >> 13));
+        if (mantissa & 0x1000)
+        {
+            ++half; // Round to nearest, a carry moves into the exponent as it should
+        }
+        return half;
+    }
+
+    template <typename T>
+    T quantize(float value, const TfLiteQuantizationParams &params)
+    {
+        const float scaled = params.scale > 0 ? value / params.scale : value;
+        const long quantized = std::lround(scaled) + params.zero_point;
+        return static_cast<T>(std::clamp<long>(quantized, std::numeric_limits<T>::min(), std::numeric_limits<T>::max()));
+    }
+
+    // Writes token indices into the row of an input tensor that does not take int32 directly
+    void writeInputRow(TfLiteTensor &tensor, size_t offset, const std::vector<int32_t> &ids)
+    {
+        switch (tensor.type)
+        {
+        case kTfLiteFloat32:
+            std::copy(ids.begin(), ids.end(), tensor.data.f + offset);
+            break;
+        case kTfLiteFloat16:
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                tensor.data.f16[offset + i].data = floatToHalf(float(ids[i]));
+            }
+            break;
+        case kTfLiteInt8:
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                tensor.data.int8[offset + i] = quantize<int8_t>(float(ids[i]), tensor.params);
+            }
+            break;
+        case kTfLiteUInt8:
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                tensor.data.uint8[offset + i] = quantize<uint8_t>(float(ids[i]), tensor.params);
+            }
+            break;
+        // Add more cases if your models use different types
+        default:
+            throw std::runtime_error("Unsupported input tensor type");
+        }
+    }
+
+    // Reads the first count values of a non-float32 output tensor as floats
+    void readOutput(const TfLiteTensor &tensor, size_t count, std::vector<float> &values)
+    {
+        values.resize(count);
+        switch (tensor.type)
+        {
+        case kTfLiteFloat16:
+            for (size_t i = 0; i < count; ++i)
+            {
+                values[i] = halfToFloat(tensor.data.f16[i].data);
+            }
+            break;
+        case kTfLiteInt8:
+            for (size_t i = 0; i < count; ++i)
+            {
+                values[i] = (int32_t(tensor.data.int8[i]) - tensor.params.zero_point) * tensor.params.scale;
+            }
+            break;
+        case kTfLiteUInt8:
+            for (size_t i = 0; i < count; ++i)
+            {
+                values[i] = (int32_t(tensor.data.uint8[i]) - tensor.params.zero_point) * tensor.params.scale;
+            }
+            break;
+        default:
+            throw std::runtime_error("Unsupported output tensor type");
+        }
+    }
+}
+
+ModelRunner::ModelRunner(const std::string &model_path, const ModelRunnerParams &params)
 {
     model_ = tflite::FlatBufferModel::BuildFromFile(model_path.c_str());
     if (!model_)
     {
         throw std::runtime_error("Failed to load model: " + model_path);
     }
+
+    // Interpreters only add their own tensor arena, the weights stay in the shared flatbuffer
     tflite::ops::builtin::BuiltinOpResolver resolver;
-    tflite::InterpreterBuilder(*model_, resolver)(&interpreter_);
-    if (!interpreter_)
+    for (int i = 0; i < std::max(1, params.interpreters); ++i)
     {
-        throw std::runtime_error("Failed to build interpreter for model: " + model_path);
+        std::unique_ptr<tflite::Interpreter> interpreter;
+        tflite::InterpreterBuilder(*model_, resolver)(&interpreter, std::max(1, params.threads_per_interpreter));
+        if (!interpreter)
+        {
+            throw std::runtime_error("Failed to build interpreter for model: " + model_path);
+        }
+
+        if (params.xnnpack)
+        {
+            // One delegate per interpreter, a delegate's thread pool serves one Invoke() at a time
+            TfLiteXNNPackDelegateOptions options = TfLiteXNNPackDelegateOptionsDefault();
+            options.num_threads = std::max(1, params.xnnpack_threads > 0 ? params.xnnpack_threads : params.threads_per_interpreter);
+            tflite::Interpreter::TfLiteDelegatePtr delegate(TfLiteXNNPackDelegateCreate(&options), TfLiteXNNPackDelegateDelete);
+            if (!delegate || interpreter->ModifyGraphWithDelegate(delegate.get()) != kTfLiteOk)
+            {
+                std::cerr << "XNNPACK delegate not applied, running " << model_path << " on the builtin kernels" << std::endl;
+            }
+            else
+            {
+                delegates_.push_back(std::move(delegate));
+            }
+        }
+
+        if (interpreter->AllocateTensors() != kTfLiteOk)
+        {
+            throw std::runtime_error("Failed to allocate tensors for model: " + model_path);
+        }
+        free_interpreters_.push_back(interpreter.get());
+        interpreters_.push_back(std::move(interpreter));
     }
+}
 
-    if (interpreter_->AllocateTensors() != kTfLiteOk)
+ModelRunner::InterpreterLease::InterpreterLease(ModelRunner &owner) : owner_(owner), interpreter_(nullptr)
+{
+    std::unique_lock<std::mutex> lock(owner_.pool_mutex_);
+    owner_.interpreter_returned_.wait(lock, [this]
+                                      { return !owner_.free_interpreters_.empty(); });
+    interpreter_ = owner_.free_interpreters_.back();
+    owner_.free_interpreters_.pop_back();
+}
+
+ModelRunner::InterpreterLease::~InterpreterLease()
+{
     {
-        throw std::runtime_error("Failed to allocate tensors for model: " + model_path);
+        std::lock_guard<std::mutex> lock(owner_.pool_mutex_);
+        owner_.free_interpreters_.push_back(interpreter_);
     }
+    owner_.interpreter_returned_.notify_one();
 }
 
 bool ModelRunner::IsLoaded() const
@@ -51,13 +225,16 @@ void ModelRunner::LoadTokenizer(const std::string &tokenizer_json_path)
         tokenizer_index_word_[index] = word;
     }
 
+    std::unordered_map<std::string, int> tokenizer_word_index;
     auto word_index = tokenizer_json["word_index"];
     for (auto it = word_index.begin(); it != word_index.end(); ++it)
     {
         std::string word = it.key();
         int index = it.value();
-        tokenizer_word_index_[word] = index;
+        tokenizer_word_index[word] = index;
     }
+    vocabulary_.Build(tokenizer_word_index);
+    unknown_index_ = std::max(0, vocabulary_.Find("<UNK>"));
 
     if (tokenizer_json.contains("max_len"))
     {
@@ -94,213 +271,265 @@ void ModelRunner::LoadLabels(const std::string &labels_path)
 
 bool ModelRunner::RunInference(const std::string &input_text, std::vector<std::vector<float>> &result)
 {
-    if (!IsLoaded())
-    {
-        throw std::runtime_error("Model not loaded.");
-    }
+    TokenizedText text;
+    FastTokenizer::Split(input_text, text);
+    return RunInference(text, result);
+}
 
-    // Tokenize input
-    std::vector<int> tokenized_input = TokenizeInput(input_text);
+bool ModelRunner::RunInference(const TokenizedText &text, std::vector<std::vector<float>> &result)
+{
+    std::vector<std::vector<std::vector<float>>> results;
+    RunBatchInference(&text, 1, results);
+    result = std::move(results[0]);
+    return true;
+}
 
-    TfLiteTensor *input_tensor = interpreter_->tensor(interpreter_->inputs()[0]);
-    if (input_tensor == nullptr)
+bool ModelRunner::RunBatchInference(const std::vector<std::string> &inputs, std::vector<std::vector<std::vector<float>>> &results)
+{
+    std::vector<TokenizedText> texts(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
     {
-        throw std::runtime_error("Failed to get input tensor");
+        FastTokenizer::Split(inputs[i], texts[i]);
     }
+    return RunBatchInference(texts.data(), texts.size(), results);
+}
 
-    // Determine the data type of the input tensor
-    switch (input_tensor->type)
-    {
-    case kTfLiteInt32:
-    {
-        std::memcpy(input_tensor->data.raw, tokenized_input.data(), tokenized_input.size() * sizeof(int));
-        break;
-    }
-    case kTfLiteFloat32:
-    {
-        // Convert tokenized_input to float
-        std::vector<float> float_input(tokenized_input.begin(), tokenized_input.end());
-        std::memcpy(input_tensor->data.f, float_input.data(), float_input.size() * sizeof(float));
-        break;
-    }
-    // Add more cases if your models use different types
-    default:
-    {
-        throw std::runtime_error("Unsupported input tensor type");
-    }
-    }
+bool ModelRunner::RunBatchInference(const TokenizedText *texts, size_t count, std::vector<std::vector<std::vector<float>>> &results)
+{
+    results.assign(count, {});
+    RunBatchInference(texts, count, [&results](size_t index, const TensorView &rows)
+                      {
+                          std::vector<std::vector<float>> &result = results[index];
+                          result.resize(rows.Rows());
+                          for (size_t j = 0; j < rows.Rows(); ++j)
+                          {
+                              result[j].assign(rows.Row(j), rows.Row(j) + rows.Cols());
+                          } });
+    return true;
+}
 
-    // Invoke the interpreter
-    if (interpreter_->Invoke() != kTfLiteOk)
+void ModelRunner::RunBatchInference(const TokenizedText *texts, size_t count_texts, const OutputConsumer &consume)
+{
+    if (!IsLoaded())
     {
-        throw std::runtime_error("Failed to invoke TFLite interpreter");
+        throw std::runtime_error("Model not loaded.");
     }
-
-    TfLiteTensor *output_tensor = interpreter_->tensor(interpreter_->outputs()[0]);
-    if (output_tensor == nullptr)
+    if (count_texts == 0)
     {
-        throw std::runtime_error("Failed to get output tensor");
+        return;
     }
 
-    // Debug: Print output tensor information
-    std::cout << "Output Tensor Type: " << output_tensor->type << std::endl;
-    std::cout << "Output Tensor Dimensions: ";
-    for (int i = 0; i < output_tensor->dims->size; ++i)
-    {
-        std::cout << output_tensor->dims->data[i] << " ";
-    }
-    std::cout << std::endl;
+    // The interpreter stays leased until every view into its output has been consumed
+    InterpreterLease interpreter(*this);
+    std::vector<float> dequantized;
 
-    // Handle different output tensor shapes based on the model type
-    if (output_tensor->type == kTfLiteFloat32)
+    // Models exported with a fixed batch of one cannot be resized, they get one Invoke() per sentence
+    size_t rows = batch_resizable_ ? count_texts : 1;
+    for (size_t first = 0; first < count_texts; first += rows)
     {
-        if (output_tensor->dims->size == 2)
+        size_t count = std::min(rows, count_texts - first);
+        TfLiteTensor *input_tensor = PrepareInput(*interpreter.get(), count);
+        if (input_tensor == nullptr)
         {
-            int batch_size = output_tensor->dims->data[0];
-            int num_classes = output_tensor->dims->data[1];
-            result.resize(batch_size, std::vector<float>(num_classes));
-            for (int i = 0; i < batch_size; ++i)
+            rows = 1;
+            count = 1;
+            input_tensor = PrepareInput(*interpreter.get(), 1);
+            if (input_tensor == nullptr)
             {
-                std::memcpy(result[i].data(), output_tensor->data.f + i * num_classes, num_classes * sizeof(float));
+                throw std::runtime_error("Failed to get input tensor");
             }
         }
-        else if (output_tensor->dims->size == 3)
+
+        // Rows past the end of the batch stay zero padded, their output is ignored
+        std::memset(input_tensor->data.raw, 0, input_tensor->bytes);
+        switch (input_tensor->type)
         {
-            // Assuming NER model output: [batch_size, sequence_length, num_entities]
-            int batch_size = output_tensor->dims->data[0];
-            int sequence_length = output_tensor->dims->data[1];
-            int num_entities = output_tensor->dims->data[2];
-            result.resize(sequence_length, std::vector<float>(num_entities));
-            for (int i = 0; i < sequence_length; ++i)
+        case kTfLiteInt32:
+        {
+            // Token indices go straight into the tensor rows
+            for (size_t i = 0; i < count; ++i)
             {
-                std::memcpy(result[i].data(), output_tensor->data.f + i * num_entities, num_entities * sizeof(float));
+                vocabulary_.Encode(texts[first + i], input_tensor->data.i32 + i * max_length_, max_length_, unknown_index_);
             }
+            break;
         }
-        else
+        default:
         {
-            throw std::runtime_error("Unexpected output tensor dimensions");
+            // Float, fp16 or quantized input: encode, then convert with the tensor's own parameters
+            std::vector<int32_t> ids(max_length_);
+            for (size_t i = 0; i < count; ++i)
+            {
+                vocabulary_.Encode(texts[first + i], ids.data(), ids.size(), unknown_index_);
+                writeInputRow(*input_tensor, i * max_length_, ids);
+            }
+            break;
+        }
         }
-    }
-    else
-    {
-        throw std::runtime_error("Unsupported output tensor type");
-    }
 
-    return true;
-}
+        // Invoke the interpreter
+        if (interpreter->Invoke() != kTfLiteOk)
+        {
+            throw std::runtime_error("Failed to invoke TFLite interpreter");
+        }
 
-std::vector<int> ModelRunner::TokenizeInput(const std::string &input_text)
-{
-    std::vector<int> tokenized_input(max_length_, 0);
-    std::istringstream iss(input_text);
-    std::string word;
-    int index = 0;
+        const TfLiteTensor *output_tensor = interpreter->tensor(interpreter->outputs()[0]);
+        if (output_tensor == nullptr)
+        {
+            throw std::runtime_error("Failed to get output tensor");
+        }
 
-    while (iss >> word && index < max_length_)
-    {
-        if (tokenizer_word_index_.find(word) != tokenizer_word_index_.end())
+        // Classification output is [batch_size, num_classes], one row per sentence;
+        // NER output is [batch_size, sequence_length, num_entities], one row per token
+        size_t sequence_length;
+        size_t columns;
+        if (output_tensor->dims->size == 2)
         {
-            tokenized_input[index++] = tokenizer_word_index_[word];
+            sequence_length = 1;
+            columns = output_tensor->dims->data[1];
+        }
+        else if (output_tensor->dims->size == 3)
+        {
+            sequence_length = output_tensor->dims->data[1];
+            columns = output_tensor->dims->data[2];
         }
         else
         {
-            tokenized_input[index++] = tokenizer_word_index_["<UNK>"];
+            throw std::runtime_error("Unexpected output tensor dimensions");
         }
-    }
 
-    if (tokenized_input.size() > max_length_)
-    {
-        throw std::length_error("Tokenized input size is too large");
+        // Float output is viewed in place, anything else is converted once for the whole batch
+        const size_t values = sequence_length * columns;
+        const float *output = output_tensor->data.f;
+        if (output_tensor->type != kTfLiteFloat32)
+        {
+            readOutput(*output_tensor, count * values, dequantized);
+            output = dequantized.data();
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            consume(first + i, TensorView(output + i * values, sequence_length, columns));
+        }
     }
-
-    return tokenized_input;
 }
 
-std::pair<std::string, std::vector<std::string>> ModelRunner::PredictlabelFromInput(const std::string &input)
+TfLiteTensor *ModelRunner::PrepareInput(tflite::Interpreter &interpreter, size_t rows)
 {
-    std::vector<std::vector<float>> results;
-
-    // Run inference on the input text to get NER predictions
-    if (!RunInference(input, results))
+    const int input_index = interpreter.inputs()[0];
+    TfLiteTensor *input_tensor = interpreter.tensor(input_index);
+    if (input_tensor == nullptr || input_tensor->dims->size != 2)
     {
-        throw std::runtime_error("Failed to run inference on input: " + input);
+        // Without a [batch, length] input there is nothing to resize, one sentence at a time
+        batch_resizable_ = batch_resizable_ && rows <= 1;
+        return rows <= 1 ? input_tensor : nullptr;
     }
 
-    std::string task_description = "Entities Extracted";
-    std::vector<std::string> entity_descriptions;
-
-    // Tokenize the input text into words
-    std::istringstream iss(input);
-    std::vector<std::string> words;
-    std::string word;
-    while (iss >> word)
+    // Batches are rounded up to a power of two so an interpreter only reallocates for a few shapes
+    int batch_rows = 1;
+    while (size_t(batch_rows) < rows)
     {
-        words.push_back(word);
+        batch_rows *= 2;
     }
-
-    // Check if the number of words matches the result size (predicted entities)
-    if (words.size() > results.size())
+    if (input_tensor->dims->data[0] == batch_rows && input_tensor->dims->data[1] == max_length_)
     {
-        std::cerr << "Warning: Fewer predictions than words in the input text." << std::endl;
+        return input_tensor;
     }
 
-    // Map each word to its predicted NER label
-    for (int i = 0; i < words.size(); ++i)
+    if (interpreter.ResizeInputTensor(input_index, {batch_rows, max_length_}) != kTfLiteOk || interpreter.AllocateTensors() != kTfLiteOk)
     {
-        // Ensure we do not exceed the number of predictions
-        if (i >= results.size())
-            break;
+        if (batch_rows > 1)
+        {
+            std::cerr << "Model does not accept batches, running sentences one at a time" << std::endl;
+            batch_resizable_ = false;
+        }
+        return nullptr;
+    }
+    return interpreter.tensor(input_index);
+}
 
-        // Find the predicted entity index with the highest probability
-        int predicted_entity_index = std::distance(results[i].begin(), std::max_element(results[i].begin(), results[i].end()));
-        float predicted_probability = results[i][predicted_entity_index];
+std::pair<std::string, std::vector<std::string>> ModelRunner::PredictlabelFromInput(const std::string &input)
+{
+    // The words the labels are reported for are the ones the model saw
+    TokenizedText text;
+    FastTokenizer::Split(input, text);
 
-        // Debug: Print the word and the predicted entity
-        std::cout << "Word: " << words[i]
-                  << " -> Predicted entity index: " << predicted_entity_index
-                  << " with probability: " << predicted_probability << std::endl;
+    std::string task_description = "Entities Extracted";
+    std::vector<std::string> entity_descriptions;
 
-        // Only add the predicted label if the confidence is high enough (e.g., > 0.5)
-        if (predicted_probability > 0.5 && labels_.find(predicted_entity_index) != labels_.end())
+    // Run inference on the input text to get NER predictions, read in place from the output tensor
+    RunBatchInference(&text, 1, [&](size_t, const TensorView &results)
+                      {
+        // Check if the number of words matches the result size (predicted entities)
+        if (text.count > results.Rows())
         {
-            std::string predicted_label = labels_[predicted_entity_index];
-            entity_descriptions.push_back(words[i] + " (" + predicted_label + ")");
+            std::cerr << "Warning: Fewer predictions than words in the input text." << std::endl;
         }
-        else
+
+        // Map each word to its predicted NER label
+        const size_t words = std::min(text.count, results.Rows());
+        for (size_t i = 0; i < words; ++i)
         {
-            // If confidence is too low or the label is unknown, mark as "O" (outside entity)
-            entity_descriptions.push_back(words[i] + " (O)");
-        }
-    }
+            std::string word(text.Source(input, i));
+
+            // Find the predicted entity index with the highest probability
+            int predicted_entity_index = int(ArgMaxRow(results.Row(i), results.Cols()));
+            float predicted_probability = results(i, predicted_entity_index);
+
+            // Debug: Print the word and the predicted entity
+            std::cout << "Word: " << word
+                      << " -> Predicted entity index: " << predicted_entity_index
+                      << " with probability: " << predicted_probability << std::endl;
+
+            // Only add the predicted label if the confidence is high enough (e.g., > 0.5)
+            auto label = labels_.find(predicted_entity_index);
+            if (predicted_probability > 0.5 && label != labels_.end())
+            {
+                entity_descriptions.push_back(word + " (" + label->second + ")");
+            }
+            else
+            {
+                // If confidence is too low or the label is unknown, mark as "O" (outside entity)
+                entity_descriptions.push_back(word + " (O)");
+            }
+        } });
 
     return {task_description, entity_descriptions};
 }
 
 std::string ModelRunner::ClassifySentence(const std::string &input)
 {
-    std::vector<std::vector<float>> results;
-
-    // Run inference on the input text to get classification predictions
-    if (!RunInference(input, results))
-    {
-        throw std::runtime_error("Failed to run inference on input: " + input);
-    }
+    return ClassifySentences({input})[0];
+}
 
-    // Check if results are empty
-    if (results.empty() || results[0].empty())
+std::vector<std::string> ModelRunner::ClassifySentences(const std::vector<std::string> &inputs)
+{
+    std::vector<TokenizedText> texts(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
     {
-        std::cerr << "Inference results are empty for input: " << input << std::endl;
-        return "Unknown";
+        FastTokenizer::Split(inputs[i], texts[i]);
     }
 
-    // The results should contain a vector of probabilities for each class
-    const std::vector<float> &class_probabilities = results[0];
+    // Labelled straight from the output tensor, nothing is copied out
+    std::vector<std::string> labels(inputs.size(), "Unknown");
+    RunBatchInference(texts.data(), texts.size(), [&](size_t index, const TensorView &results)
+                      {
+        if (results.Empty())
+        {
+            std::cerr << "Inference results are empty for input: " << inputs[index] << std::endl;
+            return;
+        }
+        labels[index] = LabelClassification(results); });
+    return labels;
+}
 
+std::string ModelRunner::LabelClassification(const TensorView &results, float *confidence) const
+{
     // Find the class with the highest probability
-    int predicted_class_index = std::distance(class_probabilities.begin(),
-                                              std::max_element(class_probabilities.begin(),
-                                                               class_probabilities.end()));
-    float predicted_probability = class_probabilities[predicted_class_index];
+    int predicted_class_index = int(ArgMaxRow(results.Row(0), results.Cols()));
+    float predicted_probability = results(0, predicted_class_index);
+    if (confidence)
+    {
+        *confidence = predicted_probability;
+    }
 
     // Debug: Print the predicted class and probability
     std::cout << "Predicted class index: " << predicted_class_index
@@ -333,3 +562,49 @@ std::string ModelRunner::ClassifySentence(const std::string &input)
 
     return sentence_label;
 }
+
+std::vector<EntitySpan> ModelRunner::LabelEntities(std::string_view input, const TokenizedText &text, const TensorView &rows) const
+{
+    std::vector<EntitySpan> spans;
+    if (rows.Cols() == 0)
+    {
+        return spans;
+    }
+    bool open = false; // Whether the last span may still grow
+    const size_t words = std::min(text.count, rows.Rows());
+    for (size_t i = 0; i < words; ++i)
+    {
+        int predicted_entity_index = int(ArgMaxRow(rows.Row(i), rows.Cols()));
+        float predicted_probability = rows(i, predicted_entity_index);
+
+        // Same confidence threshold as PredictlabelFromInput, anything else is outside an entity
+        auto label = labels_.find(predicted_entity_index);
+        if (predicted_probability <= 0.5 || label == labels_.end() || label->second == "O")
+        {
+            open = false;
+            continue;
+        }
+
+        std::string_view type = label->second;
+        const bool begins = type.size() > 2 && type[0] == 'B' && type[1] == '-';
+        if (type.size() > 2 && (type[0] == 'B' || type[0] == 'I') && type[1] == '-')
+        {
+            type.remove_prefix(2);
+        }
+
+        const size_t begin = text.words[i].source;
+        const size_t end = begin + text.words[i].source_length;
+        if (open && !begins && spans.back().type == type)
+        {
+            EntitySpan &span = spans.back();
+            span.length = end - span.begin;
+            span.text = std::string(input.substr(span.begin, span.length));
+            span.confidence = std::min(span.confidence, predicted_probability);
+            continue;
+        }
+
+        spans.push_back({std::string(type), std::string(input.substr(begin, end - begin)), begin, end - begin, predicted_probability});
+        open = true;
+    }
+    return spans;
+}
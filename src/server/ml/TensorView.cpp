@@ -0,0 +1,288 @@
+#include "TensorView.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define TENSORVIEW_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TENSORVIEW_NEON 1
+#endif
+
+namespace
+{
+    // exp() for x <= 0 as in Cephes expf: x = n ln2 + r, exp(r) from a degree 6 polynomial
+    // on |r| <= ln2 / 2, then scaled by 2^n through the exponent bits. Relative error ~2e-7.
+    constexpr float kLog2e = 1.44269504088896341f;
+    constexpr float kLn2Hi = 0.693359375f;
+    constexpr float kLn2Lo = -2.12194440e-4f;
+    constexpr float kExpMin = -87.0f; // Below this 2^n is no longer a normal float
+    constexpr float kExpPoly[6] = {1.9875691500e-4f, 1.3981999507e-3f, 8.3334519073e-3f, 4.1665795894e-2f, 1.6666665459e-1f, 5.0000001201e-1f};
+
+#if defined(TENSORVIEW_SSE2)
+    inline __m128 exp4(__m128 x)
+    {
+        x = _mm_max_ps(x, _mm_set1_ps(kExpMin));
+        __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(kLog2e))); // Rounds to nearest
+        __m128 nf = _mm_cvtepi32_ps(n);
+        __m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(nf, _mm_set1_ps(kLn2Hi))), _mm_mul_ps(nf, _mm_set1_ps(kLn2Lo)));
+
+        __m128 y = _mm_set1_ps(kExpPoly[0]);
+        for (int i = 1; i < 6; ++i)
+        {
+            y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(kExpPoly[i]));
+        }
+        y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, r), r), r), _mm_set1_ps(1.0f));
+
+        __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+        return _mm_mul_ps(y, scale);
+    }
+#elif defined(TENSORVIEW_NEON)
+    inline float32x4_t exp4(float32x4_t x)
+    {
+        x = vmaxq_f32(x, vdupq_n_f32(kExpMin));
+
+        // vcvtq_s32_f32 truncates, floor(x log2e + 0.5) rounds to nearest on ARMv7 as well
+        float32x4_t fx = vmlaq_f32(vdupq_n_f32(0.5f), x, vdupq_n_f32(kLog2e));
+        int32x4_t n = vcvtq_s32_f32(fx);
+        uint32x4_t above = vcgtq_f32(vcvtq_f32_s32(n), fx);
+        n = vsubq_s32(n, vreinterpretq_s32_u32(vandq_u32(above, vdupq_n_u32(1))));
+        float32x4_t nf = vcvtq_f32_s32(n);
+        float32x4_t r = vmlsq_f32(vmlsq_f32(x, nf, vdupq_n_f32(kLn2Hi)), nf, vdupq_n_f32(kLn2Lo));
+
+        float32x4_t y = vdupq_n_f32(kExpPoly[0]);
+        for (int i = 1; i < 6; ++i)
+        {
+            y = vmlaq_f32(vdupq_n_f32(kExpPoly[i]), y, r);
+        }
+        y = vaddq_f32(vmlaq_f32(r, vmulq_f32(y, r), r), vdupq_n_f32(1.0f));
+
+        float32x4_t scale = vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(n, vdupq_n_s32(127)), 23));
+        return vmulq_f32(y, scale);
+    }
+#endif
+
+    float maxValue(const float *values, size_t count)
+    {
+        size_t i = 0;
+        float best = values[0];
+#if defined(TENSORVIEW_SSE2)
+        if (count >= 4)
+        {
+            __m128 lanes = _mm_loadu_ps(values);
+            for (i = 4; i + 4 <= count; i += 4)
+            {
+                lanes = _mm_max_ps(lanes, _mm_loadu_ps(values + i));
+            }
+            lanes = _mm_max_ps(lanes, _mm_movehl_ps(lanes, lanes));
+            lanes = _mm_max_ss(lanes, _mm_shuffle_ps(lanes, lanes, 1));
+            best = _mm_cvtss_f32(lanes);
+        }
+#elif defined(TENSORVIEW_NEON)
+        if (count >= 4)
+        {
+            float32x4_t lanes = vld1q_f32(values);
+            for (i = 4; i + 4 <= count; i += 4)
+            {
+                lanes = vmaxq_f32(lanes, vld1q_f32(values + i));
+            }
+            float32x2_t half = vpmax_f32(vget_low_f32(lanes), vget_high_f32(lanes));
+            best = vget_lane_f32(vpmax_f32(half, half), 0);
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            best = std::max(best, values[i]);
+        }
+        return best;
+    }
+}
+
+size_t ArgMaxRow(const float *values, size_t count)
+{
+    size_t i = 0;
+    size_t best = 0;
+
+#if defined(TENSORVIEW_SSE2) || defined(TENSORVIEW_NEON)
+    if (count >= 4)
+    {
+        // Every lane keeps the first maximum it sees, the lanes are merged afterwards
+        float laneValues[4];
+        int32_t laneIndices[4];
+#if defined(TENSORVIEW_SSE2)
+        __m128 bestValues = _mm_loadu_ps(values);
+        __m128i bestIndices = _mm_setr_epi32(0, 1, 2, 3);
+        __m128i indices = bestIndices;
+        for (i = 4; i + 4 <= count; i += 4)
+        {
+            indices = _mm_add_epi32(indices, _mm_set1_epi32(4));
+            __m128 v = _mm_loadu_ps(values + i);
+            __m128 greater = _mm_cmpgt_ps(v, bestValues);
+            __m128i take = _mm_castps_si128(greater);
+            bestValues = _mm_or_ps(_mm_and_ps(greater, v), _mm_andnot_ps(greater, bestValues));
+            bestIndices = _mm_or_si128(_mm_and_si128(take, indices), _mm_andnot_si128(take, bestIndices));
+        }
+        _mm_storeu_ps(laneValues, bestValues);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(laneIndices), bestIndices);
+#else
+        float32x4_t bestValues = vld1q_f32(values);
+        int32x4_t bestIndices = {0, 1, 2, 3};
+        int32x4_t indices = bestIndices;
+        for (i = 4; i + 4 <= count; i += 4)
+        {
+            indices = vaddq_s32(indices, vdupq_n_s32(4));
+            float32x4_t v = vld1q_f32(values + i);
+            uint32x4_t greater = vcgtq_f32(v, bestValues);
+            bestValues = vbslq_f32(greater, v, bestValues);
+            bestIndices = vbslq_s32(greater, indices, bestIndices);
+        }
+        vst1q_f32(laneValues, bestValues);
+        vst1q_s32(laneIndices, bestIndices);
+#endif
+        best = size_t(laneIndices[0]);
+        for (int lane = 1; lane < 4; ++lane)
+        {
+            const float value = laneValues[lane];
+            if (value > values[best] || (value == values[best] && size_t(laneIndices[lane]) < best))
+            {
+                best = size_t(laneIndices[lane]);
+            }
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        if (values[i] > values[best])
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+size_t TopKRow(const float *values, size_t count, size_t k, size_t *indices)
+{
+    k = std::min(k, count);
+    if (k == 0)
+    {
+        return 0;
+    }
+    if (k == 1)
+    {
+        indices[0] = ArgMaxRow(values, count);
+        return 1;
+    }
+
+    // indices[0, kept) stays sorted, largest first; a value enters only when it beats the last
+    size_t kept = 0;
+    auto offer = [&](size_t i)
+    {
+        if (kept == k && !(values[i] > values[indices[k - 1]]))
+        {
+            return;
+        }
+        size_t position = kept < k ? kept++ : k - 1;
+        while (position > 0 && values[i] > values[indices[position - 1]])
+        {
+            indices[position] = indices[position - 1];
+            --position;
+        }
+        indices[position] = i;
+    };
+
+    size_t i = 0;
+    for (; i < k; ++i)
+    {
+        offer(i);
+    }
+
+#if defined(TENSORVIEW_SSE2) || defined(TENSORVIEW_NEON)
+    // Most blocks hold nothing larger than the current k-th value and are skipped whole
+    for (; i + 4 <= count; i += 4)
+    {
+#if defined(TENSORVIEW_SSE2)
+        const bool candidate = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(values + i), _mm_set1_ps(values[indices[k - 1]]))) != 0;
+#else
+        uint32x4_t greater = vcgtq_f32(vld1q_f32(values + i), vdupq_n_f32(values[indices[k - 1]]));
+        uint32x2_t folded = vorr_u32(vget_low_u32(greater), vget_high_u32(greater));
+        const bool candidate = (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0;
+#endif
+        if (candidate)
+        {
+            for (size_t j = i; j < i + 4; ++j)
+            {
+                offer(j);
+            }
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        offer(i);
+    }
+    return k;
+}
+
+void SoftmaxRow(const float *values, size_t count, float *out)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // Shifting by the maximum keeps every exponent <= 0, the sum is then at least 1
+    const float shift = maxValue(values, count);
+    size_t i = 0;
+    float sum = 0.0f;
+
+#if defined(TENSORVIEW_SSE2)
+    __m128 sums = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 e = exp4(_mm_sub_ps(_mm_loadu_ps(values + i), _mm_set1_ps(shift)));
+        _mm_storeu_ps(out + i, e);
+        sums = _mm_add_ps(sums, e);
+    }
+    sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+    sums = _mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1));
+    sum = _mm_cvtss_f32(sums);
+#elif defined(TENSORVIEW_NEON)
+    float32x4_t sums = vdupq_n_f32(0.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t e = exp4(vsubq_f32(vld1q_f32(values + i), vdupq_n_f32(shift)));
+        vst1q_f32(out + i, e);
+        sums = vaddq_f32(sums, e);
+    }
+    float32x2_t half = vadd_f32(vget_low_f32(sums), vget_high_f32(sums));
+    sum = vget_lane_f32(vpadd_f32(half, half), 0);
+#endif
+
+    for (; i < count; ++i)
+    {
+        out[i] = std::exp(values[i] - shift);
+        sum += out[i];
+    }
+
+    const float scale = 1.0f / sum;
+    i = 0;
+#if defined(TENSORVIEW_SSE2)
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(out + i), _mm_set1_ps(scale)));
+    }
+#elif defined(TENSORVIEW_NEON)
+    for (; i + 4 <= count; i += 4)
+    {
+        vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(out + i), scale));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        out[i] *= scale;
+    }
+}
@@ -0,0 +1,206 @@
+#include "UtteranceUnderstanding.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    // One thread for the whole process runs the NER half of an utterance while the caller
+    // classifies. A job it has not started by the time the caller is done is taken back and
+    // run inline, so concurrent callers never wait behind each other's NER.
+    class NluThread
+    {
+    public:
+        struct Job
+        {
+            std::function<void()> run;
+            bool started = false;
+            bool done = false;
+            std::exception_ptr error;
+        };
+
+        static NluThread &instance()
+        {
+            static NluThread thread;
+            return thread;
+        }
+
+        void post(const std::shared_ptr<Job> &job)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(job);
+            changed_.notify_all();
+        }
+
+        // Blocks until job has run, here if the thread has not picked it up yet; rethrows what it threw
+        void wait(const std::shared_ptr<Job> &job)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!job->started)
+            {
+                job->started = true;
+                lock.unlock();
+                execute(*job);
+                lock.lock();
+            }
+            changed_.wait(lock, [&job]
+                          { return job->done; });
+            if (job->error)
+            {
+                std::rethrow_exception(job->error);
+            }
+        }
+
+    private:
+        NluThread() : thread_([this]
+                              { loop(); }) {}
+
+        ~NluThread()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+                changed_.notify_all();
+            }
+            thread_.join();
+        }
+
+        void execute(Job &job)
+        {
+            try
+            {
+                job.run();
+            }
+            catch (...)
+            {
+                job.error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            job.done = true;
+            changed_.notify_all();
+        }
+
+        void loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                changed_.wait(lock, [this]
+                              { return stopping_ || !jobs_.empty(); });
+                if (stopping_)
+                {
+                    return;
+                }
+                std::shared_ptr<Job> job = std::move(jobs_.front());
+                jobs_.pop_front();
+                if (job->started)
+                {
+                    continue; // Its caller ran it already
+                }
+                job->started = true;
+                lock.unlock();
+                execute(*job);
+                lock.lock();
+            }
+        }
+
+        std::mutex mutex_;
+        std::condition_variable changed_; // Job posted or finished, or stopping
+        std::deque<std::shared_ptr<Job>> jobs_;
+        bool stopping_ = false;
+        std::thread thread_; // Last, it starts running loop() as soon as it is constructed
+    };
+}
+
+std::vector<std::vector<std::string>> Utterance::EntityList() const
+{
+    std::vector<std::vector<std::string>> list;
+    list.reserve(entities.size());
+    for (const EntitySpan &entity : entities)
+    {
+        list.push_back({entity.type, entity.text});
+    }
+    return list;
+}
+
+Utterance UnderstandUtterance(ModelRunner *nerModel, ModelRunner *classificationModel, const std::string &input)
+{
+    return UnderstandUtterances(nerModel, classificationModel, {input})[0];
+}
+
+std::vector<Utterance> UnderstandUtterances(ModelRunner *nerModel, ModelRunner *classificationModel, const std::vector<std::string> &inputs)
+{
+    std::vector<Utterance> utterances(inputs.size());
+    if (inputs.empty())
+    {
+        return utterances;
+    }
+
+    // Both models see the same split, only the vocabulary lookup is per model
+    std::vector<TokenizedText> texts(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        FastTokenizer::Split(inputs[i], texts[i]);
+    }
+
+    const bool extract = nerModel && nerModel->IsLoaded();
+    const bool classify = classificationModel && classificationModel->IsLoaded();
+
+    // Both results are labelled straight from the output tensors. The two threads write
+    // different members of each Utterance, so they need no lock.
+    auto extractEntities = [&]
+    {
+        nerModel->RunBatchInference(texts.data(), texts.size(), [&](size_t index, const TensorView &rows)
+                                    { utterances[index].entities = nerModel->LabelEntities(inputs[index], texts[index], rows); });
+    };
+    auto classifyIntents = [&]
+    {
+        classificationModel->RunBatchInference(texts.data(), texts.size(), [&](size_t index, const TensorView &rows)
+                                               {
+            if (!rows.Empty())
+            {
+                utterances[index].intent = classificationModel->LabelClassification(rows, &utterances[index].confidence);
+            } });
+    };
+
+    if (!(extract && classify))
+    {
+        if (extract)
+        {
+            extractEntities();
+        }
+        if (classify)
+        {
+            classifyIntents();
+        }
+        return utterances;
+    }
+
+    // NER goes to the NLU thread while this one classifies. The job refers to locals, so it
+    // has to have finished before they go out of scope, also when classification throws.
+    NluThread &nlu = NluThread::instance();
+    auto entities = std::make_shared<NluThread::Job>();
+    entities->run = extractEntities;
+    nlu.post(entities);
+    try
+    {
+        classifyIntents();
+    }
+    catch (...)
+    {
+        try
+        {
+            nlu.wait(entities);
+        }
+        catch (...)
+        {
+        }
+        throw;
+    }
+    nlu.wait(entities);
+    return utterances;
+}
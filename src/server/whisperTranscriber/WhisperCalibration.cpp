@@ -0,0 +1,431 @@
+#include "WhisperCalibration.h"
+#include "AudioConvert.h"
+#include "Resampler.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <nlohmann/json.hpp>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Clip
+    {
+        std::string name;
+        std::vector<float> samples; // 16 kHz mono
+        std::vector<std::string> reference; // Normalized words of the transcript, empty without one
+    };
+
+    struct Measurement
+    {
+        WhisperTuning tuning;
+        double realTimeFactor; // Mean decode time over audio time of a single clip
+        double p50Ms;
+        double p95Ms;
+        double throughput;     // Seconds of audio transcribed per second with all states busy
+        double wordErrorRate;  // Negative when no clip has a transcript
+    };
+
+    uint32_t readLE32(const uint8_t *p)
+    {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+
+    uint16_t readLE16(const uint8_t *p)
+    {
+        return uint16_t(p[0]) | uint16_t(p[1]) << 8;
+    }
+
+    // Reads a PCM or IEEE float WAV file and converts it to 16 kHz mono
+    bool readWav(const std::string &path, std::vector<float> &samples)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (bytes.size() < 12 || std::memcmp(bytes.data(), "RIFF", 4) != 0 || std::memcmp(bytes.data() + 8, "WAVE", 4) != 0)
+        {
+            return false;
+        }
+
+        AudioFormat format;
+        format.sampleFormat = SampleFormat::Unknown;
+        const uint8_t *data = nullptr;
+        size_t dataLength = 0;
+        for (size_t offset = 12; offset + 8 <= bytes.size();)
+        {
+            const uint8_t *chunk = bytes.data() + offset;
+            size_t length = std::min<size_t>(readLE32(chunk + 4), bytes.size() - offset - 8);
+            if (std::memcmp(chunk, "fmt ", 4) == 0 && length >= 16)
+            {
+                uint16_t tag = readLE16(chunk + 8);
+                uint16_t bits = readLE16(chunk + 22);
+                if (tag == 0xFFFE && length >= 26)
+                {
+                    tag = readLE16(chunk + 32); // WAVE_FORMAT_EXTENSIBLE keeps the real tag in the sub-format
+                }
+                format.channels = uint8_t(readLE16(chunk + 10));
+                format.sampleRate = readLE32(chunk + 12);
+                if (tag == 1 && bits == 16)
+                {
+                    format.sampleFormat = SampleFormat::S16LE;
+                }
+                else if (tag == 1 && bits == 24)
+                {
+                    format.sampleFormat = SampleFormat::S24LE;
+                }
+                else if (tag == 1 && bits == 32)
+                {
+                    format.sampleFormat = SampleFormat::S32LE;
+                }
+                else if (tag == 3 && bits == 32)
+                {
+                    format.sampleFormat = SampleFormat::F32LE;
+                }
+            }
+            else if (std::memcmp(chunk, "data", 4) == 0)
+            {
+                data = chunk + 8;
+                dataLength = length;
+            }
+            offset += 8 + length + (length & 1);
+        }
+        if (!data || format.sampleFormat == SampleFormat::Unknown || format.channels == 0 || format.sampleRate == 0)
+        {
+            return false;
+        }
+
+        size_t frames = dataLength / (format.bytesPerSample() * format.channels);
+        std::vector<float> mono(frames);
+        convertToMonoFloat(data, frames, format, mono.data());
+        if (format.sampleRate == WHISPER_SAMPLE_RATE)
+        {
+            samples = std::move(mono);
+            return true;
+        }
+
+        // A little trailing silence pushes the filter delay out of the resampler
+        mono.resize(frames + format.sampleRate / 50, 0.0f);
+        Resampler resampler(format.sampleRate, WHISPER_SAMPLE_RATE);
+        samples.resize(resampler.maxOutputFrames(mono.size()));
+        samples.resize(resampler.process(mono.data(), mono.size(), samples.data()));
+        return true;
+    }
+
+    std::vector<std::string> normalizedWords(const std::string &text)
+    {
+        std::string cleaned;
+        for (char c : text)
+        {
+            if (std::isalnum(static_cast<unsigned char>(c)) || c == '\'')
+            {
+                cleaned += char(std::tolower(static_cast<unsigned char>(c)));
+            }
+            else
+            {
+                cleaned += ' ';
+            }
+        }
+        std::istringstream stream(cleaned);
+        return {std::istream_iterator<std::string>(stream), std::istream_iterator<std::string>()};
+    }
+
+    // Word-level edit distance between a hypothesis and the reference
+    size_t wordErrors(const std::vector<std::string> &reference, const std::vector<std::string> &hypothesis)
+    {
+        std::vector<size_t> row(hypothesis.size() + 1);
+        for (size_t j = 0; j < row.size(); ++j)
+        {
+            row[j] = j;
+        }
+        for (size_t i = 1; i <= reference.size(); ++i)
+        {
+            size_t diagonal = row[0];
+            row[0] = i;
+            for (size_t j = 1; j <= hypothesis.size(); ++j)
+            {
+                size_t above = row[j];
+                row[j] = std::min({row[j] + 1, row[j - 1] + 1, diagonal + (reference[i - 1] == hypothesis[j - 1] ? 0 : 1)});
+                diagonal = above;
+            }
+        }
+        return row.back();
+    }
+
+    std::vector<Clip> loadClips(const std::string &directory)
+    {
+        std::vector<Clip> clips;
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator(directory, error))
+        {
+            if (entry.path().extension() != ".wav")
+            {
+                continue;
+            }
+            Clip clip;
+            clip.name = entry.path().filename().string();
+            if (!readWav(entry.path().string(), clip.samples) || clip.samples.empty())
+            {
+                std::cerr << "Skipping unreadable calibration clip " << clip.name << std::endl;
+                continue;
+            }
+            std::filesystem::path transcriptPath = entry.path();
+            std::ifstream transcript(transcriptPath.replace_extension(".txt"));
+            if (transcript.is_open())
+            {
+                std::stringstream text;
+                text << transcript.rdbuf();
+                clip.reference = normalizedWords(text.str());
+            }
+            clips.push_back(std::move(clip));
+        }
+        if (error)
+        {
+            std::cerr << "Failed to read calibration clips from " << directory << ": " << error.message() << std::endl;
+        }
+        std::sort(clips.begin(), clips.end(), [](const Clip &a, const Clip &b)
+                  { return a.name < b.name; });
+        return clips;
+    }
+
+    double percentileMs(std::vector<double> values, double fraction)
+    {
+        size_t index = std::min(values.size() - 1, size_t(fraction * double(values.size())));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    bool measure(const WhisperTranscriber::Params &base, const std::vector<Clip> &clips, int repeats, const WhisperTuning &tuning, Measurement &result)
+    {
+        WhisperTranscriber::Params params = base;
+        params.n_threads = tuning.n_threads;
+        params.n_states = tuning.n_states;
+        params.beam_size = tuning.beam_size;
+        params.fast_model_path.clear(); // The tuning applies to whichever model decodes
+        WhisperTranscriber transcriber;
+        if (!transcriber.setup(params))
+        {
+            return false;
+        }
+
+        // The first decode pays for lazy allocations, keep it out of the numbers
+        transcriber.transcribeLiveData(clips.front().samples);
+
+        // Single decodes on an otherwise idle transcriber give latency and accuracy
+        std::vector<double> latencies;
+        double decodeSeconds = 0.0;
+        double audioSeconds = 0.0;
+        size_t errors = 0;
+        size_t referenceWords = 0;
+        for (int repeat = 0; repeat < repeats; ++repeat)
+        {
+            for (const Clip &clip : clips)
+            {
+                Clock::time_point start = Clock::now();
+                std::string text = transcriber.transcribeLiveData(clip.samples);
+                double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                latencies.push_back(seconds * 1000.0);
+                decodeSeconds += seconds;
+                audioSeconds += double(clip.samples.size()) / WHISPER_SAMPLE_RATE;
+                if (repeat == 0 && !clip.reference.empty())
+                {
+                    errors += wordErrors(clip.reference, normalizedWords(text));
+                    referenceWords += clip.reference.size();
+                }
+            }
+        }
+
+        // Throughput with every state busy, the way a loaded server runs
+        const size_t jobs = std::max(clips.size() * size_t(repeats), size_t(tuning.n_states) * 2);
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> callers;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < tuning.n_states; ++i)
+        {
+            callers.emplace_back([&]
+                                 {
+                for (size_t job = next++; job < jobs; job = next++)
+                {
+                    transcriber.transcribeLiveData(clips[job % clips.size()].samples);
+                } });
+        }
+        double busyAudioSeconds = 0.0;
+        for (size_t job = 0; job < jobs; ++job)
+        {
+            busyAudioSeconds += double(clips[job % clips.size()].samples.size()) / WHISPER_SAMPLE_RATE;
+        }
+        for (std::thread &caller : callers)
+        {
+            caller.join();
+        }
+        double wallSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        result.tuning = tuning;
+        result.realTimeFactor = decodeSeconds / audioSeconds;
+        result.p50Ms = percentileMs(latencies, 0.5);
+        result.p95Ms = percentileMs(latencies, 0.95);
+        result.throughput = busyAudioSeconds / wallSeconds;
+        result.wordErrorRate = referenceWords > 0 ? double(errors) / double(referenceWords) : -1.0;
+        return true;
+    }
+}
+
+bool runWhisperCalibration(const WhisperTranscriber::Params &base, const WhisperCalibrationParams &params)
+{
+    std::vector<Clip> clips = loadClips(params.clip_dir);
+    if (clips.empty())
+    {
+        std::cerr << "No calibration clips found in " << params.clip_dir << std::endl;
+        return false;
+    }
+    const int cores = std::max(1u, std::thread::hardware_concurrency());
+    const int repeats = std::max(1, params.repeats);
+    std::cout << "Whisper calibration with " << base.model_path << ", " << clips.size() << " clip(s), " << cores << " core(s)" << std::endl;
+
+    // Powers of two up to the core count plus the core count itself; states times threads never
+    // oversubscribes the cores except for the single-state row
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < cores; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(cores);
+    std::vector<int> beamSizes{0};
+    if (params.beam_size > 1)
+    {
+        beamSizes.push_back(params.beam_size);
+    }
+
+    std::vector<Measurement> measurements;
+    for (int beam : beamSizes)
+    {
+        for (int states = 1; states <= cores; states *= 2)
+        {
+            for (int threads : threadCounts)
+            {
+                if (states > 1 && states * threads > cores)
+                {
+                    continue;
+                }
+                WhisperTuning tuning;
+                tuning.n_threads = threads;
+                tuning.n_states = states;
+                tuning.beam_size = beam;
+                Measurement measurement;
+                if (!measure(base, clips, repeats, tuning, measurement))
+                {
+                    std::cerr << "Skipping " << threads << " thread(s) x " << states << " state(s), the model failed to load" << std::endl;
+                    continue;
+                }
+                std::cout << std::fixed << std::setprecision(3)
+                          << (beam > 1 ? "beam " + std::to_string(beam) : std::string("greedy")) << ", "
+                          << threads << " thread(s) x " << states << " state(s): RTF " << measurement.realTimeFactor
+                          << ", p50 " << std::setprecision(0) << measurement.p50Ms << " ms, p95 " << measurement.p95Ms
+                          << " ms, throughput " << std::setprecision(2) << measurement.throughput << "x realtime";
+                if (measurement.wordErrorRate >= 0.0)
+                {
+                    std::cout << ", WER " << std::setprecision(1) << measurement.wordErrorRate * 100.0 << "%";
+                }
+                std::cout << std::endl;
+                measurements.push_back(measurement);
+            }
+        }
+    }
+    if (measurements.empty())
+    {
+        return false;
+    }
+
+    // Settle for the accuracy of the best combination, then for the latency of the fastest
+    // accurate one, and among what is left take the one that keeps up with the most traffic
+    double bestWer = 1e9;
+    for (const Measurement &m : measurements)
+    {
+        bestWer = m.wordErrorRate >= 0.0 ? std::min(bestWer, m.wordErrorRate) : bestWer;
+    }
+    auto accurate = [&](const Measurement &m)
+    {
+        return m.wordErrorRate < 0.0 || m.wordErrorRate <= bestWer + params.wer_tolerance;
+    };
+    double bestP95 = 1e9;
+    for (const Measurement &m : measurements)
+    {
+        bestP95 = accurate(m) ? std::min(bestP95, m.p95Ms) : bestP95;
+    }
+    // A budget below 1 would rule out even the fastest accurate combination
+    const double latencyBudget = std::max(1.0, double(params.latency_budget));
+    const Measurement *best = nullptr;
+    for (const Measurement &m : measurements)
+    {
+        if (accurate(m) && m.p95Ms <= bestP95 * latencyBudget && (!best || m.throughput > best->throughput))
+        {
+            best = &m;
+        }
+    }
+    if (!best)
+    {
+        std::cerr << "No combination met the accuracy and latency requirements" << std::endl;
+        return false;
+    }
+
+    nlohmann::json tuning;
+    tuning["n_threads"] = best->tuning.n_threads;
+    tuning["n_states"] = best->tuning.n_states;
+    tuning["beam_size"] = best->tuning.beam_size;
+    tuning["model_path"] = base.model_path;
+    tuning["cores"] = cores;
+    tuning["real_time_factor"] = best->realTimeFactor;
+    tuning["p95_latency_ms"] = best->p95Ms;
+    tuning["throughput"] = best->throughput;
+
+    std::ofstream output(params.output_path);
+    if (!output.is_open())
+    {
+        std::cerr << "Failed to write tuning file " << params.output_path << std::endl;
+        return false;
+    }
+    output << tuning.dump(4) << std::endl;
+    std::cout << "Best: " << best->tuning.n_threads << " thread(s) x " << best->tuning.n_states << " state(s), "
+              << (best->tuning.beam_size > 1 ? "beam " + std::to_string(best->tuning.beam_size) : std::string("greedy"))
+              << ", written to " << params.output_path << std::endl;
+    return true;
+}
+
+bool loadWhisperTuning(const std::string &path, WhisperTuning &tuning)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    try
+    {
+        nlohmann::json json;
+        file >> json;
+        WhisperTuning loaded;
+        loaded.n_threads = std::max(1, json.value("n_threads", loaded.n_threads));
+        loaded.n_states = std::max(1, json.value("n_states", loaded.n_states));
+        loaded.beam_size = std::max(0, json.value("beam_size", loaded.beam_size));
+        tuning = loaded;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Invalid tuning file " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    if (std::max(1u, std::thread::hardware_concurrency()) < unsigned(tuning.n_threads))
+    {
+        std::cerr << "Tuning file " << path << " was calibrated on a larger machine" << std::endl;
+    }
+    return true;
+}
@@ -5,62 +5,529 @@ Date: 2024-09-01
 Description:
 */
 #include "WhisperTranscriber.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
+#include <iterator>
 #include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-WhisperTranscriber::WhisperTranscriber() : ctx_(nullptr) {}
+namespace
+{
+    // Words of text that repeat the last words of committed, the audio kept across a window
+    // boundary is often transcribed twice. Returns the length of the repeated prefix of text.
+    size_t repeatedPrefix(const std::string &committed, const std::string &text, size_t maxWords)
+    {
+        std::istringstream committedStream(committed);
+        std::vector<std::string> tail{std::istream_iterator<std::string>(committedStream), std::istream_iterator<std::string>()};
+
+        std::vector<std::pair<std::string, size_t>> head; // Word and the offset just past it
+        size_t offset = 0;
+        while (head.size() < maxWords)
+        {
+            size_t begin = text.find_first_not_of(" \t\n", offset);
+            if (begin == std::string::npos)
+            {
+                break;
+            }
+            offset = std::min(text.find_first_of(" \t\n", begin), text.size());
+            head.emplace_back(text.substr(begin, offset - begin), offset);
+        }
+
+        for (size_t words = std::min(head.size(), tail.size()); words > 0; --words)
+        {
+            bool repeated = true;
+            for (size_t i = 0; i < words && repeated; ++i)
+            {
+                repeated = tail[tail.size() - words + i] == head[i].first;
+            }
+            if (repeated)
+            {
+                return head[words - 1].second;
+            }
+        }
+        return 0;
+    }
+
+    // Mean probability of the text tokens of the last decode on state, 0 when nothing was decoded
+    float meanTokenProbability(struct whisper_context *ctx, struct whisper_state *state)
+    {
+        const whisper_token eot = whisper_token_eot(ctx);
+        double sum = 0.0;
+        int n = 0;
+        const int n_segments = whisper_full_n_segments_from_state(state);
+        for (int i = 0; i < n_segments; ++i)
+        {
+            const int n_tokens = whisper_full_n_tokens_from_state(state, i);
+            for (int j = 0; j < n_tokens; ++j)
+            {
+                if (whisper_full_get_token_id_from_state(state, i, j) < eot)
+                {
+                    sum += whisper_full_get_token_p_from_state(state, i, j);
+                    ++n;
+                }
+            }
+        }
+        return n > 0 ? static_cast<float>(sum / n) : 0.0f;
+    }
+}
+
+WhisperTranscriber::WhisperTranscriber() : state_(State::Unloaded), load_seconds_(0.0) {}
 
 WhisperTranscriber::~WhisperTranscriber()
 {
-    if (ctx_)
+    release();
+}
+
+void WhisperTranscriber::release(Model &model)
+{
+    for (struct whisper_state *state : model.states)
+    {
+        whisper_free_state(state);
+    }
+    model.states.clear();
+    model.free_states.clear();
+
+    if (model.ctx)
     {
-        whisper_free(ctx_);
+        whisper_free(model.ctx);
+        model.ctx = nullptr;
     }
 }
 
-bool WhisperTranscriber::setup(const Params &params)
+void WhisperTranscriber::release()
 {
-    std::lock_guard<std::mutex> lock(whisper_mutex_);
-    params_ = params;
+    release(model_);
+    release(fast_model_);
+}
 
+struct whisper_context *WhisperTranscriber::initContext(const std::string &path) const
+{
     struct whisper_context_params cparams = whisper_context_default_params();
     cparams.use_gpu = params_.use_gpu;
 
-    ctx_ = whisper_init_from_file_with_params(params_.model_path.c_str(), cparams);
-    if (!ctx_)
+    int fd = params_.mmap_model ? open(path.c_str(), O_RDONLY) : -1;
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
     {
-        std::cerr << "Failed to initialize whisper context" << std::endl;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return whisper_init_from_file_with_params_no_state(path.c_str(), cparams);
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror("mmap failed for whisper model");
+        return whisper_init_from_file_with_params_no_state(path.c_str(), cparams);
+    }
+
+    // The file is read front to back exactly once, let the kernel read ahead aggressively
+    madvise(data, size, MADV_SEQUENTIAL);
+    madvise(data, size, MADV_WILLNEED);
+    struct whisper_context *ctx = whisper_init_from_buffer_with_params_no_state(data, size, cparams);
+
+    // Whisper copies the tensors into its own buffers, the mapping is only needed while loading
+    munmap(data, size);
+    return ctx;
+}
+
+bool WhisperTranscriber::loadModel(Model &model, const std::string &path)
+{
+    // The weights are loaded once, every state only adds its own KV cache and work buffers
+    model.ctx = initContext(path);
+    if (!model.ctx)
+    {
+        std::cerr << "Failed to initialize whisper context from " << path << std::endl;
+        return false;
+    }
+
+    for (int i = 0; i < std::max(1, params_.n_states); ++i)
+    {
+        struct whisper_state *state = whisper_init_state(model.ctx);
+        if (!state)
+        {
+            std::cerr << "Failed to initialize whisper state " << i << " for " << path << std::endl;
+            break;
+        }
+        model.states.push_back(state);
+    }
+    if (model.states.empty())
+    {
+        release(model);
         return false;
     }
+    model.free_states = model.states;
 
+    std::cout << "Whisper model " << path << " loaded with " << model.states.size() << " inference state(s)" << std::endl;
     return true;
 }
 
-std::string WhisperTranscriber::transcribeLiveData(const std::vector<float> &pcmf32)
+bool WhisperTranscriber::setup(const Params &params)
+{
+    {
+        std::lock_guard<std::mutex> lock(whisper_mutex_);
+        release();
+        params_ = params;
+        state_ = State::Loading;
+    }
+
+    // The models are only touched by callers that got past waitUntilReady(), so they are loaded
+    // without holding the mutex and state() stays responsive
+    auto start = std::chrono::steady_clock::now();
+    bool loaded = loadModel(model_, params_.model_path);
+
+    // Without the fast model every utterance is simply decoded by the main one
+    if (loaded && !params_.fast_model_path.empty() && !loadModel(fast_model_, params_.fast_model_path))
+    {
+        std::cerr << "Continuing without a fast model" << std::endl;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(whisper_mutex_);
+        load_seconds_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        state_ = loaded ? State::Ready : State::Failed;
+    }
+    ready_.notify_all();
+    return loaded;
+}
+
+void WhisperTranscriber::beginLoading()
 {
     std::lock_guard<std::mutex> lock(whisper_mutex_);
-    return processTranscription(pcmf32);
+    state_ = State::Loading;
+}
+
+bool WhisperTranscriber::waitUntilReady()
+{
+    std::unique_lock<std::mutex> lock(whisper_mutex_);
+    ready_.wait(lock, [this]
+                { return state_ != State::Loading; });
+    return state_ == State::Ready;
+}
+
+WhisperTranscriber::StateLease::StateLease(WhisperTranscriber &owner, Model &model) : owner_(owner), model_(model), state_(nullptr)
+{
+    std::unique_lock<std::mutex> lock(owner_.whisper_mutex_);
+    model_.state_returned.wait(lock, [this]
+                               { return !model_.free_states.empty() || model_.states.empty(); });
+    if (!model_.free_states.empty())
+    {
+        state_ = model_.free_states.back();
+        model_.free_states.pop_back();
+    }
+}
+
+WhisperTranscriber::StateLease::~StateLease()
+{
+    if (state_)
+    {
+        {
+            std::lock_guard<std::mutex> lock(owner_.whisper_mutex_);
+            model_.free_states.push_back(state_);
+        }
+        model_.state_returned.notify_one();
+    }
+}
+
+std::string WhisperTranscriber::transcribeLiveData(const std::vector<float> &pcmf32)
+{
+    return transcribeLiveData(pcmf32.data(), pcmf32.size());
+}
+
+std::string WhisperTranscriber::transcribeLiveData(const float *samples, size_t count, const SegmentCallback &onSegment)
+{
+    if (!waitUntilReady())
+    {
+        std::cerr << "Whisper transcriber is not set up" << std::endl;
+        return "";
+    }
+
+    // Most utterances are short commands the fast model gets right, the main model only sees
+    // the long ones and those the fast model was unsure about
+    const size_t fastSamples = static_cast<size_t>(std::max(0, params_.fast_max_ms)) * WHISPER_SAMPLE_RATE / 1000;
+    if (fast_model_.ctx && count <= fastSamples)
+    {
+        StateLease lease(*this, fast_model_);
+        float confidence = 0.0f;
+        std::string text = processTranscription(fast_model_, lease.get(), samples, count, nullptr, &confidence);
+        if (confidence >= params_.fast_min_confidence)
+        {
+            if (onSegment)
+            {
+                onSegment(text);
+            }
+            return text;
+        }
+    }
+
+    StateLease lease(*this, model_);
+    if (!lease.get())
+    {
+        std::cerr << "Whisper transcriber is not set up" << std::endl;
+        return "";
+    }
+    return processTranscription(model_, lease.get(), samples, count, onSegment, nullptr);
 }
 
-std::string WhisperTranscriber::processTranscription(const std::vector<float> &pcmf32)
+whisper_full_params WhisperTranscriber::decodeParams() const
 {
-    whisper_full_params wparams = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+    whisper_full_params wparams = whisper_full_default_params(params_.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+    if (params_.beam_size > 1)
+    {
+        wparams.beam_search.beam_size = params_.beam_size;
+    }
     wparams.language = params_.language.c_str();
     wparams.n_threads = params_.n_threads;
     wparams.translate = params_.translate;
+    return wparams;
+}
+
+std::string WhisperTranscriber::processTranscription(Model &model, struct whisper_state *state, const float *samples, size_t count, const SegmentCallback &onSegment, float *confidence)
+{
+    whisper_full_params wparams = decodeParams();
+    wparams.no_context = true; // The state may have decoded another client's utterance last
 
-    if (whisper_full_parallel(ctx_, wparams, pcmf32.data(), pcmf32.size(), params_.n_processors) != 0)
+    // Segments are reported as soon as whisper finishes them, long before the whole decode is done
+    struct SegmentContext
+    {
+        const SegmentCallback *callback;
+        std::string partial;
+    };
+    SegmentContext segmentContext{&onSegment, std::string()};
+    if (onSegment)
+    {
+        wparams.new_segment_callback = [](struct whisper_context *, struct whisper_state *state, int n_new, void *user_data)
+        {
+            SegmentContext &context = *static_cast<SegmentContext *>(user_data);
+            const int n_segments = whisper_full_n_segments_from_state(state);
+            for (int i = n_segments - n_new; i < n_segments; ++i)
+            {
+                context.partial += whisper_full_get_segment_text_from_state(state, i);
+                context.partial += "\n";
+            }
+            (*context.callback)(context.partial);
+        };
+        wparams.new_segment_callback_user_data = &segmentContext;
+    }
+
+    if (whisper_full_with_state(model.ctx, state, wparams, samples, static_cast<int>(count)) != 0)
     {
         std::cerr << "Failed to process live audio" << std::endl;
         return "";
     }
 
     std::stringstream result;
-    const int n_segments = whisper_full_n_segments(ctx_);
+    const int n_segments = whisper_full_n_segments_from_state(state);
     for (int i = 0; i < n_segments; ++i)
     {
-        result << whisper_full_get_segment_text(ctx_, i) << "\n";
+        result << whisper_full_get_segment_text_from_state(state, i) << "\n";
+    }
+    if (confidence)
+    {
+        *confidence = meanTokenProbability(model.ctx, state);
     }
 
     return result.str();
 }
+
+std::unique_ptr<WhisperTranscriber::Stream> WhisperTranscriber::openStream(const StreamParams &params)
+{
+    return std::unique_ptr<Stream>(new Stream(*this, params));
+}
+
+WhisperTranscriber::Stream::Stream(WhisperTranscriber &owner, const StreamParams &params)
+    : owner_(owner), params_(params), fast_(true), confidence_(0.0f), pending_(0), received_(0)
+{
+    params_.step_ms = std::max(100, params_.step_ms);
+    params_.window_ms = std::max(params_.step_ms, params_.window_ms);
+    params_.keep_ms = std::min(std::max(0, params_.keep_ms), params_.window_ms / 2);
+}
+
+bool WhisperTranscriber::Stream::push(const float *samples, size_t count)
+{
+    const size_t windowSamples = static_cast<size_t>(params_.window_ms) * WHISPER_SAMPLE_RATE / 1000;
+    const size_t stepSamples = static_cast<size_t>(params_.step_ms) * WHISPER_SAMPLE_RATE / 1000;
+    const size_t keepSamples = static_cast<size_t>(params_.keep_ms) * WHISPER_SAMPLE_RATE / 1000;
+
+    bool changed = false;
+    while (count > 0)
+    {
+        size_t take = std::min(count, windowSamples - window_.size());
+        window_.insert(window_.end(), samples, samples + take);
+        samples += take;
+        count -= take;
+        pending_ += take;
+        received_ += take;
+
+        bool full = window_.size() >= windowSamples;
+        if (full || pending_ >= stepSamples)
+        {
+            changed = decode() || changed;
+        }
+        if (full)
+        {
+            commit(keepSamples);
+        }
+    }
+    return changed;
+}
+
+std::string WhisperTranscriber::Stream::finish()
+{
+    if (pending_ > 0)
+    {
+        decode();
+    }
+    if (fast_ && received_ > 0 && confidence_ < owner_.params_.fast_min_confidence)
+    {
+        // The fast model was unsure about the whole utterance, which still fits the window
+        escalate();
+        decode();
+    }
+    commit(0);
+    return committed_;
+}
+
+std::string WhisperTranscriber::Stream::partial() const
+{
+    return committed_ + hypothesis_;
+}
+
+bool WhisperTranscriber::Stream::decode()
+{
+    pending_ = 0;
+    if (!owner_.waitUntilReady())
+    {
+        std::cerr << "Whisper transcriber is not set up" << std::endl;
+        return false;
+    }
+
+    // The fast model only ever sees short utterances from their start and never a prompt
+    const size_t fastSamples = static_cast<size_t>(std::max(0, owner_.params_.fast_max_ms)) * WHISPER_SAMPLE_RATE / 1000;
+    if (fast_ && (!owner_.fast_model_.ctx || received_ > fastSamples || !committed_.empty()))
+    {
+        escalate();
+    }
+    Model &model = fast_ ? owner_.fast_model_ : owner_.model_;
+
+    StateLease lease(owner_, model);
+    if (!lease.get())
+    {
+        std::cerr << "Whisper transcriber is not set up" << std::endl;
+        return false;
+    }
+
+    whisper_full_params wparams = owner_.decodeParams();
+    wparams.print_progress = false;
+    wparams.print_realtime = false;
+    wparams.print_timestamps = false;
+    wparams.print_special = false;
+    // States are shared between streams, the only context is the prompt carried by this stream
+    wparams.no_context = true;
+    wparams.single_segment = true;
+    wparams.prompt_tokens = prompt_.empty() ? nullptr : prompt_.data();
+    wparams.prompt_n_tokens = static_cast<int>(prompt_.size());
+
+    if (whisper_full_with_state(model.ctx, lease.get(), wparams, window_.data(), static_cast<int>(window_.size())) != 0)
+    {
+        std::cerr << "Failed to process streamed audio" << std::endl;
+        return false;
+    }
+
+    std::string text;
+    hypothesis_tokens_.clear();
+    confidence_ = meanTokenProbability(model.ctx, lease.get());
+    const whisper_token eot = whisper_token_eot(model.ctx);
+    const int n_segments = whisper_full_n_segments_from_state(lease.get());
+    for (int i = 0; i < n_segments; ++i)
+    {
+        text += whisper_full_get_segment_text_from_state(lease.get(), i);
+        const int n_tokens = whisper_full_n_tokens_from_state(lease.get(), i);
+        for (int j = 0; j < n_tokens; ++j)
+        {
+            whisper_token token = whisper_full_get_token_id_from_state(lease.get(), i, j);
+            if (token < eot)
+            {
+                hypothesis_tokens_.push_back(token);
+            }
+        }
+    }
+
+    if (!committed_.empty() && params_.keep_ms > 0)
+    {
+        text.erase(0, repeatedPrefix(committed_, text, 3));
+    }
+
+    previous_hypothesis_ = std::move(hypothesis_);
+    hypothesis_ = std::move(text);
+
+    // Local agreement: the words two consecutive decodes share are not expected to change
+    size_t agreed = 0;
+    size_t limit = std::min(previous_hypothesis_.size(), hypothesis_.size());
+    for (size_t i = 0; i < limit && previous_hypothesis_[i] == hypothesis_[i]; ++i)
+    {
+        if (i + 1 == hypothesis_.size() || hypothesis_[i + 1] == ' ')
+        {
+            agreed = i + 1;
+        }
+    }
+    std::string stable = committed_ + hypothesis_.substr(0, agreed);
+    if (stable.size() > stable_.size() && stable.compare(0, stable_.size(), stable_) == 0)
+    {
+        stable_ = std::move(stable);
+    }
+
+    return hypothesis_ != previous_hypothesis_;
+}
+
+void WhisperTranscriber::Stream::commit(size_t keepSamples)
+{
+    committed_ += hypothesis_;
+    stable_ = committed_;
+
+    // The committed words prompt the next window so it continues the sentence instead of restarting
+    prompt_.insert(prompt_.end(), hypothesis_tokens_.begin(), hypothesis_tokens_.end());
+    if (prompt_.size() > static_cast<size_t>(std::max(0, params_.max_prompt_tokens)))
+    {
+        prompt_.erase(prompt_.begin(), prompt_.end() - std::max(0, params_.max_prompt_tokens));
+    }
+
+    hypothesis_.clear();
+    previous_hypothesis_.clear();
+    hypothesis_tokens_.clear();
+    keepSamples = std::min(keepSamples, window_.size());
+    window_.erase(window_.begin(), window_.end() - keepSamples);
+}
+
+void WhisperTranscriber::Stream::escalate()
+{
+    fast_ = false;
+
+    // Token ids belong to the fast model's vocabulary, the main model only gets the committed
+    // text, tokenized again with its own
+    prompt_.clear();
+    hypothesis_tokens_.clear();
+    const int maxPromptTokens = std::max(0, params_.max_prompt_tokens);
+    if (committed_.empty() || maxPromptTokens == 0 || !owner_.model_.ctx)
+    {
+        return;
+    }
+
+    std::vector<whisper_token> tokens(committed_.size() + 1); // Never more tokens than bytes
+    const int n_tokens = whisper_tokenize(owner_.model_.ctx, committed_.c_str(), tokens.data(), static_cast<int>(tokens.size()));
+    if (n_tokens <= 0)
+    {
+        return;
+    }
+    const size_t first = static_cast<size_t>(std::max(0, n_tokens - maxPromptTokens));
+    prompt_.assign(tokens.begin() + first, tokens.begin() + n_tokens);
+}
@@ -0,0 +1,170 @@
+#include "AudioCodec.h"
+#include "TestCheck.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    std::vector<uint8_t> toBytes(const std::vector<int16_t> &samples)
+    {
+        std::vector<uint8_t> bytes(samples.size() * 2);
+        std::memcpy(bytes.data(), samples.data(), bytes.size());
+        return bytes;
+    }
+
+    std::vector<int16_t> toSamples(const std::vector<uint8_t> &bytes, size_t length)
+    {
+        std::vector<int16_t> samples(length / 2);
+        std::memcpy(samples.data(), bytes.data(), samples.size() * 2);
+        return samples;
+    }
+
+    std::vector<int16_t> roundTrip(CodecType codec, const std::vector<int16_t> &samples, uint8_t channels)
+    {
+        const size_t frames = samples.size() / channels;
+        std::vector<uint8_t> pcm = toBytes(samples);
+        std::vector<uint8_t> encoded(maxEncodedAudioSize(codec, frames, channels));
+        const size_t encodedLength = encodeAudio(codec, pcm.data(), frames, channels, encoded.data());
+        CHECK(encodedLength == encoded.size());
+
+        const size_t decodedLength = decodedAudioSize(codec, encoded.data(), encodedLength, channels);
+        CHECK(decodedLength == pcm.size());
+        std::vector<uint8_t> decoded(decodedLength);
+        CHECK(decodeAudio(codec, encoded.data(), encodedLength, channels, decoded.data()) == decodedLength);
+        return toSamples(decoded, decodedLength);
+    }
+
+    // Interleaved sine with a different frequency and phase per channel
+    std::vector<int16_t> tone(size_t frames, uint8_t channels, double amplitude)
+    {
+        std::vector<int16_t> samples(frames * channels);
+        for (size_t f = 0; f < frames; ++f)
+        {
+            for (uint8_t c = 0; c < channels; ++c)
+            {
+                double frequency = 440.0 * (c + 1);
+                samples[f * channels + c] = int16_t(std::lround(amplitude * std::sin(2.0 * M_PI * frequency * f / 16000.0 + c)));
+            }
+        }
+        return samples;
+    }
+
+    double snrDb(const std::vector<int16_t> &reference, const std::vector<int16_t> &decoded)
+    {
+        double signal = 0.0;
+        double noise = 0.0;
+        for (size_t i = 0; i < reference.size(); ++i)
+        {
+            double error = double(decoded[i]) - reference[i];
+            signal += double(reference[i]) * reference[i];
+            noise += error * error;
+        }
+        return 10.0 * std::log10(signal / std::max(noise, 1e-9));
+    }
+
+    void testMuLawEveryValue()
+    {
+        std::vector<int16_t> samples;
+        for (int v = -32768; v <= 32767; ++v)
+        {
+            samples.push_back(int16_t(v));
+        }
+        std::vector<int16_t> decoded = roundTrip(CodecType::MuLaw, samples, 1);
+        CHECK(decoded.size() == samples.size());
+
+        // G.711 keeps the sign and 4 mantissa bits past the leading one and decodes to the middle
+        // of the interval, so the error is at most half a step, 1/32 of the biased magnitude;
+        // beyond the clip level it grows by the clipped amount
+        int worst = 0;
+        for (size_t i = 0; i < samples.size() && i < decoded.size(); ++i)
+        {
+            const int magnitude = std::abs(int(samples[i]));
+            const int clipped = std::min(magnitude, 32635);
+            const int error = std::abs(int(decoded[i]) - samples[i]);
+            if (error > (clipped + 0x84) / 32 + (magnitude - clipped))
+            {
+                ++worst;
+            }
+            if (decoded[i] != 0 && (decoded[i] < 0) != (samples[i] < 0))
+            {
+                ++worst;
+            }
+        }
+        CHECK(worst == 0);
+    }
+
+    void testMuLawStable()
+    {
+        // Decoded values are codebook entries, encoding them again must not move them
+        std::vector<int16_t> once = roundTrip(CodecType::MuLaw, tone(4000, 1, 20000.0), 1);
+        CHECK(roundTrip(CodecType::MuLaw, once, 1) == once);
+    }
+
+    void testAdpcmTone(uint8_t channels)
+    {
+        // Several blocks plus a partial one, so block boundaries and the step index carried
+        // over between them are covered
+        const size_t frames = 3 * kAdpcmBlockFrames + 123;
+        std::vector<int16_t> samples = tone(frames, channels, 12000.0);
+        std::vector<int16_t> decoded = roundTrip(CodecType::ImaAdpcm, samples, channels);
+        CHECK(decoded.size() == samples.size());
+        if (decoded.size() != samples.size())
+        {
+            return;
+        }
+
+        // The first frame of every block is stored verbatim
+        for (size_t f = 0; f < frames; f += kAdpcmBlockFrames)
+        {
+            for (uint8_t c = 0; c < channels; ++c)
+            {
+                CHECK(decoded[f * channels + c] == samples[f * channels + c]);
+            }
+        }
+        CHECK(snrDb(samples, decoded) > 25.0);
+    }
+
+    void testAdpcmConcatenatedBlocks()
+    {
+        // Separately encoded chunks of one stream decode as a whole
+        std::vector<int16_t> samples = tone(900, 1, 8000.0);
+        std::vector<uint8_t> pcm = toBytes(samples);
+        std::vector<uint8_t> encoded(maxEncodedAudioSize(CodecType::ImaAdpcm, 400, 1) + maxEncodedAudioSize(CodecType::ImaAdpcm, 500, 1));
+        size_t length = encodeAudio(CodecType::ImaAdpcm, pcm.data(), 400, 1, encoded.data());
+        length += encodeAudio(CodecType::ImaAdpcm, pcm.data() + 800, 500, 1, encoded.data() + length);
+        CHECK(length == encoded.size());
+        CHECK(decodedAudioSize(CodecType::ImaAdpcm, encoded.data(), length, 1) == pcm.size());
+    }
+
+    void testAdpcmMalformed()
+    {
+        std::vector<uint8_t> pcm = toBytes(tone(500, 2, 8000.0));
+        std::vector<uint8_t> encoded(maxEncodedAudioSize(CodecType::ImaAdpcm, 500, 2));
+        const size_t length = encodeAudio(CodecType::ImaAdpcm, pcm.data(), 500, 2, encoded.data());
+
+        CHECK(decodedAudioSize(CodecType::ImaAdpcm, encoded.data(), length - 1, 2) == 0); // Truncated block
+        CHECK(decodedAudioSize(CodecType::ImaAdpcm, encoded.data(), 1, 2) == 0);          // Truncated frame count
+        CHECK(decodedAudioSize(CodecType::ImaAdpcm, encoded.data(), length, 0) == 0);
+
+        std::vector<uint8_t> zero = encoded;
+        zero[0] = zero[1] = 0;
+        CHECK(decodedAudioSize(CodecType::ImaAdpcm, zero.data(), length, 2) == 0);
+
+        std::vector<uint8_t> oversized = encoded;
+        oversized[0] = oversized[1] = 0xFF;
+        CHECK(decodedAudioSize(CodecType::ImaAdpcm, oversized.data(), length, 2) == 0);
+    }
+}
+
+int main()
+{
+    testMuLawEveryValue();
+    testMuLawStable();
+    testAdpcmTone(1);
+    testAdpcmTone(2);
+    testAdpcmConcatenatedBlocks();
+    testAdpcmMalformed();
+    return TEST_RESULT();
+}
@@ -0,0 +1,184 @@
+#include "AudioConvert.h"
+#include "TestCheck.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const SampleFormat kFormats[] = {SampleFormat::S16LE, SampleFormat::S24LE, SampleFormat::S32LE, SampleFormat::F32LE};
+    const uint8_t kChannels[] = {1, 2, 3, 4};
+
+    // Odd counts leave a scalar tail behind every vector width, the large ones span several scratch blocks
+    const size_t kFrames[] = {1, 3, 7, 17, 255, 1023, 4099};
+
+    AudioFormat makeFormat(SampleFormat sampleFormat, uint8_t channels)
+    {
+        AudioFormat format;
+        format.sampleFormat = sampleFormat;
+        format.channels = channels;
+        return format;
+    }
+
+    // Full-scale random samples; floats stay within [-1, 1] so they are never NaN
+    std::vector<uint8_t> randomSamples(SampleFormat format, size_t samples, std::mt19937 &rng)
+    {
+        const size_t width = makeFormat(format, 1).bytesPerSample();
+        std::vector<uint8_t> bytes(samples * width);
+        if (format == SampleFormat::F32LE)
+        {
+            std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+            for (size_t i = 0; i < samples; ++i)
+            {
+                float sample = value(rng);
+                std::memcpy(bytes.data() + i * width, &sample, sizeof(sample));
+            }
+        }
+        else
+        {
+            std::uniform_int_distribution<int> byte(0, 255);
+            for (uint8_t &b : bytes)
+            {
+                b = uint8_t(byte(rng));
+            }
+        }
+        return bytes;
+    }
+
+    bool sameBits(const std::vector<float> &a, const std::vector<float> &b)
+    {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+    }
+
+    void testKnownValues()
+    {
+        const int16_t s16[] = {0, 16384, -32768, 32767};
+        float out[4];
+        convertSamplesToFloat(reinterpret_cast<const uint8_t *>(s16), 4, SampleFormat::S16LE, out, ConvertPath::Scalar);
+        CHECK(out[0] == 0.0f && out[1] == 0.5f && out[2] == -1.0f && out[3] == 32767.0f / 32768.0f);
+
+        // S24 is sign-extended: 0x800000 is the most negative value, 0x400000 half scale
+        const uint8_t s24[] = {0x00, 0x00, 0x80, 0x00, 0x00, 0x40, 0xFF, 0xFF, 0xFF};
+        convertSamplesToFloat(s24, 3, SampleFormat::S24LE, out, ConvertPath::Scalar);
+        CHECK(out[0] == -1.0f && out[1] == 0.5f && out[2] == -1.0f / 8388608.0f);
+
+        // Stereo downmix averages the channels
+        const int16_t stereo[] = {16384, -16384, 32767, 32767};
+        convertToMonoFloat(reinterpret_cast<const uint8_t *>(stereo), 2, makeFormat(SampleFormat::S16LE, 2), out, ConvertPath::Scalar);
+        CHECK(out[0] == 0.0f && out[1] == 32767.0f / 32768.0f);
+    }
+
+    void testSimdMatchesScalar()
+    {
+        std::mt19937 rng(42);
+        for (SampleFormat sampleFormat : kFormats)
+        {
+            for (uint8_t channels : kChannels)
+            {
+                const AudioFormat format = makeFormat(sampleFormat, channels);
+                for (size_t frames : kFrames)
+                {
+                    std::vector<uint8_t> in = randomSamples(sampleFormat, frames * channels, rng);
+
+                    std::vector<float> scalar(frames);
+                    std::vector<float> simd(frames);
+                    CHECK(convertToMonoFloat(in.data(), frames, format, scalar.data(), ConvertPath::Scalar) == frames);
+                    CHECK(convertToMonoFloat(in.data(), frames, format, simd.data(), ConvertPath::Simd) == frames);
+                    CHECK(sameBits(scalar, simd));
+
+                    std::vector<float> samplesScalar(frames * channels);
+                    std::vector<float> samplesSimd(frames * channels);
+                    convertSamplesToFloat(in.data(), frames * channels, sampleFormat, samplesScalar.data(), ConvertPath::Scalar);
+                    convertSamplesToFloat(in.data(), frames * channels, sampleFormat, samplesSimd.data(), ConvertPath::Simd);
+                    CHECK(sameBits(samplesScalar, samplesSimd));
+                }
+            }
+        }
+    }
+
+    void testInPlace()
+    {
+        std::mt19937 rng(7);
+        for (SampleFormat sampleFormat : kFormats)
+        {
+            for (uint8_t channels : kChannels)
+            {
+                const AudioFormat format = makeFormat(sampleFormat, channels);
+                for (size_t frames : kFrames)
+                {
+                    std::vector<uint8_t> in = randomSamples(sampleFormat, frames * channels, rng);
+                    std::vector<float> expected(frames);
+                    convertToMonoFloat(in.data(), frames, format, expected.data(), ConvertPath::Scalar);
+
+                    // Narrow mono input (S16, S24) grows while it is converted, the rest shrinks
+                    for (ConvertPath path : {ConvertPath::Scalar, ConvertPath::Simd})
+                    {
+                        const size_t capacity = std::max(in.size(), monoFloatBytes(format, in.size()));
+                        std::vector<uint8_t> buffer(capacity);
+                        std::memcpy(buffer.data(), in.data(), in.size());
+                        CHECK(convertToMonoFloatInPlace(buffer.data(), in.size(), buffer.size(), format, path) == frames);
+
+                        std::vector<float> converted(frames);
+                        std::memcpy(converted.data(), buffer.data(), frames * sizeof(float));
+                        CHECK(sameBits(converted, expected));
+                    }
+                }
+            }
+        }
+
+        // Too small a buffer for the float output is refused instead of overrun
+        std::vector<uint8_t> narrow(2 * 100);
+        CHECK(monoFloatBytes(makeFormat(SampleFormat::S16LE, 1), narrow.size()) == 400);
+        CHECK(convertToMonoFloatInPlace(narrow.data(), narrow.size(), narrow.size(), makeFormat(SampleFormat::S16LE, 1)) == 0);
+    }
+
+    void testUnsupported()
+    {
+        const uint8_t bytes[16] = {};
+        float out[4];
+        CHECK(convertToMonoFloat(bytes, 4, makeFormat(SampleFormat::Unknown, 1), out) == 0);
+        CHECK(monoFloatBytes(makeFormat(SampleFormat::Unknown, 2), sizeof(bytes)) == 0);
+    }
+
+    void testDcOffset()
+    {
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> noise(-0.25f, 0.25f);
+        for (size_t count : kFrames)
+        {
+            std::vector<float> signal(count);
+            for (float &sample : signal)
+            {
+                sample = 0.3f + noise(rng);
+            }
+
+            std::vector<float> scalar = signal;
+            std::vector<float> simd = signal;
+            removeDcOffset(scalar.data(), count, ConvertPath::Scalar);
+            removeDcOffset(simd.data(), count, ConvertPath::Simd);
+            CHECK(sameBits(scalar, simd));
+
+            double mean = 0.0;
+            for (float sample : simd)
+            {
+                mean += sample;
+            }
+            CHECK(std::fabs(mean / double(count)) < 1e-6);
+        }
+    }
+}
+
+int main()
+{
+    testKnownValues();
+    testSimdMatchesScalar();
+    testInPlace();
+    testUnsupported();
+    testDcOffset();
+    if (!simdConvertAvailable())
+    {
+        std::cout << "No SIMD conversion in this build, only the scalar path was checked" << std::endl;
+    }
+    return TEST_RESULT();
+}
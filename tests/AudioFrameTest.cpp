@@ -0,0 +1,121 @@
+#include "AudioFrame.h"
+#include "TestCheck.h"
+#include <cstring>
+
+namespace
+{
+    FrameHeader sampleHeader()
+    {
+        FrameHeader header;
+        header.type = FrameType::EndOfStream;
+        header.flags = FrameHeader::kFlagOverloaded | 2;
+        header.streamId = 0xA1B2C3D4;
+        header.sequence = 0x01020304;
+        header.timestampUs = 0x1122334455667788ull;
+        header.format.sampleRate = 44100;
+        header.format.channels = 2;
+        header.format.sampleFormat = SampleFormat::S16LE;
+        header.format.codec = CodecType::ImaAdpcm;
+        header.queueDepth = 7;
+        header.payloadLength = 123456;
+        return header;
+    }
+
+    void testRoundTrip()
+    {
+        const FrameHeader in = sampleHeader();
+        uint8_t bytes[FrameHeader::kSize + 4];
+        std::memset(bytes, 0xEE, sizeof(bytes));
+        encodeFrameHeader(in, bytes);
+        CHECK(bytes[FrameHeader::kSize] == 0xEE); // Nothing written past the header
+
+        FrameHeader out;
+        CHECK(decodeFrameHeader(bytes, sizeof(bytes), out) == FrameStatus::Ok);
+        CHECK(out.version == FrameHeader::kVersion);
+        CHECK(out.type == in.type);
+        CHECK(out.flags == in.flags);
+        CHECK(out.streamId == in.streamId);
+        CHECK(out.sequence == in.sequence);
+        CHECK(out.timestampUs == in.timestampUs);
+        CHECK(out.format.sampleRate == in.format.sampleRate);
+        CHECK(out.format.channels == in.format.channels);
+        CHECK(out.format.sampleFormat == in.format.sampleFormat);
+        CHECK(out.format.codec == in.format.codec);
+        CHECK(out.queueDepth == in.queueDepth);
+        CHECK(out.payloadLength == in.payloadLength);
+    }
+
+    void testWireLayout()
+    {
+        uint8_t bytes[FrameHeader::kSize];
+        encodeFrameHeader(sampleHeader(), bytes);
+
+        // "JRVS" magic, then little-endian fields at their documented offsets
+        CHECK(std::memcmp(bytes, "JRVS", 4) == 0);
+        CHECK(bytes[4] == FrameHeader::kVersion);
+        CHECK(bytes[5] == uint8_t(FrameType::EndOfStream));
+        CHECK(bytes[8] == 0xD4 && bytes[11] == 0xA1);
+        CHECK(bytes[16] == 0x88 && bytes[23] == 0x11);
+        CHECK(bytes[31] == 7);
+        CHECK(bytes[32] == 0x40 && bytes[33] == 0xE2 && bytes[34] == 0x01 && bytes[35] == 0x00);
+        CHECK(hasFrameMagic(bytes, sizeof(bytes)));
+        CHECK(!hasFrameMagic(bytes, 3));
+    }
+
+    void testTruncated()
+    {
+        uint8_t bytes[FrameHeader::kSize];
+        encodeFrameHeader(sampleHeader(), bytes);
+        for (size_t length = 0; length < FrameHeader::kSize; ++length)
+        {
+            FrameHeader out;
+            CHECK(decodeFrameHeader(bytes, length, out) == FrameStatus::NeedMore);
+        }
+    }
+
+    void testRejected()
+    {
+        uint8_t bytes[FrameHeader::kSize];
+        FrameHeader out;
+
+        encodeFrameHeader(sampleHeader(), bytes);
+        bytes[0] ^= 0x01;
+        CHECK(decodeFrameHeader(bytes, sizeof(bytes), out) == FrameStatus::BadMagic);
+        CHECK(!hasFrameMagic(bytes, sizeof(bytes)));
+
+        // An HTTP request on the same port must not look like a frame
+        const char *http = "POST /audio HTTP/1.1\r\nHost: jarvis\r\n\r\n";
+        CHECK(!hasFrameMagic(reinterpret_cast<const uint8_t *>(http), std::strlen(http)));
+
+        encodeFrameHeader(sampleHeader(), bytes);
+        bytes[4] = FrameHeader::kVersion + 1;
+        CHECK(decodeFrameHeader(bytes, sizeof(bytes), out) == FrameStatus::BadVersion);
+
+        encodeFrameHeader(sampleHeader(), bytes);
+        bytes[5] = 0;
+        CHECK(decodeFrameHeader(bytes, sizeof(bytes), out) == FrameStatus::BadType);
+        bytes[5] = uint8_t(FrameType::TaskStatus) + 1;
+        CHECK(decodeFrameHeader(bytes, sizeof(bytes), out) == FrameStatus::BadType);
+    }
+
+    void testEventFrames()
+    {
+        CHECK(!isEventFrame(FrameType::Audio));
+        CHECK(!isEventFrame(FrameType::Result));
+        CHECK(!isEventFrame(FrameType::Error));
+        CHECK(isEventFrame(FrameType::Partial));
+        CHECK(isEventFrame(FrameType::Final));
+        CHECK(isEventFrame(FrameType::Intent));
+        CHECK(isEventFrame(FrameType::TaskStatus));
+    }
+}
+
+int main()
+{
+    testRoundTrip();
+    testWireLayout();
+    testTruncated();
+    testRejected();
+    testEventFrames();
+    return TEST_RESULT();
+}
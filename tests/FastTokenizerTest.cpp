@@ -0,0 +1,159 @@
+#include "FastTokenizer.h"
+#include "TestCheck.h"
+#include <cctype>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    // Reference split: what Keras' text_to_word_sequence does with its default filters, plus
+    // the other ASCII whitespace FastTokenizer also separates on
+    std::vector<std::string> kerasSplit(const std::string &text)
+    {
+        const std::string filters = "!\"#$%&()*+,-./:;<=>?@[\\]^_`{|}~\t\n\r\v\f";
+        std::vector<std::string> words;
+        std::string word;
+        for (char c : text)
+        {
+            if (c == ' ' || filters.find(c) != std::string::npos)
+            {
+                if (!word.empty())
+                {
+                    words.push_back(word);
+                }
+                word.clear();
+            }
+            else
+            {
+                word += char(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        if (!word.empty())
+        {
+            words.push_back(word);
+        }
+        return words;
+    }
+
+    void testSplitMatchesKeras()
+    {
+        const std::vector<std::string> inputs = {
+            "Turn on the kitchen light",
+            "  play   Music, in the living-room!  ",
+            "set a timer for 10:30 (tomorrow) @home",
+            "what's the weather?\tin\nNew_York~{ok}|done",
+            "email: john.doe@example.com; subject=\"Hi\" [urgent]",
+            "don't stop Caf\xC3\xA9 na\xC3\xAFve",
+            "",
+            "?!.,",
+        };
+        for (const std::string &input : inputs)
+        {
+            TokenizedText text;
+            FastTokenizer::Split(input, text);
+            const std::vector<std::string> expected = kerasSplit(input);
+            CHECK(!text.truncated);
+            CHECK(text.count == expected.size());
+            for (size_t i = 0; i < text.count && i < expected.size(); ++i)
+            {
+                CHECK(text.Normalized(i) == expected[i]);
+
+                // The source span covers the same word as written
+                std::string source(text.Source(input, i));
+                CHECK(kerasSplit(source) == std::vector<std::string>{expected[i]});
+            }
+        }
+    }
+
+    void testSplitCapacity()
+    {
+        std::string many;
+        for (size_t i = 0; i < TokenizedText::kMaxWords + 5; ++i)
+        {
+            many += "w" + std::to_string(i) + " ";
+        }
+        TokenizedText text;
+        FastTokenizer::Split(many, text);
+        CHECK(text.truncated);
+        CHECK(text.count == TokenizedText::kMaxWords);
+        CHECK(text.Normalized(TokenizedText::kMaxWords - 1) == "w" + std::to_string(TokenizedText::kMaxWords - 1));
+
+        // A word that does not fit is dropped whole, the ones before it stay
+        std::string longWord = "short " + std::string(TokenizedText::kMaxChars, 'x');
+        FastTokenizer::Split(longWord, text);
+        CHECK(text.truncated);
+        CHECK(text.count == 1);
+        CHECK(text.Normalized(0) == "short");
+    }
+
+    void testFind()
+    {
+        FastTokenizer vocabulary;
+        vocabulary.Build({{"<UNK>", 1}, {"turn", 2}, {"Light", 3}, {"light", 4}, {"caf\xC3\xA9", 5}, {"", 6}});
+
+        CHECK(vocabulary.Size() == 4); // "" is skipped, "Light" and "light" are one word
+        CHECK(vocabulary.Find("turn") == 2);
+        CHECK(vocabulary.Find("TURN") == 2);
+        CHECK(vocabulary.Find("light") == 3 || vocabulary.Find("light") == 4);
+        CHECK(vocabulary.Find("<UNK>") == 1);
+        CHECK(vocabulary.Find("<unk>") == 1);
+        CHECK(vocabulary.Find("caf\xC3\xA9") == 5);
+        CHECK(vocabulary.Find("tur") == -1);
+        CHECK(vocabulary.Find("turns") == -1);
+        CHECK(vocabulary.Find("") == -1);
+
+        // Enough words to force collisions and probing in the open-addressing table
+        std::unordered_map<std::string, int> large;
+        for (int i = 0; i < 5000; ++i)
+        {
+            large["word" + std::to_string(i)] = i + 1;
+        }
+        vocabulary.Build(large);
+        CHECK(vocabulary.Size() == large.size());
+        int misses = 0;
+        for (const auto &[word, id] : large)
+        {
+            misses += vocabulary.Find(word) != id;
+        }
+        CHECK(misses == 0);
+        CHECK(vocabulary.Find("word5000") == -1);
+    }
+
+    void testEncode()
+    {
+        FastTokenizer vocabulary;
+        vocabulary.Build({{"<UNK>", 1}, {"turn", 2}, {"on", 3}, {"the", 4}, {"light", 5}});
+        const int32_t unknown = vocabulary.Find("<UNK>");
+
+        TokenizedText text;
+        FastTokenizer::Split("Turn ON the kitchen Light!", text);
+
+        int32_t ids[8];
+        vocabulary.Encode(text, ids, 8, unknown);
+        const int32_t expected[8] = {2, 3, 4, 1, 5, 0, 0, 0}; // "kitchen" falls back to <UNK>, then zero padding
+        for (size_t i = 0; i < 8; ++i)
+        {
+            CHECK(ids[i] == expected[i]);
+        }
+
+        // Fewer slots than words keeps the first ones
+        int32_t shortIds[3] = {-7, -7, -7};
+        vocabulary.Encode(text, shortIds, 3, unknown);
+        CHECK(shortIds[0] == 2 && shortIds[1] == 3 && shortIds[2] == 4);
+
+        // Without an <UNK> entry callers pass 0, missing words then look like padding
+        vocabulary.Build({{"turn", 2}});
+        vocabulary.Encode(text, ids, 3, 0);
+        CHECK(ids[0] == 2 && ids[1] == 0 && ids[2] == 0);
+    }
+}
+
+int main()
+{
+    testSplitMatchesKeras();
+    testSplitCapacity();
+    testFind();
+    testEncode();
+    return TEST_RESULT();
+}
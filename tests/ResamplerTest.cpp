@@ -0,0 +1,133 @@
+#include "Resampler.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // Feeds in (interleaved, `channels` wide) in chunks of chunkFrames and collects the output
+    std::vector<float> resample(Resampler &resampler, const std::vector<float> &in, uint8_t channels, size_t chunkFrames)
+    {
+        std::vector<float> out;
+        const size_t frames = in.size() / channels;
+        for (size_t offset = 0; offset < frames; offset += chunkFrames)
+        {
+            const size_t chunk = std::min(chunkFrames, frames - offset);
+            std::vector<float> buffer(resampler.maxOutputFrames(chunk) * channels);
+            const size_t written = resampler.process(in.data() + offset * channels, chunk, buffer.data());
+            CHECK(written <= resampler.maxOutputFrames(chunk));
+            out.insert(out.end(), buffer.begin(), buffer.begin() + written * channels);
+        }
+        return out;
+    }
+
+    size_t expectedFrames(uint32_t inputRate, uint32_t outputRate, size_t inputFrames)
+    {
+        // One output per 1/outputRate seconds, starting with the first input frame
+        return size_t((uint64_t(inputFrames) * outputRate + inputRate - 1) / inputRate);
+    }
+
+    void testOutputLength(uint32_t inputRate, uint32_t outputRate)
+    {
+        const size_t frames = inputRate / 2 + 37;
+        std::vector<float> in(frames, 0.25f);
+
+        // The count depends only on the total input, not on how it was split up
+        for (size_t chunk : {frames, size_t(1), size_t(160), size_t(441), size_t(1000)})
+        {
+            Resampler resampler(inputRate, outputRate);
+            CHECK(resample(resampler, in, 1, chunk).size() == expectedFrames(inputRate, outputRate, frames));
+        }
+    }
+
+    void testDcGain(uint32_t inputRate, uint32_t outputRate, uint8_t channels)
+    {
+        const size_t frames = inputRate / 4;
+        std::vector<float> in(frames * channels);
+        for (size_t f = 0; f < frames; ++f)
+        {
+            for (uint8_t c = 0; c < channels; ++c)
+            {
+                in[f * channels + c] = 0.5f * (c + 1);
+            }
+        }
+
+        Resampler resampler(inputRate, outputRate, channels);
+        std::vector<float> out = resample(resampler, in, channels, 512);
+
+        // Past the filter delay every phase must pass a constant through unchanged
+        const size_t settled = 64 * size_t(outputRate) / inputRate + 64;
+        size_t checked = 0;
+        for (size_t f = settled; f < out.size() / channels; ++f)
+        {
+            for (uint8_t c = 0; c < channels; ++c)
+            {
+                const float expected = 0.5f * (c + 1);
+                CHECK(std::fabs(out[f * channels + c] - expected) < 1e-3f * expected);
+                ++checked;
+            }
+        }
+        CHECK(checked > 0);
+    }
+
+    void testStreamingMatchesOneShot()
+    {
+        std::vector<float> in(22050);
+        for (size_t i = 0; i < in.size(); ++i)
+        {
+            in[i] = float(std::sin(2.0 * M_PI * 1000.0 * i / 44100.0));
+        }
+
+        Resampler whole(44100, 16000);
+        Resampler chunked(44100, 16000);
+        CHECK(resample(whole, in, 1, in.size()) == resample(chunked, in, 1, 333));
+
+        // After reset() the same input yields the same output as a fresh instance
+        whole.reset();
+        Resampler fresh(44100, 16000);
+        CHECK(resample(whole, in, 1, 1024) == resample(fresh, in, 1, 1024));
+    }
+
+    void testInvalid()
+    {
+        bool threw = false;
+        try
+        {
+            Resampler resampler(0, 16000);
+        }
+        catch (const std::invalid_argument &)
+        {
+            threw = true;
+        }
+        CHECK(threw);
+
+        // 16000 -> 44101 needs 44101 phases of 32 taps, past the bank size limit
+        threw = false;
+        try
+        {
+            Resampler resampler(16000, 44101);
+        }
+        catch (const std::invalid_argument &)
+        {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+}
+
+int main()
+{
+    testOutputLength(44100, 16000);
+    testOutputLength(48000, 16000);
+    testOutputLength(8000, 16000);
+    testOutputLength(16000, 16000);
+    testDcGain(44100, 16000, 1);
+    testDcGain(48000, 16000, 2);
+    testDcGain(8000, 16000, 1);
+    testDcGain(22050, 16000, 2);
+    testStreamingMatchesOneShot();
+    testInvalid();
+    return TEST_RESULT();
+}
@@ -0,0 +1,169 @@
+#include "TensorView.h"
+#include "TestCheck.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Scalar references the vector kernels must agree with
+    size_t referenceArgMax(const float *values, size_t count)
+    {
+        return size_t(std::max_element(values, values + count) - values); // First maximum on ties
+    }
+
+    std::vector<size_t> referenceTopK(const float *values, size_t count, size_t k)
+    {
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [values](size_t a, size_t b)
+                         { return values[a] > values[b]; });
+        order.resize(std::min(k, count));
+        return order;
+    }
+
+    std::vector<double> referenceSoftmax(const float *values, size_t count)
+    {
+        const double shift = *std::max_element(values, values + count);
+        std::vector<double> out(count);
+        double sum = 0.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            out[i] = std::exp(double(values[i]) - shift);
+            sum += out[i];
+        }
+        for (double &value : out)
+        {
+            value /= sum;
+        }
+        return out;
+    }
+
+    // Sizes around the vector width, so every mix of full blocks and scalar tail is covered
+    const size_t kCounts[] = {1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 64, 100, 1001};
+
+    void testArgMaxTies()
+    {
+        // Equal maxima in different lanes and blocks, the lowest index must win
+        for (size_t count : kCounts)
+        {
+            for (size_t first = 0; first < count; ++first)
+            {
+                std::vector<float> values(count, -1.0f);
+                for (size_t i = first; i < count; i += 3)
+                {
+                    values[i] = 2.0f;
+                }
+                CHECK(ArgMaxRow(values.data(), count) == first);
+            }
+        }
+
+        std::vector<float> constant(37, 0.5f);
+        CHECK(ArgMaxRow(constant.data(), constant.size()) == 0);
+
+        const float negative[] = {-3.0f, -1.0f, -2.0f, -1.0f, -5.0f, -1.0f};
+        CHECK(ArgMaxRow(negative, 6) == 1);
+    }
+
+    void testRandomRows()
+    {
+        std::mt19937 rng(1234);
+        std::normal_distribution<float> logits(0.0f, 4.0f);
+        std::uniform_int_distribution<int> coarse(-3, 3); // Few distinct values, plenty of ties
+
+        for (int round = 0; round < 50; ++round)
+        {
+            for (size_t count : kCounts)
+            {
+                std::vector<float> values(count);
+                for (float &value : values)
+                {
+                    value = round % 2 ? logits(rng) : float(coarse(rng));
+                }
+
+                CHECK(ArgMaxRow(values.data(), count) == referenceArgMax(values.data(), count));
+
+                for (size_t k : {size_t(1), size_t(2), size_t(3), size_t(5), count, count + 2})
+                {
+                    std::vector<size_t> indices(k);
+                    const size_t written = TopKRow(values.data(), count, k, indices.data());
+                    const std::vector<size_t> expected = referenceTopK(values.data(), count, k);
+                    CHECK(written == expected.size());
+
+                    // Ties may come in any order, the values must match the reference ranking
+                    for (size_t i = 0; i < written && i < expected.size(); ++i)
+                    {
+                        CHECK(values[indices[i]] == values[expected[i]]);
+                    }
+                    std::vector<size_t> sorted(indices.begin(), indices.begin() + written);
+                    std::sort(sorted.begin(), sorted.end());
+                    CHECK(std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end());
+                }
+
+                std::vector<float> probabilities(count);
+                SoftmaxRow(values.data(), count, probabilities.data());
+                const std::vector<double> expected = referenceSoftmax(values.data(), count);
+                double sum = 0.0;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    CHECK(std::fabs(probabilities[i] - expected[i]) <= 1e-6 + 1e-5 * expected[i]);
+                    sum += probabilities[i];
+                }
+                CHECK(std::fabs(sum - 1.0) < 1e-5);
+            }
+        }
+    }
+
+    void testSoftmaxExtremes()
+    {
+        // Large logits must not overflow, very negative ones underflow to 0 instead of NaN
+        const float values[] = {1000.0f, 999.0f, -1000.0f, 0.0f, 1000.0f, -1e30f, 998.0f, 1.0f, -200.0f};
+        const size_t count = sizeof(values) / sizeof(values[0]);
+        float out[count];
+        SoftmaxRow(values, count, out);
+        const std::vector<double> expected = referenceSoftmax(values, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            CHECK(std::isfinite(out[i]));
+            CHECK(std::fabs(out[i] - expected[i]) <= 1e-6 + 1e-5 * expected[i]);
+        }
+
+        // In place
+        float inPlace[5] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+        SoftmaxRow(inPlace, 5, inPlace);
+        const float copy[5] = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+        const std::vector<double> reference = referenceSoftmax(copy, 5);
+        for (size_t i = 0; i < 5; ++i)
+        {
+            CHECK(std::fabs(inPlace[i] - reference[i]) <= 1e-6 + 1e-5 * reference[i]);
+        }
+    }
+
+    void testView()
+    {
+        const float data[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+        TensorView view(data, 4, 3);
+        CHECK(view.Rows() == 4 && view.Cols() == 3 && !view.Empty());
+        CHECK(view(2, 1) == 7.0f);
+        CHECK(view.Row(3)[0] == 9.0f);
+
+        TensorView slice = view.Slice(1, 2);
+        CHECK(slice.Rows() == 2 && slice.Cols() == 3);
+        CHECK(slice(0, 0) == 3.0f && slice(1, 2) == 8.0f);
+
+        CHECK(TensorView().Empty());
+        CHECK(TensorView(data, 0, 3).Empty());
+        CHECK(TopKRow(data, 12, 0, nullptr) == 0);
+    }
+}
+
+int main()
+{
+    testArgMaxTies();
+    testRandomRows();
+    testSoftmaxExtremes();
+    testView();
+    return TEST_RESULT();
+}
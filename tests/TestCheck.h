@@ -0,0 +1,22 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <iostream>
+
+// Minimal checks for the unit tests. A failed CHECK reports the expression and the test goes
+// on; main() returns TEST_RESULT() so ctest marks the executable failed.
+inline int testFailures = 0;
+
+#define CHECK(expr)                                                                               \
+    do                                                                                            \
+    {                                                                                             \
+        if (!(expr))                                                                              \
+        {                                                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #expr << std::endl;   \
+            ++testFailures;                                                                       \
+        }                                                                                         \
+    } while (0)
+
+#define TEST_RESULT() (testFailures == 0 ? 0 : 1)
+
+#endif // TEST_CHECK_H
@@ -0,0 +1,152 @@
+#include "VoiceActivity.h"
+#include "TestCheck.h"
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+    constexpr uint32_t kRate = 16000;
+
+    size_t samplesAt(double seconds)
+    {
+        return size_t(seconds * kRate);
+    }
+
+    // Faint background noise, well below anything the detector should call speech
+    std::vector<float> background(double seconds, std::mt19937 &rng)
+    {
+        std::normal_distribution<float> noise(0.0f, 0.003f);
+        std::vector<float> samples(samplesAt(seconds));
+        for (float &sample : samples)
+        {
+            sample = noise(rng);
+        }
+        return samples;
+    }
+
+    // Voiced-speech stand-in: a low tone with a slow syllable-rate envelope
+    void addBurst(std::vector<float> &samples, double from, double to)
+    {
+        for (size_t i = samplesAt(from); i < samplesAt(to) && i < samples.size(); ++i)
+        {
+            const double t = double(i) / kRate;
+            samples[i] += float(0.2 * std::sin(2.0 * M_PI * 180.0 * t) * (0.6 + 0.4 * std::sin(2.0 * M_PI * 3.0 * t)));
+        }
+    }
+
+    // Segment edges are frame aligned, so they may be off by up to one frame
+    bool near(size_t sample, double seconds)
+    {
+        const double frame = VadParams().frame_ms / 1000.0;
+        return std::fabs(double(sample) / kRate - seconds) <= frame + 1e-9;
+    }
+
+    void testSilenceAndNoise()
+    {
+        std::vector<float> silence(samplesAt(1.0), 0.0f);
+        CHECK(detectSpeech(silence.data(), silence.size(), kRate).empty());
+        CHECK(trimToSpeech(silence.data(), silence.size(), kRate) == 0);
+
+        std::mt19937 rng(1);
+        std::vector<float> quiet = background(2.0, rng);
+        CHECK(trimToSpeech(quiet.data(), quiet.size(), kRate) == 0);
+
+        // Loud broadband hiss clears the level threshold but crosses zero far too often
+        std::normal_distribution<float> hiss(0.0f, 0.1f);
+        std::vector<float> loud(samplesAt(2.0));
+        for (float &sample : loud)
+        {
+            sample = hiss(rng);
+        }
+        CHECK(trimToSpeech(loud.data(), loud.size(), kRate) == 0);
+    }
+
+    void testBurstKeepsPadding()
+    {
+        std::mt19937 rng(2);
+        std::vector<float> samples = background(3.0, rng);
+        addBurst(samples, 1.0, 1.5);
+        const std::vector<float> original = samples;
+
+        const double padding = VadParams().padding_ms / 1000.0;
+        std::vector<SpeechSegment> segments = detectSpeech(samples.data(), samples.size(), kRate);
+        CHECK(segments.size() == 1);
+        if (segments.size() != 1)
+        {
+            return;
+        }
+        CHECK(near(segments[0].begin, 1.0 - padding));
+        CHECK(near(segments[0].end, 1.5 + padding));
+
+        // trimToSpeech keeps exactly that span, untouched
+        const size_t kept = trimToSpeech(samples.data(), samples.size(), kRate);
+        CHECK(kept == segments[0].end - segments[0].begin);
+        bool same = true;
+        for (size_t i = 0; i < kept; ++i)
+        {
+            same = same && samples[i] == original[segments[0].begin + i];
+        }
+        CHECK(same);
+    }
+
+    void testClickDropped()
+    {
+        // 40 ms is well under min_speech_ms
+        std::mt19937 rng(3);
+        std::vector<float> samples = background(2.0, rng);
+        addBurst(samples, 1.0, 1.04);
+        CHECK(detectSpeech(samples.data(), samples.size(), kRate).empty());
+        CHECK(trimToSpeech(samples.data(), samples.size(), kRate) == 0);
+    }
+
+    void testPauses()
+    {
+        const VadParams params;
+        const double padding = params.padding_ms / 1000.0;
+
+        // A pause shorter than max_gap_ms stays inside one segment. 400 ms is also longer than
+        // the padding on both sides, so only the bridging can close it.
+        std::mt19937 rng(4);
+        std::vector<float> bridged = background(3.0, rng);
+        addBurst(bridged, 0.8, 1.3);
+        addBurst(bridged, 1.7, 2.1);
+        std::vector<SpeechSegment> segments = detectSpeech(bridged.data(), bridged.size(), kRate, params);
+        CHECK(segments.size() == 1);
+        if (segments.size() == 1)
+        {
+            CHECK(near(segments[0].begin, 0.8 - padding));
+            CHECK(near(segments[0].end, 2.1 + padding));
+        }
+
+        // A long pause splits the utterance; trimming joins the halves with join_gap_ms of silence
+        std::vector<float> split = background(4.0, rng);
+        addBurst(split, 0.8, 1.3);
+        addBurst(split, 2.5, 3.0);
+        segments = detectSpeech(split.data(), split.size(), kRate, params);
+        CHECK(segments.size() == 2);
+        if (segments.size() != 2)
+        {
+            return;
+        }
+        const size_t first = segments[0].end - segments[0].begin;
+        const size_t second = segments[1].end - segments[1].begin;
+        const size_t gap = samplesAt(params.join_gap_ms / 1000.0);
+        CHECK(trimToSpeech(split.data(), split.size(), kRate, params) == first + gap + second);
+        bool silent = true;
+        for (size_t i = first; i < first + gap; ++i)
+        {
+            silent = silent && split[i] == 0.0f;
+        }
+        CHECK(silent);
+    }
+}
+
+int main()
+{
+    testSilenceAndNoise();
+    testBurstKeepsPadding();
+    testClickDropped();
+    testPauses();
+    return TEST_RESULT();
+}